@@ -66,6 +66,7 @@
 #include "version.h"
 #include "stats_latency.h"
 #include "handle_cgnat.h"
+#include "prox_events.h"
 #include "handle_impair.h"
 #include "rx_pkt.h"
 
@@ -383,10 +384,8 @@ static int parse_cmd_count(const char *str, struct input *input)
 				plog_err("Core %u task %u is not generating packets\n", lcore_id, task_id);
 			}
 			else {
-				struct task_base *task = lcore_cfg[lcore_id].tasks_all[task_id];
-
 				log_pkt_count(count, lcore_id, task_id);
-				task_gen_set_pkt_count(task, count);
+				cmd_task_set(lcore_id, task_id, task_gen_msg_set_pkt_count, count);
 			}
 		}
 	}
@@ -525,8 +524,9 @@ static int parse_cmd_pkt_size(const char *str, struct input *input)
 			}
 			struct task_base *tbase = lcore_cfg[lcore_id].tasks_all[task_id];
 
-			if (task_gen_set_pkt_size(tbase, pkt_size) != 0)
+			if (task_gen_check_pkt_size(tbase, pkt_size) != 0)
 				return -1;
+			cmd_task_set(lcore_id, task_id, task_gen_msg_set_pkt_size, pkt_size);
 		}
 	}
 	return 0;
@@ -559,12 +559,11 @@ static int parse_cmd_speed(const char *str, struct input *input)
 			plog_err("Speed out of range (must be betweeen 0%% and 100%%)\n");
 		}
 		else {
-			struct task_base *tbase = lcore_cfg[lcore_id].tasks_all[task_id];
 			uint64_t bps = speed * 12500000;
 
 			plog_info("Setting rate to %"PRIu64" Bps\n", bps);
 
-			task_gen_set_rate(tbase, bps);
+			cmd_task_set(lcore_id, task_id, task_gen_set_rate, bps);
 		}
 	}
 	return 0;
@@ -593,10 +592,8 @@ static int parse_cmd_speed_byte(const char *str, struct input *input)
 				plog_err("Speed out of range (must be <= 1250000000)\n");
 			}
 			else {
-				struct task_base *tbase = lcore_cfg[lcore_id].tasks_all[task_id];
-
 				plog_info("Setting rate to %"PRIu64" Bps\n", bps);
-				task_gen_set_rate(tbase, bps);
+				cmd_task_set(lcore_id, task_id, task_gen_set_rate, bps);
 			}
 		}
 	}
@@ -758,6 +755,64 @@ static int parse_cmd_thread_info(const char *str, struct input *input)
 	return 0;
 }
 
+static int parse_cmd_acl_stats(const char *str, struct input *input)
+{
+	unsigned lcores[RTE_MAX_LCORE], task_id, nb_cores;
+
+	if (parse_core_task(str, lcores, &task_id, &nb_cores))
+		return -1;
+	cmd_acl_stats(lcores, nb_cores, task_id);
+	return 0;
+}
+
+static int parse_cmd_acl_algorithm(const char *str, struct input *input)
+{
+	unsigned lcores[RTE_MAX_LCORE], task_id, nb_cores;
+	char alg[16];
+
+	if (parse_core_task(str, lcores, &task_id, &nb_cores))
+		return -1;
+	if (!(str = strchr_skip_twice(str, ' ')))
+		return -1;
+	if (sscanf(str, "%15s", alg) != 1)
+		return -1;
+
+	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
+		for (unsigned int i = 0; i < nb_cores; i++) {
+			if (!task_is_mode(lcores[i], task_id, "acl", "")) {
+				plog_err("Core %u task %u is not an ACL task\n", lcores[i], task_id);
+				continue;
+			}
+			task_acl_set_alg(lcore_cfg[lcores[i]].tasks_all[task_id], alg);
+		}
+	}
+	return 0;
+}
+
+static int parse_cmd_acl_benchmark(const char *str, struct input *input)
+{
+	unsigned lcores[RTE_MAX_LCORE], task_id, nb_cores;
+	unsigned n_tuples = 65536, seed = 0;
+
+	if (parse_core_task(str, lcores, &task_id, &nb_cores))
+		return -1;
+	if ((str = strchr_skip_twice(str, ' ')) != NULL) {
+		if (sscanf(str, "%u %u", &n_tuples, &seed) < 1 || n_tuples == 0)
+			return -1;
+	}
+
+	if (cores_task_are_valid(lcores, task_id, nb_cores)) {
+		for (unsigned int i = 0; i < nb_cores; i++) {
+			if (!task_is_mode(lcores[i], task_id, "acl", "")) {
+				plog_err("Core %u task %u is not an ACL task\n", lcores[i], task_id);
+				continue;
+			}
+			task_acl_benchmark(lcore_cfg[lcores[i]].tasks_all[task_id], n_tuples, seed);
+		}
+	}
+	return 0;
+}
+
 static int parse_cmd_verbose(const char *str, struct input *input)
 {
 	unsigned id;
@@ -834,6 +889,14 @@ static int parse_cmd_rule_add(const char *str, struct input *input)
 		if (str_to_rule(&rule, fields, -1, 1) == 0) {
 			for (unsigned int i = 0; i < nb_cores; i++) {
 				lcore_id = lcores[i];
+				if (task_is_mode(lcore_id, task_id, "acl", "") &&
+				    (lcore_cfg[lcore_id].targs[task_id].flags & TASK_ARG_ACL_SHADOW)) {
+					/* Built here instead of on the ACL core */
+					struct acl4_rule shadow_rule = rule;
+
+					task_acl_add_rules(lcore_cfg[lcore_id].tasks_all[task_id], &shadow_rule, 1);
+					continue;
+				}
 				ring = ctrl_rings[lcore_id*MAX_TASKS_PER_CORE + task_id];
 				if (!ring) {
 					plog_err("No ring for control messages to core %u task %u\n", lcore_id, task_id);
@@ -959,6 +1022,20 @@ static int parse_cmd_route_add(const char *str, struct input *input)
 	return 0;
 }
 
+static int parse_cmd_route_reload(const char *str, struct input *input)
+{
+	char name[256], lua_file[256];
+	int n;
+
+	n = sscanf(str, "%255s %255s", name, lua_file);
+	if (n < 1)
+		return -1;
+
+	/* Errors are reported by cmd_route_reload() */
+	cmd_route_reload(name, n == 2 ? lua_file : NULL);
+	return 0;
+}
+
 static int parse_cmd_start(const char *str, struct input *input)
 {
 	int task_id = -1;
@@ -1153,6 +1230,76 @@ static int parse_cmd_tx_distr_show(const char *str, struct input *input)
 	return 0;
 }
 
+static int parse_cmd_cycles_distr_start(const char *str, struct input *input)
+{
+	unsigned lcore_id[RTE_MAX_LCORE];
+
+	int nb_cores;
+
+	nb_cores = parse_list_set(lcore_id, str, sizeof(lcore_id)/sizeof(lcore_id[0]));
+
+	if (nb_cores <= 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < nb_cores; ++i)
+		cmd_cycles_distr_start(lcore_id[i]);
+	req_refresh();
+	return 0;
+}
+
+static int parse_cmd_cycles_distr_stop(const char *str, struct input *input)
+{
+	unsigned lcore_id[RTE_MAX_LCORE];
+
+	int nb_cores;
+
+	nb_cores = parse_list_set(lcore_id, str, sizeof(lcore_id)/sizeof(lcore_id[0]));
+
+	if (nb_cores <= 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < nb_cores; ++i)
+		cmd_cycles_distr_stop(lcore_id[i]);
+	req_refresh();
+	return 0;
+}
+
+static int parse_cmd_cycles_distr_reset(const char *str, struct input *input)
+{
+	unsigned lcore_id[RTE_MAX_LCORE];
+
+	int nb_cores;
+
+	nb_cores = parse_list_set(lcore_id, str, sizeof(lcore_id)/sizeof(lcore_id[0]));
+
+	if (nb_cores <= 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < nb_cores; ++i)
+		cmd_cycles_distr_rst(lcore_id[i]);
+	return 0;
+}
+
+static int parse_cmd_cycles_distr_show(const char *str, struct input *input)
+{
+	unsigned lcore_id[RTE_MAX_LCORE];
+
+	int nb_cores;
+
+	nb_cores = parse_list_set(lcore_id, str, sizeof(lcore_id)/sizeof(lcore_id[0]));
+
+	if (nb_cores <= 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < nb_cores; ++i)
+		cmd_cycles_distr_show(lcore_id[i]);
+	return 0;
+}
+
 static int parse_cmd_tot_stats(const char *str, struct input *input)
 {
 	if (strcmp("", str) != 0) {
@@ -1646,18 +1793,29 @@ static int parse_cmd_lat_stats(const char *str, struct input *input)
 				uint64_t tot_lat_min_usec = time_unit_to_usec(&tot->min.time);
 				uint64_t tot_lat_max_usec = time_unit_to_usec(&tot->max.time);
 				uint64_t lat_avg_usec = time_unit_to_usec(&stats->avg.time);
+				uint64_t lat_pct_usec[LAT_N_PERCENTILES];
+
+				for (int p = 0; p < LAT_N_PERCENTILES; ++p)
+					lat_pct_usec[p] = time_unit_to_usec(&stats->percentile[p]);
 
 				if (input->reply) {
-					char buf[128];
+					char buf[256];
+					/* Percentiles are appended so that existing
+					   users of the first fields keep working */
 					snprintf(buf, sizeof(buf),
-					 	"%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64"\n",
+					 	"%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64",%"PRIu64"\n",
 						 lat_min_usec,
 						 lat_max_usec,
 						 lat_avg_usec,
 						 tot_lat_min_usec,
 						 tot_lat_max_usec,
 						 last_tsc,
-						 rte_get_tsc_hz());
+						 rte_get_tsc_hz(),
+						 lat_pct_usec[LAT_P50],
+						 lat_pct_usec[LAT_P90],
+						 lat_pct_usec[LAT_P99],
+						 lat_pct_usec[LAT_P99_9],
+						 lat_pct_usec[LAT_P99_99]);
 					input->reply(input, buf, strlen(buf));
 				}
 				else {
@@ -1667,6 +1825,12 @@ static int parse_cmd_lat_stats(const char *str, struct input *input)
 						  lat_avg_usec,
 						  tot_lat_min_usec,
 						  tot_lat_max_usec);
+					plog_info("p50: %"PRIu64", p90: %"PRIu64", p99: %"PRIu64", p99.9: %"PRIu64", p99.99: %"PRIu64"\n",
+						  lat_pct_usec[LAT_P50],
+						  lat_pct_usec[LAT_P90],
+						  lat_pct_usec[LAT_P99],
+						  lat_pct_usec[LAT_P99_9],
+						  lat_pct_usec[LAT_P99_99]);
 				}
 			}
 		}
@@ -1791,6 +1955,46 @@ static int parse_cmd_cgnat_private_hash(const char *str, struct input *input)
 	return 0;
 }
 
+static int parse_cmd_events(const char *str, struct input *input)
+{
+	uint32_t lcores[RTE_MAX_LCORE];
+	uint32_t *list = NULL;
+	int nb_cores = 0;
+	uint64_t suppressed = 0;
+	char buf[128];
+
+	if (strcmp(str, "") != 0) {
+		if ((nb_cores = parse_list_set(lcores, str, RTE_MAX_LCORE)) <= 0) {
+			plog_err("Invalid core while parsing command (%s)\n", get_parse_err());
+			return -1;
+		}
+		list = lcores;
+		for (int i = 0; i < nb_cores; i++)
+			suppressed += event_suppressed_get(lcores[i]);
+	} else {
+		for (uint32_t lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+			suppressed += event_suppressed_get(lcore_id);
+	}
+
+	for (int event = 0; event < N_PROX_EVENTS; event++) {
+		uint64_t count = event_count_get(event, list, nb_cores);
+
+		if (input->reply) {
+			snprintf(buf, sizeof(buf), "%s,%"PRIu64"\n", event_name(event), count);
+			input->reply(input, buf, strlen(buf));
+		} else if (count) {
+			plog_info("%-24s %"PRIu64"\n", event_name(event), count);
+		}
+	}
+	if (input->reply) {
+		snprintf(buf, sizeof(buf), "suppressed,%"PRIu64"\n", suppressed);
+		input->reply(input, buf, strlen(buf));
+	} else {
+		plog_info("%"PRIu64" event samples were not logged because of rate limiting\n", suppressed);
+	}
+	return 0;
+}
+
 static int parse_cmd_accuracy(const char *str, struct input *input)
 {
 	unsigned lcores[RTE_MAX_LCORE], lcore_id, task_id, nb_cores;
@@ -1888,6 +2092,10 @@ static struct cmd_str cmd_strings[] = {
 	{"tx distr stop", "", "Stop gathering statistical distribution of xmitted packets", parse_cmd_tx_distr_stop},
 	{"tx distr reset", "", "Reset gathered statistical distribution of xmitted packets", parse_cmd_tx_distr_reset},
 	{"tx distr show", "", "Display gathered statistical distribution of xmitted packets", parse_cmd_tx_distr_show},
+	{"cycles distr start", "", "Start measuring cycles spent in handle_bulk, per burst size", parse_cmd_cycles_distr_start},
+	{"cycles distr stop", "", "Stop measuring cycles spent in handle_bulk", parse_cmd_cycles_distr_stop},
+	{"cycles distr reset", "", "Reset measured cycles per burst size", parse_cmd_cycles_distr_reset},
+	{"cycles distr show", "", "Display number of calls, cycles per call and cycles per packet for each burst size", parse_cmd_cycles_distr_show},
 
 	{"rate", "<port id> <queue id> <rate>", "rate does not include preamble, SFD and IFG", parse_cmd_rate},
 	{"count","<core id> <task id> <count>", "Generate <count> packets", parse_cmd_count},
@@ -1904,7 +2112,11 @@ static struct cmd_str cmd_strings[] = {
 
 	{"arp add", "<core id> <task id> <port id> <gre id> <svlan> <cvlan> <ip addr> <mac addr> <user>", "Add a single ARP entry into a CPE table on <core id>/<task id>.", parse_cmd_arp_add},
 	{"rule add", "<core id> <task id> svlan_id&mask cvlan_id&mask ip_proto&mask source_ip/prefix destination_ip/prefix range dport_range action", "Add a rule to the ACL table on <core id>/<task id>", parse_cmd_rule_add},
+	{"acl stats", "<core list> <task id>", "Show the number of packets and bytes matching each ACL rule and a histogram of the cycles spent classifying each burst, summed over all cores in <core list>. Requires acl stats=yes for the task", parse_cmd_acl_stats},
+	{"acl algorithm", "<core list> <task id> <algorithm>", "Select the rte_acl classify algorithm used by the ACL task: default, scalar, sse, avx2, avx512x16 or avx512x32", parse_cmd_acl_algorithm},
+	{"acl benchmark", "<core list> <task id> [<n tuples> [<seed>]]", "Classify <n tuples> (default 65536) random tuples against the rules of the ACL task with each available algorithm and report the lookup rate. Runs on the master core; the ACL task is not interrupted", parse_cmd_acl_benchmark},
 	{"route add", "<core id> <task id> <ip/prefix> <next hop id>", "Add a route to the routing table on core <core id> <task id>. Example: route add 10.0.16.0/24 9", parse_cmd_route_add},
+	{"route reload", "<table> [<lua file>]", "Replace route table <table> used by all routing, qinq_decap4 and cgnat tasks without stopping them. The new table is read from <lua file>, which must return it, or else from the Lua variable <table>. Routes added with 'route add' since startup are not kept. Example: route reload lpm4 ipv4.lua", parse_cmd_route_reload},
 	{"gateway ip", "<core id> <task id> <ip>", "Define/Change IP address of destination gateway on core <core id> <task id>.", parse_cmd_gateway_ip},
 	{"local ip", "<core id> <task id> <ip>", "Define/Change IP address of destination gateway on core <core id> <task id>.", parse_cmd_local_ip},
 
@@ -1914,7 +2126,7 @@ static struct cmd_str cmd_strings[] = {
 	{"tot stats", "", "Print total RX and TX packets", parse_cmd_tot_stats},
 	{"tot ierrors tot", "", "Print total number of ierrors since reset", parse_cmd_tot_ierrors_tot},
 	{"tot imissed tot", "", "Print total number of imissed since reset", parse_cmd_tot_imissed_tot},
-	{"lat stats", "<core id> <task id>", "Print min,max,avg latency as measured during last sampling interval", parse_cmd_lat_stats},
+	{"lat stats", "<core id> <task id>", "Print min,max,avg latency and p50,p90,p99,p99.9,p99.99 percentiles as measured during last sampling interval", parse_cmd_lat_stats},
 	{"irq stats", "<core id> <task id>", "Print irq related infos", parse_cmd_irq},
 	{"lat packets", "<core id> <task id>", "Print the latency for each of the last set of packets", parse_cmd_lat_packets},
 	{"accuracy limit", "<core id> <task id> <nsec>", "Only consider latency of packets that were measured with an error no more than <nsec>", parse_cmd_accuracy},
@@ -1941,6 +2153,7 @@ static struct cmd_str cmd_strings[] = {
 	{"stats", "<stats_path>", "Get stats as sepcified by <stats_path>. A comma-separated list of <stats_path> can be supplied", parse_cmd_stats},
 	{"cgnat dump public hash", "<core id> <task id>", "Dump cgnat public hash table", parse_cmd_cgnat_public_hash},
 	{"cgnat dump private hash", "<core id> <task id>", "Dump cgnat private hash table", parse_cmd_cgnat_private_hash},
+	{"events", "[<core list>]", "Print the number of datapath events (session creation, allocation failures, ...) counted on the cores in <core list>, or on all cores. A rate limited sample of the events is logged by the master core", parse_cmd_events},
 	{"delay_us", "<core_id> <task_id> <delay_us>", "Set the delay in usec for the impair mode to <delay_us>", parse_cmd_delay_us},
 	{"random delay_us", "<core_id> <task_id> <random delay_us>", "Set the delay in usec for the impair mode to <random delay_us>", parse_cmd_random_delay_us},
 	{"probability", "<core_id> <task_id> <probability>", "Set the percent of forwarded packets for the impair mode", parse_cmd_set_probability},
@@ -52,6 +52,10 @@
 #include "rw_reg.h"
 #include "cqm.h"
 #include "stats_core.h"
+#include "prox_lua.h"
+#include "prox_lua_types.h"
+#include "route_table.h"
+#include "handle_acl.h"
 
 void start_core_all(int task_id)
 {
@@ -97,10 +101,12 @@ static void warn_inactive_cores(uint32_t *cores, int count, const char *prefix)
 	}
 }
 
-static inline int wait_command_handled(struct lcore_cfg *lconf)
+/* Wait until at most max_pending commands are still to be handled by
+   the core. */
+static int wait_commands_pending(struct lcore_cfg *lconf, uint32_t max_pending)
 {
 	uint64_t t1 = rte_rdtsc(), t2;
-	while (lconf_is_req(lconf)) {
+	while (lconf_n_req(lconf) > max_pending) {
 		t2 = rte_rdtsc();
 		if (t2 - t1 > 5 * rte_get_tsc_hz()) {
 			// Failed to handle command ...
@@ -118,6 +124,32 @@ static inline int wait_command_handled(struct lcore_cfg *lconf)
 	return 0;
 }
 
+static inline int wait_command_handled(struct lcore_cfg *lconf)
+{
+	return wait_commands_pending(lconf, 0);
+}
+
+/* Queue a command for the core, waiting only if its mailbox is
+   full. Cores that are not running have no thread to handle the
+   command, so it is handled directly. */
+static int send_msg(struct lcore_cfg *lconf, const struct lconf_msg *msg)
+{
+	if (wait_commands_pending(lconf, LCONF_MSG_RING_SIZE - 1) == -1)
+		return -1;
+	return lconf_send_msg(lconf, msg);
+}
+
+static int send_command(struct lcore_cfg *lconf, enum lconf_msg_type type, int task_id, int val)
+{
+	struct lconf_msg msg = {
+		.type = type,
+		.task_id = task_id,
+		.val = val,
+	};
+
+	return send_msg(lconf, &msg);
+}
+
 static inline void start_l3(struct task_args *targ)
 {
 	if (!task_is_master(targ)) {
@@ -149,9 +181,16 @@ void start_cores(uint32_t *cores, int count, int task_id)
 				targ = &lconf->targs[task_id];
 				start_l3(targ);
 			}
-			lconf->msg.type = LCONF_MSG_START;
-			lconf->msg.task_id = task_id;
-			lconf_set_req(lconf);
+			struct lconf_msg msg = {
+				.type = LCONF_MSG_START,
+				.task_id = task_id,
+			};
+
+			/* The core is not running: the message is
+			   handled once the core has been launched. */
+			if (wait_commands_pending(lconf, LCONF_MSG_RING_SIZE - 1) == -1)
+				return;
+			lconf_post_msg(lconf, &msg);
 			if (task_id == -1)
 				plog_info("Starting core %u (all tasks)\n", cores[i]);
 			else
@@ -186,11 +225,14 @@ void stop_cores(uint32_t *cores, int count, int task_id)
 	for (int i = 0; i < count; ++i) {
 		struct lcore_cfg *lconf = &lcore_cfg[cores[i]];
 		if (lconf->n_tasks_run) {
-			if (wait_command_handled(lconf) == -1) return;
-
-			lconf->msg.type = LCONF_MSG_STOP;
-			lconf->msg.task_id = task_id;
-			lconf_set_req(lconf);
+			struct lconf_msg msg = {
+				.type = LCONF_MSG_STOP,
+				.task_id = task_id,
+			};
+
+			if (wait_commands_pending(lconf, LCONF_MSG_RING_SIZE - 1) == -1)
+				return;
+			lconf_post_msg(lconf, &msg);
 			stopped_cores[n_stopped_cores++] = cores[i];
 		}
 	}
@@ -246,6 +288,182 @@ static struct size_unit to_size_unit(uint64_t bytes)
 	return ret;
 }
 
+/* Returns non-zero if no task preceding targ uses the same route table */
+static int route_table_first_ref(struct task_args *targ)
+{
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *t;
+
+	while (core_targ_next(&lconf, &t, 0) == 0 && t != targ) {
+		if (t->route_table_ref == targ->route_table_ref)
+			return 0;
+	}
+	return 1;
+}
+
+/* Wait until all cores running a task using rt have gone through
+   their main loop once, so that none of them still uses the table
+   that was current before the call. */
+static int route_table_wait_quiescent(struct route_table *rt)
+{
+	uint8_t posted[RTE_MAX_LCORE] = {0};
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *targ;
+	int ret = 0;
+
+	while (core_targ_next(&lconf, &targ, 0) == 0) {
+		if (targ->route_table_ref != rt || posted[lconf->id])
+			continue;
+		if (send_command(lconf, LCONF_MSG_QUIESCE, 0, 0))
+			return -1;
+		posted[lconf->id] = 1;
+	}
+
+	lconf = NULL;
+	while (core_targ_next(&lconf, &targ, 0) == 0) {
+		if (!posted[lconf->id])
+			continue;
+		posted[lconf->id] = 0;
+		if (wait_command_handled(lconf))
+			ret = -1;
+	}
+	return ret;
+}
+
+static int route_table_check_refs(struct route_table *rt, struct lpm4 *lpm)
+{
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *targ;
+
+	while (core_targ_next(&lconf, &targ, 0) == 0) {
+		if (targ->route_table_ref == rt && route_table_check_tx_ports(lpm, targ))
+			return -1;
+	}
+	return 0;
+}
+
+int cmd_route_reload(const char *name, const char *lua_file)
+{
+	struct lcore_cfg *lconf = NULL;
+	struct task_args *targ;
+	struct route_table *rt;
+	struct lpm4 *lpm, *old;
+	int n_tables = 0;
+	int ret = 0;
+
+	if (lua_file && lua_file_to_global(prox_lua(), lua_file, name)) {
+		plog_err("Failed to load route table from %s:\n%s\n", lua_file, get_lua_to_errors());
+		return -1;
+	}
+
+	while (core_targ_next(&lconf, &targ, 0) == 0) {
+		rt = targ->route_table_ref;
+		if (!rt || strcmp(targ->route_table, name) || !route_table_first_ref(targ))
+			continue;
+		n_tables++;
+
+		/* Built here, on the master core, while the tasks keep
+		   on using the current table. */
+		if (lua_to_lpm4(prox_lua(), GLOBAL, name, rt->socket_id, &lpm)) {
+			plog_err("Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
+			ret = -1;
+			continue;
+		}
+		if (route_table_check_refs(rt, lpm)) {
+			lpm4_free(lpm);
+			ret = -1;
+			continue;
+		}
+
+		old = route_table_publish(rt, lpm);
+		plog_info("Route table %s on socket %d: generation %u, %u routes\n",
+			  name, rt->socket_id, rt->generation, lpm->n_used_rules);
+
+		if (route_table_wait_quiescent(rt)) {
+			plog_warn("Not freeing previous route table %s: cores did not respond\n", name);
+			ret = -1;
+			continue;
+		}
+		lpm4_free(old);
+	}
+
+	if (!n_tables) {
+		plog_err("No task uses route table %s\n", name);
+		return -1;
+	}
+	return ret;
+}
+
+static const char *acl_action_str(uint8_t action)
+{
+	switch (action) {
+	case ACL_ALLOW:
+		return "allow";
+	case ACL_DROP:
+		return "drop";
+	case ACL_RATE_LIMIT:
+		return "rate limit";
+	default:
+		return "none";
+	}
+}
+
+void cmd_acl_stats(uint32_t *lcores, int n_cores, uint8_t task_id)
+{
+	const struct acl_rule_stats *rule_stats[RTE_MAX_LCORE];
+	const uint64_t *hist[RTE_MAX_LCORE];
+	struct task_base *first = NULL;
+	uint32_t n_rules = 0, n;
+	int n_tasks = 0;
+
+	for (int i = 0; i < n_cores; ++i) {
+		if (!prox_core_active(lcores[i], 0) || task_id >= lcore_cfg[lcores[i]].n_tasks_all ||
+		    strcmp(lcore_cfg[lcores[i]].targs[task_id].task_init->mode_str, "acl")) {
+			plog_warn("core %u task %u is not an ACL task\n", lcores[i], task_id);
+			continue;
+		}
+		struct task_base *tbase = lcore_cfg[lcores[i]].tasks_all[task_id];
+
+		rule_stats[n_tasks] = task_acl_get_rule_stats(tbase, &n);
+		if (!rule_stats[n_tasks]) {
+			plog_warn("acl stats not enabled on core %u task %u\n", lcores[i], task_id);
+			continue;
+		}
+		hist[n_tasks++] = task_acl_get_classify_hist(tbase);
+		if (n > n_rules)
+			n_rules = n;
+		if (!first)
+			first = tbase;
+	}
+	if (!n_tasks)
+		return;
+
+	/* Counters of all tasks are summed, rule numbers are expected
+	   to refer to the same rules on all of them. */
+	plog_info("%6s %16s %20s %s\n", "rule", "packets", "bytes", "action");
+	for (uint32_t rule = 0; rule <= n_rules; ++rule) {
+		uint64_t packets = 0, bytes = 0;
+
+		for (int i = 0; i < n_tasks; ++i) {
+			packets += rule_stats[i][rule].packets;
+			bytes += rule_stats[i][rule].bytes;
+		}
+		if (packets)
+			plog_info("%6u %16"PRIu64" %20"PRIu64" %s\n", rule, packets, bytes,
+				  rule? acl_action_str(task_acl_get_action(first, rule)) : "no match");
+	}
+
+	plog_info("rte_acl_classify cycles per burst:\n");
+	for (int b = 0; b < ACL_CLASSIFY_HIST_SIZE; ++b) {
+		uint64_t count = 0;
+
+		for (int i = 0; i < n_tasks; ++i)
+			count += hist[i][b];
+		if (count)
+			plog_info("\t[%"PRIu64", %"PRIu64"): %"PRIu64"\n", b? 1ULL << b : 0, b < 63? 2ULL << b : UINT64_MAX, count);
+	}
+}
+
 void cmd_mem_stats(void)
 {
 	struct rte_malloc_socket_stats sock_stats;
@@ -314,23 +532,12 @@ void cmd_dump(uint8_t lcore_id, uint8_t task_id, uint32_t nb_packets, struct inp
 
 		lconf->tasks_all[task_id]->aux->task_rt_dump.input = input;
 
-		if (wait_command_handled(lconf) == -1) return;
 		if (rx && tx)
-			lconf->msg.type = LCONF_MSG_DUMP;
+			send_command(lconf, LCONF_MSG_DUMP, task_id, nb_packets);
 		else if (rx)
-			lconf->msg.type = LCONF_MSG_DUMP_RX;
+			send_command(lconf, LCONF_MSG_DUMP_RX, task_id, nb_packets);
 		else if (tx)
-			lconf->msg.type = LCONF_MSG_DUMP_TX;
-
-		if (rx || tx) {
-			lconf->msg.task_id = task_id;
-			lconf->msg.val  = nb_packets;
-			lconf_set_req(lconf);
-		}
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+			send_command(lconf, LCONF_MSG_DUMP_TX, task_id, nb_packets);
 	}
 }
 
@@ -346,16 +553,27 @@ void cmd_trace(uint8_t lcore_id, uint8_t task_id, uint32_t nb_packets)
 	else {
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
+		send_command(lconf, LCONF_MSG_TRACE, task_id, nb_packets);
+	}
+}
 
-		lconf->msg.type = LCONF_MSG_TRACE;
-		lconf->msg.task_id = task_id;
-		lconf->msg.val  = nb_packets;
-		lconf_set_req(lconf);
+void cmd_task_set(uint8_t lcore_id, uint8_t task_id, void (*task_set)(struct task_base *tbase, uint64_t val), uint64_t val)
+{
+	if (lcore_id > RTE_MAX_LCORE) {
+		plog_warn("core_id too high, maximum allowed is: %u\n", RTE_MAX_LCORE);
+	}
+	else if (task_id >= lcore_cfg[lcore_id].n_tasks_all) {
+		plog_warn("task_id too high, should be in [0, %u]\n", lcore_cfg[lcore_id].n_tasks_all - 1);
+	}
+	else {
+		struct lconf_msg msg = {
+			.type = LCONF_MSG_TASK_SET,
+			.task_id = task_id,
+			.val64 = val,
+			.task_set = task_set,
+		};
 
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_msg(&lcore_cfg[lcore_id], &msg);
 	}
 }
 
@@ -369,13 +587,7 @@ void cmd_rx_bw_start(uint32_t lcore_id)
 
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_RX_BW_START;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_RX_BW_START, 0, 0);
 	}
 }
 
@@ -389,13 +601,7 @@ void cmd_tx_bw_start(uint32_t lcore_id)
 
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_TX_BW_START;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_TX_BW_START, 0, 0);
 	}
 }
 
@@ -409,13 +615,7 @@ void cmd_rx_bw_stop(uint32_t lcore_id)
 
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_RX_BW_STOP;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_RX_BW_STOP, 0, 0);
 	}
 }
 
@@ -429,13 +629,7 @@ void cmd_tx_bw_stop(uint32_t lcore_id)
 
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_TX_BW_STOP;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_TX_BW_STOP, 0, 0);
 	}
 }
 void cmd_rx_distr_start(uint32_t lcore_id)
@@ -447,13 +641,7 @@ void cmd_rx_distr_start(uint32_t lcore_id)
 	} else {
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_RX_DISTR_START;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_RX_DISTR_START, 0, 0);
 	}
 }
 
@@ -466,13 +654,7 @@ void cmd_tx_distr_start(uint32_t lcore_id)
 	} else {
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_TX_DISTR_START;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_TX_DISTR_START, 0, 0);
 	}
 }
 
@@ -485,13 +667,7 @@ void cmd_rx_distr_stop(uint32_t lcore_id)
 	} else {
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_RX_DISTR_STOP;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_RX_DISTR_STOP, 0, 0);
 	}
 }
 
@@ -504,13 +680,7 @@ void cmd_tx_distr_stop(uint32_t lcore_id)
 	} else {
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_TX_DISTR_STOP;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_TX_DISTR_STOP, 0, 0);
 	}
 }
 
@@ -521,13 +691,7 @@ void cmd_rx_distr_rst(uint32_t lcore_id)
 	} else {
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_RX_DISTR_RESET;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_RX_DISTR_RESET, 0, 0);
 	}
 }
 
@@ -538,13 +702,7 @@ void cmd_tx_distr_rst(uint32_t lcore_id)
 	} else {
 		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
 
-		if (wait_command_handled(lconf) == -1) return;
-		lconf->msg.type = LCONF_MSG_TX_DISTR_RESET;
-		lconf_set_req(lconf);
-
-		if (lconf->n_tasks_run == 0) {
-			lconf_do_flags(lconf);
-		}
+		send_command(lconf, LCONF_MSG_TX_DISTR_RESET, 0, 0);
 	}
 }
 
@@ -587,6 +745,66 @@ void cmd_tx_distr_show(uint32_t lcore_id)
 	}
 }
 
+void cmd_cycles_distr_start(uint32_t lcore_id)
+{
+	if (lcore_id > RTE_MAX_LCORE) {
+		plog_warn("core_id too high, maximum allowed is: %u\n", RTE_MAX_LCORE);
+	} else if (lcore_cfg[lcore_id].flags & LCONF_FLAG_CYCLES_ACTIVE) {
+		plog_warn("cycles distribution already running on core %u\n", lcore_id);
+	} else {
+		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
+
+		/* The display only shows cycles per packet once the
+		   flag has been set by the core */
+		if (send_command(lconf, LCONF_MSG_CYCLES_START, 0, 0) == 0)
+			wait_command_handled(lconf);
+	}
+}
+
+void cmd_cycles_distr_stop(uint32_t lcore_id)
+{
+	if (lcore_id > RTE_MAX_LCORE) {
+		plog_warn("core_id too high, maximum allowed is: %u\n", RTE_MAX_LCORE);
+	} else if ((lcore_cfg[lcore_id].flags & LCONF_FLAG_CYCLES_ACTIVE) == 0) {
+		plog_warn("cycles distribution not running on core %u\n", lcore_id);
+	} else {
+		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
+
+		if (send_command(lconf, LCONF_MSG_CYCLES_STOP, 0, 0) == 0)
+			wait_command_handled(lconf);
+	}
+}
+
+void cmd_cycles_distr_rst(uint32_t lcore_id)
+{
+	if (lcore_id > RTE_MAX_LCORE) {
+		plog_warn("core_id too high, maximum allowed is: %u\n", RTE_MAX_LCORE);
+	} else {
+		struct lcore_cfg *lconf = &lcore_cfg[lcore_id];
+
+		send_command(lconf, LCONF_MSG_CYCLES_RESET, 0, 0);
+	}
+}
+
+void cmd_cycles_distr_show(uint32_t lcore_id)
+{
+	if (lcore_id > RTE_MAX_LCORE) {
+		plog_warn("core_id too high, maximum allowed is: %u\n", RTE_MAX_LCORE);
+	} else {
+		for (uint32_t i = 0; i < lcore_cfg[lcore_id].n_tasks_all; ++i) {
+			const struct task_rt_cycles *c = &lcore_cfg[lcore_id].tasks_all[i]->aux->rt_cycles;
+
+			plog_info("t[%u]: burst calls cycles/call cycles/pkt\n", i);
+			for (uint32_t j = 0; j < sizeof(c->calls)/sizeof(c->calls[0]); ++j) {
+				if (c->calls[j] == 0)
+					continue;
+				plog_info("\t%3u %12"PRIu64" %10"PRIu64" %10"PRIu64"\n", j, c->calls[j],
+					  c->cycles[j] / c->calls[j], j ? c->cycles[j] / (c->calls[j] * j) : 0);
+			}
+		}
+	}
+}
+
 void cmd_ringinfo_all(void)
 {
 	struct lcore_cfg *lconf;
@@ -869,6 +1087,17 @@ void cmd_thread_info(uint8_t lcore_id, uint8_t task_id)
 		plog_info("core %d, task %d: %d mbufs stored in QoS\n", lcore_id, task_id,
 			  task_qos_n_pkts_buffered(task));
 
+		const struct qos_tc_stats *tc_stats = task_qos_get_tc_stats(task);
+		if (tc_stats) {
+			for (uint32_t tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; ++tc) {
+				uint64_t out = tc_stats[tc].dequeued + tc_stats[tc].dropped;
+				uint64_t in = tc_stats[tc].enqueued;
+
+				plog_info("\ttc %u: %"PRIu64" enqueued, %"PRIu64" dequeued, %"PRIu64" dropped, %"PRIu64" queued\n",
+					  tc, in, tc_stats[tc].dequeued, tc_stats[tc].dropped, in > out? in - out : 0);
+			}
+		}
+
 #ifdef ENABLE_EXTRA_USER_STATISTICS
 	}
 	else if (lcore_cfg[lcore_id].targs[task_id].mode == QINQ_ENCAP4) {
@@ -36,6 +36,7 @@
 #include <inttypes.h>
 
 struct input;
+struct task_base;
 
 /* command functions */
 void start_core_all(int task_id);
@@ -45,6 +46,16 @@ void stop_cores(uint32_t *cores, int count, int task_id);
 
 void cmd_trace(uint8_t lcore_id, uint8_t task_id, uint32_t nb_packets);
 void cmd_dump(uint8_t lcore_id, uint8_t task_id, uint32_t nb_packets, struct input *input, int rx, int tx);
+/* Call task_set(task, val) from the core running the task, without
+   waiting for it to be called. */
+void cmd_task_set(uint8_t lcore_id, uint8_t task_id, void (*task_set)(struct task_base *tbase, uint64_t val), uint64_t val);
+/* Replace the route table name used by routing, qinq_decap4 and cgnat
+   tasks without stopping them. If lua_file is not NULL, the table is
+   first read from the file, which has to return it. */
+int cmd_route_reload(const char *name, const char *lua_file);
+/* Sum the per rule counters and classify timings of the ACL task on
+   each of the cores */
+void cmd_acl_stats(uint32_t *lcores, int n_cores, uint8_t task_id);
 void cmd_mem_stats(void);
 void cmd_mem_layout(void);
 void cmd_hashdump(uint8_t lcore_id, uint8_t task_id, uint32_t table_id);
@@ -52,6 +63,10 @@ void cmd_rx_distr_start(uint32_t lcore_id);
 void cmd_rx_distr_stop(uint32_t lcore_id);
 void cmd_rx_distr_rst(uint32_t lcore_id);
 void cmd_rx_distr_show(uint32_t lcore_id);
+void cmd_cycles_distr_start(uint32_t lcore_id);
+void cmd_cycles_distr_stop(uint32_t lcore_id);
+void cmd_cycles_distr_rst(uint32_t lcore_id);
+void cmd_cycles_distr_show(uint32_t lcore_id);
 void cmd_tx_distr_start(uint32_t lcore_id);
 void cmd_tx_distr_stop(uint32_t lcore_id);
 void cmd_tx_distr_rst(uint32_t lcore_id);
@@ -52,6 +52,13 @@
 #define NB_RX_RING_DESC 256
 #define NB_TX_RING_DESC 256
 
+/* Maximum number of main loop iterations an idle task is skipped
+   when adaptive polling is enabled */
+#define DEFAULT_MAX_POLL_SKIP     64
+
+/* Maximum time an idle core waits before polling again */
+#define DEFAULT_MAX_IDLE_US       10
+
 /* 1500000 milliseconds */
 #define DEFAULT_CPE_TIMEOUT_MS    1500000
 
@@ -142,6 +149,8 @@ void set_task_defaults(struct prox_cfg* prox_cfg, struct lcore_cfg* lcore_cfg_in
 	for (uint8_t lcore_id = 0; lcore_id < RTE_MAX_LCORE; ++lcore_id) {
 		struct lcore_cfg *cur_lcore_cfg_init = &lcore_cfg_init[lcore_id];
 		cur_lcore_cfg_init->id = lcore_id;
+		cur_lcore_cfg_init->max_poll_skip = DEFAULT_MAX_POLL_SKIP;
+		cur_lcore_cfg_init->max_idle_us = DEFAULT_MAX_IDLE_US;
 		for (uint8_t task_id = 0; task_id < MAX_TASKS_PER_CORE; ++task_id) {
 			struct task_args *targ = &cur_lcore_cfg_init->targs[task_id];
 			for (uint8_t port_id = 0; port_id < PROX_MAX_PORTS; ++port_id) {
@@ -42,6 +42,7 @@ static struct display_column *stddev_col;
 static struct display_column *accuracy_limit_col;
 static struct display_column *used_col;
 static struct display_column *lost_col;
+static struct display_column *percentile_col[LAT_N_PERCENTILES];
 static struct display_page display_page_latency;
 
 static void display_latency_draw_frame(struct screen_state *screen_state)
@@ -55,6 +56,7 @@ static void display_latency_draw_frame(struct screen_state *screen_state)
 	struct display_table *core = display_page_add_table(&display_page_latency);
 	struct display_table *port = display_page_add_table(&display_page_latency);
 	struct display_table *lat = display_page_add_table(&display_page_latency);
+	struct display_table *pct = display_page_add_table(&display_page_latency);
 	struct display_table *acc = display_page_add_table(&display_page_latency);
 	struct display_table *other = display_page_add_table(&display_page_latency);
 
@@ -80,6 +82,12 @@ static void display_latency_draw_frame(struct screen_state *screen_state)
 	stddev_col = display_table_add_col(lat);
 	display_column_init(stddev_col, "Stddev (us)", 20);
 
+	display_table_init(pct, "Percentiles (us)");
+	for (int i = 0; i < LAT_N_PERCENTILES; ++i) {
+		percentile_col[i] = display_table_add_col(pct);
+		display_column_init(percentile_col[i], stats_latency_percentile_name(i), 9);
+	}
+
 	display_table_init(acc, "Accuracy ");
 	used_col = display_table_add_col(acc);
 	display_column_init(used_col, "Used Packets (%)", 16);
@@ -125,11 +133,15 @@ static void display_stats_latency_entry(int row, struct stats_latency *stats_lat
 		display_column_print(max_col, row, "%s", print_time_unit_err_usec(dst, &max));
 		display_column_print(avg_col, row, "%s", print_time_unit_err_usec(dst, &avg));
 		display_column_print(stddev_col, row, "%s", print_time_unit_err_usec(dst, &stddev));
+		for (int i = 0; i < LAT_N_PERCENTILES; ++i)
+			display_column_print(percentile_col[i], row, "%s", print_time_unit_usec(dst, &stats_latency->percentile[i]));
 	} else {
 		display_column_print(min_col, row, "%s", "N/A");
 		display_column_print(max_col, row, "%s", "N/A");
 		display_column_print(avg_col, row, "%s", "N/A");
 		display_column_print(stddev_col, row, "%s", "N/A");
+		for (int i = 0; i < LAT_N_PERCENTILES; ++i)
+			display_column_print(percentile_col[i], row, "%s", "N/A");
 	}
 
 	display_column_print(accuracy_limit_col, row, "%s", print_time_unit_usec(dst, &accuracy_limit));
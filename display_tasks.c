@@ -36,6 +36,7 @@
 #include "stats_task.h"
 #include "stats_core.h"
 #include "lconf.h"
+#include "prox_cfg.h"
 
 struct task_stats_disp {
 	uint32_t lcore_id;
@@ -60,6 +61,7 @@ static struct display_column *tx_fail_col;
 static struct display_column *discard_col;
 static struct display_column *handled_col;
 static struct display_column *cpp_col;
+static struct display_column *handle_cpp_col;
 static struct display_column *ghz_col;
 static struct display_column *rx_col;
 static struct display_column *tx_col;
@@ -72,6 +74,21 @@ static struct display_column *class_col;
 static struct display_column *mbm_tot_col;
 static struct display_column *mbm_loc_col;
 static struct display_column *frac_col;
+static struct display_column *core_idle_col;
+static struct display_column *core_sleep_col;
+/* Cyc/Pkt is only shown while "cycles distr" runs on some core */
+static int handle_cpp_shown;
+
+static int cycles_distr_active(void)
+{
+	uint32_t lcore_id = -1;
+
+	while (prox_core_next(&lcore_id, 0) == 0) {
+		if (lcore_cfg[lcore_id].flags & LCONF_FLAG_CYCLES_ACTIVE)
+			return 1;
+	}
+	return 0;
+}
 
 static void stats_display_core_task_entry(struct lcore_cfg *lconf, struct task_args *targ, unsigned row)
 {
@@ -131,6 +148,12 @@ static void display_tasks_draw_frame(struct screen_state *state)
 		handled_col = display_table_add_col(stats);
 		display_column_init(handled_col, "Handled (K)", 9);
 
+		handle_cpp_shown = cycles_distr_active();
+		if (handle_cpp_shown) {
+			handle_cpp_col = display_table_add_col(stats);
+			display_column_init(handle_cpp_col, "Cyc/Pkt", 7);
+		}
+
 		if (stats_cpu_freq_enabled()) {
 			struct display_table *other = display_page_add_table(&display_page_tasks);
 
@@ -142,6 +165,17 @@ static void display_tasks_draw_frame(struct screen_state *state)
 			ghz_col = display_table_add_col(other);
 			display_column_init(ghz_col, "Clk (GHz)", 9);
 		}
+		if (stats_idle_enabled()) {
+			struct display_table *other = display_page_add_table(&display_page_tasks);
+
+			display_table_init(other, "Core");
+
+			core_idle_col = display_table_add_col(other);
+			display_column_init(core_idle_col, "Idle (%)", 6);
+
+			core_sleep_col = display_table_add_col(other);
+			display_column_init(core_sleep_col, "Sleep (%)", 6);
+		}
 		if (stats_mbm_enabled()) {
 			struct display_table *other = display_page_add_table(&display_page_tasks);
 			mbm_tot_col = display_table_add_col(other);
@@ -248,6 +282,18 @@ static void display_core_task_stats_per_sec(const struct task_stats_disp *t, str
 	print_kpps(discard_col, row, last->drop_discard - prev->drop_discard, delta_t);
 	print_kpps(handled_col, row, last->drop_handled - prev->drop_handled, delta_t);
 
+	/* Only non-zero while "cycles distr" is running on the core. The
+	   totals are reset when it is started again, so the interval in
+	   which that happened is not shown. */
+	if (handle_cpp_shown) {
+		uint64_t handle_pkts = last->handle_pkts - prev->handle_pkts;
+
+		if (last->handle_pkts > prev->handle_pkts && last->handle_cycles >= prev->handle_cycles)
+			display_column_print(handle_cpp_col, row, "%lu", (last->handle_cycles - prev->handle_cycles) / handle_pkts);
+		else
+			display_column_print(handle_cpp_col, row, "%s", "");
+	}
+
 	if (stats_cpu_freq_enabled()) {
 		uint8_t lcore_stat_id = t->lcore_stat_id;
 		struct lcore_stats_sample *clast = stats_get_lcore_stats_sample(lcore_stat_id, 1);
@@ -276,6 +322,19 @@ static void display_core_task_stats_per_sec(const struct task_stats_disp *t, str
 		display_column_print(cpp_col, row, "%lu", cpp);
 		display_column_print(ghz_col, row, "%lu.%03lu", mhz/1000, mhz%1000);
 	}
+	if (stats_idle_enabled()) {
+		struct lcore_stats_sample *clast = stats_get_lcore_stats_sample(t->lcore_stat_id, 1);
+		struct lcore_stats_sample *cprev = stats_get_lcore_stats_sample(t->lcore_stat_id, 0);
+		uint64_t core_delta_t = clast->tsc - cprev->tsc;
+		uint64_t idle = clast->idle_cycles - cprev->idle_cycles;
+		uint64_t sleep = clast->sleep_cycles - cprev->sleep_cycles;
+
+		idle = core_delta_t && idle < core_delta_t ? idle * 10000 / core_delta_t : 10000;
+		sleep = core_delta_t && sleep < core_delta_t ? sleep * 10000 / core_delta_t : 10000;
+
+		display_column_print(core_idle_col, row, "%3lu.%02lu", idle / 100, idle % 100);
+		display_column_print(core_sleep_col, row, "%3lu.%02lu", sleep / 100, sleep % 100);
+	}
 	if (stats_mbm_enabled()) {
 		struct lcore_stats *c = stats_get_lcore_stats(t->lcore_stat_id);
 		uint8_t lcore_stat_id = t->lcore_stat_id;
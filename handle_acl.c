@@ -30,14 +30,20 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <time.h>
+
 #include <rte_mbuf.h>
 #include <rte_acl.h>
 #include <rte_ip.h>
 #include <rte_cycles.h>
 #include <rte_version.h>
+#include <rte_malloc.h>
+#include <rte_udp.h>
+#include <rte_cpuflags.h>
 
 #include "prox_lua.h"
 #include "prox_lua_types.h"
+#include "prox_malloc.h"
 
 #include "log.h"
 #include "quit.h"
@@ -50,6 +56,8 @@
 #include "lconf.h"
 #include "prefetch.h"
 #include "etypes.h"
+#include "clock.h"
+#include "defines.h"
 
 struct task_acl {
 	struct task_base base;
@@ -58,12 +66,86 @@ struct task_acl {
 
 	uint32_t       n_rules;
 	uint32_t       n_max_rules;
+	/* Action of each rule, indexed by the rule number that
+	   rte_acl_classify() returns */
+	uint8_t        *actions;
+	/* Only allocated if "acl stats" is set */
+	struct acl_rule_stats *rule_stats;
+	uint64_t       *classify_hist;
 
 	void           *field_defs;
 	size_t         field_defs_size;
 	uint32_t       n_field_defs;
+
+	/* Shadow mode: rules are added to the shadow context, which is
+	   built on the master core and then swapped with context. The
+	   rules added to context since the last swap are kept in
+	   pending until they have been added to the shadow as well. */
+	struct lcore_cfg   *lconf;
+	struct rte_acl_ctx *shadow;
+	struct acl4_rule   *pending;
+	uint32_t           n_pending;
+	/* The previous context is no longer used once the command
+	   posted after the swap has been handled */
+	uint32_t           shadow_seq;
+	uint32_t           generation;
+	int                socket_id;
+#if RTE_VERSION >= RTE_VERSION_NUM(2,0,0,0)
+	/* Installed by task_acl_set_alg(), 0 is RTE_ACL_CLASSIFY_DEFAULT */
+	enum rte_acl_classify_alg alg;
+#endif
+
+	/* Kept to build private contexts for task_acl_benchmark() */
+	const char         *rules;
+	uint16_t           qinq_tag;
+};
+
+#if RTE_VERSION >= RTE_VERSION_NUM(2,0,0,0)
+static const struct {
+	const char *name;
+	enum rte_acl_classify_alg alg;
+} acl_algs[] = {
+	{"default", RTE_ACL_CLASSIFY_DEFAULT},
+	{"scalar", RTE_ACL_CLASSIFY_SCALAR},
+#ifdef RTE_ARCH_X86
+	{"sse", RTE_ACL_CLASSIFY_SSE},
+	{"avx2", RTE_ACL_CLASSIFY_AVX2},
+#if RTE_VERSION >= RTE_VERSION_NUM(20,11,0,0)
+	{"avx512x16", RTE_ACL_CLASSIFY_AVX512X16},
+	{"avx512x32", RTE_ACL_CLASSIFY_AVX512X32},
+#endif
+#endif
 };
 
+/* Number of lookups done for each algorithm by task_acl_benchmark() */
+#define ACL_BENCH_LOOKUPS 10000000
+
+/* Older DPDK versions accept any compiled-in algorithm in
+   rte_acl_set_ctx_classify() without checking the CPU, so the flags
+   must be checked before installing it to avoid SIGILL in the
+   classify functions. */
+static int acl_alg_cpu_supported(enum rte_acl_classify_alg alg)
+{
+#ifdef RTE_ARCH_X86
+	switch (alg) {
+	case RTE_ACL_CLASSIFY_SSE:
+		return rte_cpu_get_flag_enabled(RTE_CPUFLAG_SSE4_1) > 0;
+	case RTE_ACL_CLASSIFY_AVX2:
+		return rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) > 0;
+#if RTE_VERSION >= RTE_VERSION_NUM(20,11,0,0)
+	case RTE_ACL_CLASSIFY_AVX512X16:
+	case RTE_ACL_CLASSIFY_AVX512X32:
+		return rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F) > 0 &&
+			rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512BW) > 0;
+#endif
+	default:
+		break;
+	}
+#endif
+	return 1;
+}
+#endif
+
 static void set_tc(struct rte_mbuf *mbuf, uint32_t tc)
 {
 #if RTE_VERSION >= RTE_VERSION_NUM(1,8,0,0)
@@ -113,10 +195,26 @@ static int handle_acl_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 	}
 #endif
 
-	rte_acl_classify(task->context, (const uint8_t **)task->ptuples, results, n_pkts, 1);
+	/* Loaded once, the context can be swapped by the master core */
+	struct rte_acl_ctx *ctx = *(struct rte_acl_ctx * volatile *)&task->context;
+
+	if (unlikely(task->rule_stats != NULL)) {
+		uint64_t tsc = rte_rdtsc();
+
+		rte_acl_classify(ctx, (const uint8_t **)task->ptuples, results, n_pkts, 1);
+		tsc = rte_rdtsc() - tsc;
+		task->classify_hist[tsc? 63 - __builtin_clzll(tsc) : 0]++;
+
+		for (uint8_t i = 0; i < n_pkts; ++i) {
+			task->rule_stats[results[i]].packets++;
+			task->rule_stats[results[i]].bytes += rte_pktmbuf_pkt_len(mbufs[i]);
+		}
+	} else {
+		rte_acl_classify(ctx, (const uint8_t **)task->ptuples, results, n_pkts, 1);
+	}
 
 	for (uint8_t i = 0; i < n_pkts; ++i) {
-		switch (results[i]) {
+		switch (task->actions[results[i]]) {
 		default:
 		case ACL_NOT_SET:
 		case ACL_DROP:
@@ -133,6 +231,20 @@ static int handle_acl_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 }
 
+static int acl_build(struct task_acl *task, struct rte_acl_ctx *ctx)
+{
+	struct rte_acl_config acl_build_param;
+
+	acl_build_param.num_categories = 1;
+#if RTE_VERSION >= RTE_VERSION_NUM(2,1,0,0)
+	acl_build_param.max_size = 0;
+#endif
+	acl_build_param.num_fields = task->n_field_defs;
+	rte_memcpy(&acl_build_param.defs, task->field_defs, task->field_defs_size);
+
+	return rte_acl_build(ctx, &acl_build_param);
+}
+
 static void acl_msg(struct task_base *tbase, void **data, uint16_t n_msgs)
 {
 	struct task_acl *task = (struct task_acl *)tbase;
@@ -147,6 +259,8 @@ static void acl_msg(struct task_base *tbase, void **data, uint16_t n_msgs)
 		}
 
 		new_rules[i]->data.priority = ++task->n_rules;
+		task->actions[task->n_rules] = new_rules[i]->data.userdata;
+		new_rules[i]->data.userdata = task->n_rules;
 		rte_acl_add_rules(task->context, (struct rte_acl_rule*) new_rules[i], 1);
 	}
 
@@ -155,28 +269,322 @@ static void acl_msg(struct task_base *tbase, void **data, uint16_t n_msgs)
 		return ;
 	}
 
-	struct rte_acl_config acl_build_param;
-	/* Perform builds */
-	acl_build_param.num_categories = 1;
+	int ret;
+	PROX_PANIC((ret = acl_build(task, task->context)),
+		   "Failed to build ACL trie (%d)\n", ret);
+}
 
-	acl_build_param.num_fields = task->n_field_defs;
-	rte_memcpy(&acl_build_param.defs, task->field_defs, task->field_defs_size);
+static int acl_shadow_is_free(struct task_acl *task)
+{
+	/* A core without thread does not classify packets */
+	return !lconf_is_launched(task->lconf) || lconf_msg_seq_done(task->lconf, task->shadow_seq);
+}
 
+int task_acl_add_rules(struct task_base *tbase, struct acl4_rule *rules, uint32_t n_rules)
+{
+	struct task_acl *task = (struct task_acl *)tbase;
+	struct rte_malloc_socket_stats before, after;
+	struct lconf_msg msg = {.type = LCONF_MSG_QUIESCE};
+	struct rte_acl_ctx *old;
+	uint64_t t1, t2;
+	uint32_t i;
 	int ret;
-	PROX_PANIC((ret = rte_acl_build(task->context, &acl_build_param)),
-		   "Failed to build ACL trie (%d)\n", ret);
+
+	if (task->n_rules + n_rules > task->n_max_rules) {
+		plog_err("Failed to add %u rule%s (already at %u rules, maximum is %u)\n",
+			 n_rules, n_rules > 1? "s" : "", task->n_rules, task->n_max_rules);
+		return -1;
+	}
+
+	/* The shadow is rebuilt below, which frees the trie the core
+	   was using before the previous swap. The core handles
+	   commands every TERM_TIMEOUT: sleep instead of spinning while
+	   waiting for it. */
+	for (i = 0; !acl_shadow_is_free(task); ++i) {
+		const struct timespec wait = {.tv_sec = 0, .tv_nsec = 1000000};
+
+		if (i == 2 * tsc_to_usec(TERM_TIMEOUT) / 1000) {
+			plog_err("Failed to add rules: core %u did not release the previous ACL context\n", task->lconf->id);
+			return -1;
+		}
+		nanosleep(&wait, NULL);
+	}
+
+	for (i = 0; i < task->n_pending; ++i)
+		rte_acl_add_rules(task->shadow, (struct rte_acl_rule *)&task->pending[i], 1);
+	task->n_pending = 0;
+
+	for (i = 0; i < n_rules; ++i) {
+		rules[i].data.priority = ++task->n_rules;
+		task->actions[task->n_rules] = rules[i].data.userdata;
+		rules[i].data.userdata = task->n_rules;
+		rte_acl_add_rules(task->shadow, (struct rte_acl_rule *)&rules[i], 1);
+		task->pending[task->n_pending++] = rules[i];
+	}
+
+	rte_malloc_get_socket_stats(task->socket_id, &before);
+	t1 = rte_rdtsc();
+	ret = acl_build(task, task->shadow);
+	t2 = rte_rdtsc();
+	rte_malloc_get_socket_stats(task->socket_id, &after);
+	PROX_PANIC(ret, "Failed to build ACL trie (%d)\n", ret);
+
+	old = task->context;
+	rte_wmb();
+	*(struct rte_acl_ctx * volatile *)&task->context = task->shadow;
+	task->shadow = old;
+	task->generation++;
+
+	/* If the mailbox is full, the commands it holds are only handled
+	   after the swap, which is just as good as a new one. */
+	lconf_send_msg(task->lconf, &msg);
+	task->shadow_seq = lconf_msg_seq(task->lconf);
+
+	plog_info("ACL core %u generation %u: %u rules, built in %"PRIu64" us, heap usage %+"PRId64" bytes\n",
+		  task->lconf->id, task->generation, task->n_rules, tsc_to_usec(t2 - t1),
+		  (int64_t)after.heap_allocsz_bytes - (int64_t)before.heap_allocsz_bytes);
+	return 0;
 }
 
-static void init_task_acl(struct task_base *tbase, struct task_args *targ)
+const struct acl_rule_stats *task_acl_get_rule_stats(struct task_base *tbase, uint32_t *n_rules)
 {
 	struct task_acl *task = (struct task_acl *)tbase;
-	int use_qinq = targ->flags & TASK_ARG_QINQ_ACL;
 
+	*n_rules = task->n_rules;
+	return task->rule_stats;
+}
+
+const uint64_t *task_acl_get_classify_hist(struct task_base *tbase)
+{
+	struct task_acl *task = (struct task_acl *)tbase;
+
+	return task->classify_hist;
+}
+
+uint8_t task_acl_get_action(struct task_base *tbase, uint32_t rule)
+{
+	struct task_acl *task = (struct task_acl *)tbase;
+
+	return rule <= task->n_rules? task->actions[rule] : ACL_NOT_SET;
+}
+
+int task_acl_set_alg(struct task_base *tbase, const char *alg_str)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(2,0,0,0)
+	struct task_acl *task = (struct task_acl *)tbase;
+
+	for (size_t i = 0; i < RTE_DIM(acl_algs); ++i) {
+		if (strcmp(acl_algs[i].name, alg_str))
+			continue;
+		if (!acl_alg_cpu_supported(acl_algs[i].alg)) {
+			plog_err("ACL classify algorithm %s is not supported by the CPU\n", alg_str);
+			return -1;
+		}
+		/* Only changes the function called by rte_acl_classify(),
+		   this is safe while the core is classifying. The shadow,
+		   not used by the core, is set first so that a refusal
+		   leaves the live context untouched. */
+		if (task->shadow && rte_acl_set_ctx_classify(task->shadow, acl_algs[i].alg)) {
+			plog_err("ACL classify algorithm %s is not supported\n", alg_str);
+			return -1;
+		}
+		if (rte_acl_set_ctx_classify(task->context, acl_algs[i].alg)) {
+			if (task->shadow)
+				rte_acl_set_ctx_classify(task->shadow, task->alg);
+			plog_err("ACL classify algorithm %s is not supported\n", alg_str);
+			return -1;
+		}
+		task->alg = acl_algs[i].alg;
+		return 0;
+	}
+#endif
+	plog_err("Unknown ACL classify algorithm %s\n", alg_str);
+	return -1;
+}
+
+#if RTE_VERSION >= RTE_VERSION_NUM(2,0,0,0)
+/* The context of the task can be rebuilt by the worker core at any
+   time (see acl_msg()), so the benchmark runs on a private context
+   holding the rules from the config. */
+static struct rte_acl_ctx *acl_bench_ctx(struct task_acl *task, uint32_t *n_rules)
+{
+	const int use_qinq = task->field_defs == pkt_qinq_ipv4_udp_defs;
+	struct rte_acl_param acl_param;
+	struct rte_acl_ctx *ctx;
+	uint8_t *actions;
+	uint32_t free_rules = task->n_max_rules;
 	char name[PATH_MAX];
+
+	snprintf(name, sizeof(name), "acl-%d-%p-bench", task->lconf->id, task);
+
+	acl_param.name = name;
+	acl_param.socket_id = task->socket_id;
+	acl_param.rule_size = RTE_ACL_RULE_SZ(task->n_field_defs);
+	acl_param.max_rule_num = task->n_max_rules;
+
+	/* Actions are filled in by lua_to_rules() but not needed here */
+	actions = prox_zmalloc(task->n_max_rules + 1, task->socket_id);
+	if (actions == NULL) {
+		plog_err("Failed to allocate ACL benchmark actions\n");
+		return NULL;
+	}
+
+	ctx = rte_acl_create(&acl_param);
+	if (ctx == NULL) {
+		plog_err("Failed to create ACL benchmark context\n");
+		prox_free(actions);
+		return NULL;
+	}
+
+	if (lua_to_rules(prox_lua(), GLOBAL, task->rules, ctx, &free_rules, use_qinq, task->qinq_tag, actions)) {
+		plog_err("Failed to read rules from config:\n%s\n", get_lua_to_errors());
+		goto err;
+	}
+	*n_rules = task->n_max_rules - free_rules;
+
+	if (*n_rules && acl_build(task, ctx)) {
+		plog_err("Failed to build ACL benchmark trie\n");
+		goto err;
+	}
+	prox_free(actions);
+	return ctx;
+err:
+	rte_acl_free(ctx);
+	prox_free(actions);
+	return NULL;
+}
+#endif
+
+void task_acl_benchmark(struct task_base *tbase, uint32_t n_tuples, uint32_t seed)
+{
+#if RTE_VERSION >= RTE_VERSION_NUM(2,0,0,0)
+	struct task_acl *task = (struct task_acl *)tbase;
+	const int use_qinq = task->field_defs == pkt_qinq_ipv4_udp_defs;
+	struct pkt_qinq_ipv4_udp *tuples;
+	struct rte_acl_ctx *ctx;
+	const uint8_t **data;
+	uint32_t results[64];
+	uint32_t n_rules = 0;
+	uint32_t n_loops = ACL_BENCH_LOOKUPS / n_tuples + 1;
+
+	ctx = acl_bench_ctx(task, &n_rules);
+	if (ctx == NULL)
+		return;
+
+	tuples = prox_zmalloc(n_tuples * sizeof(*tuples), task->socket_id);
+	data = prox_zmalloc(n_tuples * sizeof(*data), task->socket_id);
+	if (tuples == NULL || data == NULL) {
+		plog_err("Failed to allocate %u ACL benchmark tuples\n", n_tuples);
+		prox_free(tuples);
+		prox_free(data);
+		rte_acl_free(ctx);
+		return;
+	}
+
+	/* Random 5-tuples in the layout expected by the field
+	   definitions of the task */
+	for (uint32_t i = 0; i < n_tuples; ++i) {
+		struct ipv4_hdr *ip;
+		struct udp_hdr *udp;
+
+		if (use_qinq) {
+			struct pkt_qinq_ipv4_udp *pkt = &tuples[i];
+
+			pkt->qinq_hdr.svlan.eth_proto = ETYPE_8021ad;
+			pkt->qinq_hdr.svlan.vlan_tci = rand_r(&seed) & 0x0fff;
+			pkt->qinq_hdr.cvlan.eth_proto = ETYPE_VLAN;
+			pkt->qinq_hdr.cvlan.vlan_tci = rand_r(&seed) & 0x0fff;
+			pkt->qinq_hdr.ether_type = ETYPE_IPv4;
+			ip = &pkt->ipv4_hdr;
+			udp = &pkt->udp_hdr;
+		} else {
+			struct pkt_eth_ipv4_udp *pkt = (struct pkt_eth_ipv4_udp *)&tuples[i];
+
+			pkt->ether_hdr.ether_type = ETYPE_IPv4;
+			ip = &pkt->ipv4_hdr;
+			udp = &pkt->udp_hdr;
+		}
+		ip->version_ihl = 0x45;
+		ip->next_proto_id = (rand_r(&seed) & 1)? IPPROTO_UDP : IPPROTO_TCP;
+		ip->src_addr = rand_r(&seed) ^ ((uint32_t)rand_r(&seed) << 16);
+		ip->dst_addr = rand_r(&seed) ^ ((uint32_t)rand_r(&seed) << 16);
+		udp->src_port = rand_r(&seed);
+		udp->dst_port = rand_r(&seed);
+		data[i] = (const uint8_t *)&tuples[i];
+	}
+
+	plog_info("ACL benchmark: %u rules from config, %u tuples, %u lookups per algorithm\n",
+		  n_rules, n_tuples, n_tuples * n_loops);
+	for (size_t a = 0; a < RTE_DIM(acl_algs); ++a) {
+		uint64_t tsc;
+		int ret = 0;
+
+		if (!acl_alg_cpu_supported(acl_algs[a].alg) ||
+		    rte_acl_set_ctx_classify(ctx, acl_algs[a].alg)) {
+			plog_info("\t%-10s unsupported\n", acl_algs[a].name);
+			continue;
+		}
+
+		tsc = rte_rdtsc();
+
+		for (uint32_t loop = 0; loop < n_loops && !ret; ++loop) {
+			for (uint32_t i = 0; i < n_tuples && !ret; i += 64) {
+				uint32_t n = n_tuples - i < 64? n_tuples - i : 64;
+
+				ret = rte_acl_classify_alg(ctx, data + i, results, n, 1, acl_algs[a].alg);
+			}
+		}
+		tsc = rte_rdtsc() - tsc;
+
+		if (ret)
+			plog_info("\t%-10s failed (%d)\n", acl_algs[a].name, ret);
+		else
+			plog_info("\t%-10s %8.2f Mpps\n", acl_algs[a].name,
+				  (double)n_tuples * n_loops * rte_get_tsc_hz() / tsc / 1000000);
+	}
+
+	prox_free(tuples);
+	prox_free(data);
+	rte_acl_free(ctx);
+#else
+	plog_err("ACL benchmark requires DPDK 2.0 or later\n");
+#endif
+}
+
+static struct rte_acl_ctx *init_acl_ctx(struct task_acl *task, struct task_args *targ, const char *suffix)
+{
+	int use_qinq = targ->flags & TASK_ARG_QINQ_ACL;
 	struct rte_acl_param acl_param;
+	struct rte_acl_ctx *ctx;
+	char name[PATH_MAX];
 
-	/* Create ACL contexts */
-	snprintf(name, sizeof(name), "acl-%d-%d", targ->lconf->id, targ->task);
+	snprintf(name, sizeof(name), "acl-%d-%d%s", targ->lconf->id, targ->task, suffix);
+
+	acl_param.name = name;
+	acl_param.socket_id = task->socket_id;
+	acl_param.rule_size = RTE_ACL_RULE_SZ(task->n_field_defs);
+	acl_param.max_rule_num = targ->n_max_rules;
+
+	ctx = rte_acl_create(&acl_param);
+	PROX_PANIC(ctx == NULL, "Failed to create ACL context\n");
+
+	uint32_t free_rules = targ->n_max_rules;
+
+	int ret = lua_to_rules(prox_lua(), GLOBAL, targ->rules, ctx, &free_rules, use_qinq, targ->qinq_tag, task->actions);
+	PROX_PANIC(ret, "Failed to read rules from config:\n%s\n", get_lua_to_errors());
+	task->n_rules = targ->n_max_rules - free_rules;
+
+	if (task->n_rules) {
+		plog_info("Building trie structure\n");
+		PROX_PANIC(acl_build(task, ctx), "Failed to build ACL trie\n");
+	}
+	return ctx;
+}
+
+static void init_task_acl(struct task_base *tbase, struct task_args *targ)
+{
+	struct task_acl *task = (struct task_acl *)tbase;
+	int use_qinq = targ->flags & TASK_ARG_QINQ_ACL;
 
 	if (use_qinq) {
 		task->n_field_defs    = RTE_DIM(pkt_qinq_ipv4_udp_defs);
@@ -188,40 +596,42 @@ static void init_task_acl(struct task_base *tbase, struct task_args *targ)
 		task->field_defs_size = sizeof(pkt_eth_ipv4_udp_defs);
 	}
 
-	acl_param.name = name;
-	acl_param.socket_id = rte_lcore_to_socket_id(targ->lconf->id);
-	acl_param.rule_size = RTE_ACL_RULE_SZ(task->n_field_defs);
-	acl_param.max_rule_num = targ->n_max_rules;
-
+	task->lconf = targ->lconf;
+	task->socket_id = rte_lcore_to_socket_id(targ->lconf->id);
 	task->n_max_rules = targ->n_max_rules;
-	task->context = rte_acl_create(&acl_param);
-
-	PROX_PANIC(task->context == NULL, "Failed to create ACL context\n");
-	uint32_t free_rules = targ->n_max_rules;
+	task->rules = targ->rules;
+	task->qinq_tag = targ->qinq_tag;
 
 	PROX_PANIC(!strcmp(targ->rules, ""), "No rule specified for ACL\n");
 
-	int ret = lua_to_rules(prox_lua(), GLOBAL, targ->rules, task->context, &free_rules, use_qinq, targ->qinq_tag);
-	PROX_PANIC(ret, "Failed to read rules from config:\n%s\n", get_lua_to_errors());
-	task->n_rules = targ->n_max_rules - free_rules;
+	/* Rule 0 means that no rule matched */
+	task->actions = prox_zmalloc(task->n_max_rules + 1, task->socket_id);
+	PROX_PANIC(task->actions == NULL, "Failed to allocate ACL actions\n");
+	task->actions[0] = ACL_NOT_SET;
 
+	if (targ->flags & TASK_ARG_ACL_STATS) {
+		task->rule_stats = prox_zmalloc((task->n_max_rules + 1) * sizeof(*task->rule_stats), task->socket_id);
+		task->classify_hist = prox_zmalloc(ACL_CLASSIFY_HIST_SIZE * sizeof(*task->classify_hist), task->socket_id);
+		PROX_PANIC(task->rule_stats == NULL || task->classify_hist == NULL, "Failed to allocate ACL statistics\n");
+	}
+
+	/* Create ACL contexts */
+	task->context = init_acl_ctx(task, targ, "");
 	plog_info("Configured %d rules\n", task->n_rules);
 
-	if (task->n_rules) {
-		struct rte_acl_config acl_build_param;
-		/* Perform builds */
-		acl_build_param.num_categories = 1;
-#if RTE_VERSION >= RTE_VERSION_NUM(2,1,0,0)
-		acl_build_param.max_size = 0;
-#endif
+	if (targ->flags & TASK_ARG_ACL_SHADOW) {
+		/* Both contexts start with the rules from the config */
+		task->shadow = init_acl_ctx(task, targ, "-shadow");
+		task->pending = prox_zmalloc(task->n_max_rules * sizeof(*task->pending), task->socket_id);
+		PROX_PANIC(task->pending == NULL, "Failed to allocate pending ACL rules\n");
+		task->shadow_seq = lconf_msg_seq(targ->lconf);
+	}
 
-		acl_build_param.num_fields = task->n_field_defs;
-		rte_memcpy(&acl_build_param.defs, task->field_defs, task->field_defs_size);
+	if (strcmp(targ->acl_alg, ""))
+		PROX_PANIC(task_acl_set_alg(tbase, targ->acl_alg), "Failed to set ACL classify algorithm\n");
 
-		plog_info("Building trie structure\n");
-		PROX_PANIC(rte_acl_build(task->context, &acl_build_param),
-			   "Failed to build ACL trie\n");
-	}
+	if (targ->flags & TASK_ARG_ACL_SHADOW)
+		return;
 
 	targ->lconf->ctrl_timeout = freq_to_tsc(targ->ctrl_freq);
 	targ->lconf->ctrl_func_m[targ->task] = acl_msg;
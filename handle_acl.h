@@ -40,6 +40,33 @@ struct acl4_rule {
 	struct rte_acl_field fields[9];
 };
 
+struct task_base;
+
+struct acl_rule_stats {
+	uint64_t packets;
+	uint64_t bytes;
+};
+
+/* Bucket i counts the bursts for which rte_acl_classify() took
+   between 2^i and 2^(i+1) - 1 cycles */
+#define ACL_CLASSIFY_HIST_SIZE 64
+
 int str_to_rule(struct acl4_rule *rule, char** fields, int n_rules, int use_qinq);
+/* Only for tasks with "shadow acl" set, to be called from the master
+   core: add the rules to the shadow context, build it and make it
+   the context used by the task. */
+int task_acl_add_rules(struct task_base *tbase, struct acl4_rule *rules, uint32_t n_rules);
+/* Statistics of rules 0 (no match) up to *n_rules, or NULL if "acl
+   stats" is not set for the task. */
+const struct acl_rule_stats *task_acl_get_rule_stats(struct task_base *tbase, uint32_t *n_rules);
+const uint64_t *task_acl_get_classify_hist(struct task_base *tbase);
+uint8_t task_acl_get_action(struct task_base *tbase, uint32_t rule);
+/* Select the rte_acl_classify() algorithm by name: default, scalar,
+   sse, avx2, avx512x16 or avx512x32 */
+int task_acl_set_alg(struct task_base *tbase, const char *alg_str);
+/* Classify n_tuples random tuples with each algorithm against the
+   rules of the task and report the lookup rate. Runs on the calling
+   core. */
+void task_acl_benchmark(struct task_base *tbase, uint32_t n_tuples, uint32_t seed);
 
 #endif /* _HANDLE_ACL_H_ */
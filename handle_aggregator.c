@@ -44,6 +44,7 @@
 #include "defines.h"
 #include "prefetch.h"
 #include "qinq.h"
+#include "qinq_classify.h"
 #include "prox_cfg.h"
 #include "log.h"
 #include "quit.h"
@@ -71,32 +72,32 @@ static inline uint8_t detect_l4_priority(uint8_t l3_priority, const struct ipv4_
 	return l3_priority;
 }
 
-static inline uint8_t detect_l3_priority(uint8_t l2_priority, const struct ipv4_hdr *ipv4_hdr)
+static inline uint8_t detect_l3_priority(uint8_t l2_priority, uint8_t version_ihl, uint8_t tos)
 {
 	uint8_t dscp;
-	if ((ipv4_hdr->version_ihl >> 4) == 4) {
-	} else if ((ipv4_hdr->version_ihl >> 4) == 6) {
+	if ((version_ihl >> 4) == 4) {
+	} else if ((version_ihl >> 4) == 6) {
 		plog_warn("IPv6 Not implemented\n");
 		return OUT_DISCARD;
 	} else {
 		plog_warn("Unexpected IP version\n");
 		return OUT_DISCARD;
 	}
-	dscp = ipv4_hdr->type_of_service >> 2;
+	dscp = tos >> 2;
 	if (dscp)
 		return MAX_PRIORITIES - dscp - 1;
 	else
 		return l2_priority;
 }
 
-static inline uint8_t detect_l2_priority(const struct qinq_hdr *pqinq)
+static inline uint8_t detect_l2_priority(const struct qinq_key *key)
 {
-	if (pqinq->cvlan.eth_proto != ETYPE_VLAN) {
-		plog_warn("Unexpected proto in QinQ = %#04x\n", pqinq->cvlan.eth_proto);
+	if (key->cvlan_eth_proto != ETYPE_VLAN) {
+		plog_warn("Unexpected proto in QinQ = %#04x\n", key->cvlan_eth_proto);
 		return OUT_DISCARD;
 	}
-	uint16_t svlan_priority = ntohs(pqinq->svlan.vlan_tci >> 13);
-	uint16_t cvlan_priority = ntohs(pqinq->cvlan.vlan_tci >> 13);
+	uint16_t svlan_priority = ntohs(key->svlan_tci >> 13);
+	uint16_t cvlan_priority = ntohs(key->cvlan_tci >> 13);
 	if (svlan_priority)
 		return svlan_priority;
 	else
@@ -121,7 +122,7 @@ static inline void buffer_packet(struct task_aggregator *task, struct rte_mbuf *
 	}
 }
 
-static inline void handle_aggregator(struct task_aggregator *task, struct rte_mbuf *mbuf)
+static inline void handle_aggregator(struct task_aggregator *task, struct rte_mbuf *mbuf, const struct qinq_key *key)
 {
 	struct ether_hdr *peth = rte_pktmbuf_mtod(mbuf, struct ether_hdr *);
 	uint8_t priority = 0;
@@ -134,12 +135,12 @@ static inline void handle_aggregator(struct task_aggregator *task, struct rte_mb
 	case ETYPE_MPLSM:
 		break;
 	case ETYPE_8021ad:
-		pqinq = rte_pktmbuf_mtod(mbuf, const struct qinq_hdr *);
-		if ((priority = detect_l2_priority(pqinq)) == OUT_DISCARD)
+		if ((priority = detect_l2_priority(key)) == OUT_DISCARD)
 			break;
-		ipv4_hdr = (const struct ipv4_hdr *)(pqinq + 1);
-		if ((priority = detect_l3_priority(priority, ipv4_hdr)) == OUT_DISCARD)
+		if ((priority = detect_l3_priority(priority, key->version_ihl, key->tos)) == OUT_DISCARD)
 			break;
+		pqinq = rte_pktmbuf_mtod(mbuf, const struct qinq_hdr *);
+		ipv4_hdr = (const struct ipv4_hdr *)(pqinq + 1);
 		if ((priority = detect_l4_priority(priority, ipv4_hdr)) == OUT_DISCARD)
 			break;
 		break;
@@ -147,7 +148,7 @@ static inline void handle_aggregator(struct task_aggregator *task, struct rte_mb
 		break;
 	case ETYPE_IPv4:
 		ipv4_hdr = (const struct ipv4_hdr *)(peth+1);
-		if ((priority = detect_l3_priority(LOW_PRIORITY, ipv4_hdr)) == OUT_DISCARD)
+		if ((priority = detect_l3_priority(LOW_PRIORITY, ipv4_hdr->version_ihl, ipv4_hdr->type_of_service)) == OUT_DISCARD)
 			break;
 		if ((priority = detect_l4_priority(priority, ipv4_hdr)) == OUT_DISCARD)
 			break;
@@ -171,29 +172,14 @@ static int handle_aggregator_bulk(struct task_base *tbase, struct rte_mbuf **mbu
 {
 	struct task_aggregator *task = (struct task_aggregator *)tbase;
 
-	uint16_t j;
+	struct qinq_key keys[MAX_PKT_BURST];
+	uint32_t lut[MAX_PKT_BURST];
 	uint32_t drop_bytes = 0;
-#ifdef PROX_PREFETCH_OFFSET
-	for (j = 0; j < PROX_PREFETCH_OFFSET && j < n_pkts; ++j) {
-		prefetch_nta(mbufs[j]);
-	}
-	for (j = 1; j < PROX_PREFETCH_OFFSET && j < n_pkts; ++j) {
-		prefetch_nta(rte_pktmbuf_mtod(mbufs[j - 1], void *));
-	}
-#endif
-	for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
-#ifdef PROX_PREFETCH_OFFSET
-		prefetch_nta(mbufs[j + PREFETCH_OFFSET]);
-		prefetch_nta(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
-#endif
-		handle_aggregator(task, mbufs[j]);
-	}
-#ifdef PROX_PREFETCH_OFFSET
-	prefetch_nta(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
-	for (; j < n_pkts; ++j) {
-		handle_aggregator(task, mbufs[j]);
+
+	qinq_keys_gather(mbufs, n_pkts, keys, lut);
+	for (uint16_t j = 0; j < n_pkts; ++j) {
+		handle_aggregator(task, mbufs[j], &keys[j]);
 	}
-#endif
 
 	for (int i = 0 ; i < task->drop.pkt_nb; i++) {
 		drop_bytes += mbuf_wire_size(task->drop.buffer[i]);
@@ -30,6 +30,8 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <errno.h>
+
 #include <rte_mbuf.h>
 #include <rte_hash.h>
 #include <rte_hash_crc.h>
@@ -53,8 +55,10 @@
 #include "log.h"
 #include "prox_port_cfg.h"
 #include "hash_entry_types.h"
-#include "prox_shared.h"
+#include "route_table.h"
 #include "handle_cgnat.h"
+#include "prox_events.h"
+#include "clock.h"
 
 #define ALL_32_BITS 0xffffffff
 #define BIT_16_TO_31 0xffff0000
@@ -63,6 +67,16 @@
 
 #define IP4(x) x & 0xff, (x >> 8) & 0xff, (x >> 16) & 0xff, x >> 24
 
+/* Number of flow entries checked for expiry per sweep step */
+#define CGNAT_SWEEP_BATCH 64
+/* Shortest session timeout: flow_time is refreshed at most every
+   half timeout, shorter timeouts would refresh it on every packet */
+#define CGNAT_MIN_SESSION_TIMEOUT_MS 10
+/* Port block allocation: upper bounds on the blocks per public IP
+   (two level bitmap) and on the blocks held by one subscriber */
+#define CGNAT_MAX_BLOCKS_PER_IP 4096
+#define CGNAT_MAX_BLOCKS_PER_SUB 8
+
 struct private_key {
 		uint32_t ip_addr;
 		uint16_t l4_port;
@@ -73,6 +87,7 @@ struct private_flow_entry {
 	uint32_t ip_addr;
 	uint32_t private_ip_idx;
 	uint16_t l4_port;
+	uint8_t  static_entry;  /* never expires */
 };
 
 struct public_key {
@@ -85,6 +100,9 @@ struct public_entry {
 	uint16_t l4_port;
 	uint32_t private_ip_idx;
 	uint8_t dpdk_port;
+	/* Last traffic from the public side, the private flow entry
+	   is only looked up by the sweep */
+	uint64_t flow_time;
 };
 
 struct public_ip_config_info {
@@ -92,6 +110,16 @@ struct public_ip_config_info {
 	uint32_t max_port_count;
 	uint32_t port_free_count;
 	uint16_t *port_list;
+	/* Port block allocation: block b owns the ports from
+	   port_beg + b * block size, its free ports are stacked in
+	   port_list starting at b * block size. */
+	uint16_t port_beg;
+	uint32_t n_dyn_ports;
+	uint32_t n_blocks;
+	uint32_t n_free_blocks;
+	uint64_t free_block_words;      /* bit w set if free_blocks[w] != 0 */
+	uint64_t *free_blocks;          /* bit b set if block b is free */
+	uint16_t *block_free_count;
 };
 
 struct private_ip_info {
@@ -100,6 +128,9 @@ struct private_ip_info {
 	uint32_t public_ip_idx;
 	struct rte_ether *private_mac;
 	uint8_t static_entry;
+	uint32_t n_ports;               /* dynamic ports in use */
+	uint16_t n_blocks;
+	uint16_t blocks[CGNAT_MAX_BLOCKS_PER_SUB];
 };
 
 struct task_nat {
@@ -109,11 +140,12 @@ struct task_nat {
 	struct rte_hash  *public_ip_port_hash;
 	struct private_flow_entry *private_flow_entries;
 	struct public_entry *public_entries;
+	struct route_table *route_table;
+	/* Tables in use by the current bulk, see route_table_get() */
 	struct next_hop *next_hops;
 	struct lcore_cfg *lconf;
 	struct rte_lpm *ipv4_lpm;
 	uint32_t total_free_port_count;
-	uint32_t number_free_rules;
 	int    private;
 	uint32_t public_ip_count;
 	uint32_t last_ip;
@@ -125,6 +157,20 @@ struct task_nat {
 	uint64_t src_mac_from_dpdk_port[PROX_MAX_PORTS];
 	volatile int dump_public_hash;
 	volatile int dump_private_hash;
+	/* Session aging, only done by the first private task of a core
+	   as the tables are shared by all cgnat tasks of the core */
+	uint32_t n_flow_entries;
+	uint32_t sweep_pos;
+	uint64_t session_timeout;
+	uint64_t sweep_period;
+	/* Granularity of flow_time, set on all cgnat tasks */
+	uint64_t flow_refresh;
+	struct cgnat_session_stats sessions;
+	uint32_t port_block_size;       /* 0: ports are allocated one by one */
+	uint32_t port_quota;            /* 0: no per subscriber limit */
+	uint32_t max_blocks;
+	struct event_lcore *events;
+	uint8_t task_id;
 };
 static __m128i proto_ipsrc_portsrc_mask;
 static __m128i proto_ipdst_portdst_mask;
@@ -166,7 +212,7 @@ static uint8_t route_ipv4(struct task_nat *task, struct rte_mbuf *mbuf)
 		break;
 	default:
 		/* Routing for other protocols is not implemented */
-		plogx_info("Routing nit implemented for this protocol\n");
+		event_sample(task->events, EVENT_CGNAT_NO_ROUTE, task->task_id, ip->src_addr, 0, ip->dst_addr, 0);
 		return OUT_DISCARD;
 	}
 
@@ -176,9 +222,7 @@ static uint8_t route_ipv4(struct task_nat *task, struct rte_mbuf *mbuf)
 	uint8_t next_hop_index;
 #endif
 	if (unlikely(rte_lpm_lookup(task->ipv4_lpm, rte_bswap32(dst_ip), &next_hop_index) != 0)) {
-		uint8_t* dst_ipp = (uint8_t*)&dst_ip;
-		plog_warn("lpm_lookup failed for ip %d.%d.%d.%d: rc = %d\n",
-			dst_ipp[0], dst_ipp[1], dst_ipp[2], dst_ipp[3], -ENOENT);
+		event_sample(task->events, EVENT_CGNAT_NO_ROUTE, task->task_id, ip->src_addr, 0, dst_ip, 0);
 		return OUT_DISCARD;
 	}
 
@@ -192,18 +236,71 @@ static int release_ip(struct task_nat *task, uint32_t *ip_addr, int public_ip_id
 	return 0;
 }
 
-static int release_port(struct task_nat *task, uint32_t public_ip_idx, uint16_t udp_src_port)
+static int pba_get_block(struct public_ip_config_info *ip_info)
+{
+	if (!ip_info->free_block_words)
+		return -1;
+
+	uint32_t w = __builtin_ctzll(ip_info->free_block_words);
+	uint32_t b = __builtin_ctzll(ip_info->free_blocks[w]);
+
+	ip_info->free_blocks[w] &= ~(1ULL << b);
+	if (!ip_info->free_blocks[w])
+		ip_info->free_block_words &= ~(1ULL << w);
+	ip_info->n_free_blocks--;
+	return w * 64 + b;
+}
+
+static void pba_put_block(struct public_ip_config_info *ip_info, uint32_t block)
+{
+	ip_info->free_blocks[block / 64] |= 1ULL << (block % 64);
+	ip_info->free_block_words |= 1ULL << (block / 64);
+	ip_info->n_free_blocks++;
+}
+
+static int release_block_port(struct task_nat *task, struct private_ip_info *sub, struct public_ip_config_info *ip_info, uint16_t udp_src_port)
+{
+	uint32_t bs = task->port_block_size;
+	uint32_t block = (uint16_t)(rte_bswap16(udp_src_port) - ip_info->port_beg) / bs;
+
+	if (block >= ip_info->n_blocks || ip_info->block_free_count[block] >= bs) {
+		return -1;
+	}
+	ip_info->port_list[block * bs + ip_info->block_free_count[block]] = udp_src_port;
+	ip_info->block_free_count[block]++;
+	ip_info->port_free_count++;
+	if (ip_info->block_free_count[block] == bs) {
+		/* Last port of the block came back: return it to the public IP */
+		for (uint16_t i = 0; i < sub->n_blocks; i++) {
+			if (sub->blocks[i] == block) {
+				sub->blocks[i] = sub->blocks[--sub->n_blocks];
+				break;
+			}
+		}
+		pba_put_block(ip_info, block);
+	}
+	return 0;
+}
+
+static int release_port(struct task_nat *task, uint32_t private_ip_idx, uint32_t public_ip_idx, uint16_t udp_src_port)
 {
 	struct public_ip_config_info *public_ip_config_info = &task->public_ip_config_info[public_ip_idx];
-	if (public_ip_config_info->max_port_count > public_ip_config_info->port_free_count) {
+	struct private_ip_info *sub = &task->private_ip_info[private_ip_idx];
+
+	if (task->port_block_size) {
+		if (release_block_port(task, sub, public_ip_config_info, udp_src_port) < 0) {
+			event_sample(task->events, EVENT_CGNAT_RELEASE_FAILED, task->task_id, 0, 0, public_ip_config_info->public_ip, udp_src_port);
+			return -1;
+		}
+	} else if (public_ip_config_info->max_port_count > public_ip_config_info->port_free_count) {
 		public_ip_config_info->port_list[public_ip_config_info->port_free_count] = udp_src_port;
 		public_ip_config_info->port_free_count++;
-		task->total_free_port_count ++;
-		plogx_dbg("Now %d free ports for IP %d.%d.%d.%d\n", public_ip_config_info->port_free_count, IP4(public_ip_config_info->public_ip));
 	} else {
-		plogx_err("Unable to release port for ip index %d: max_port_count = %d, port_free_count = %d", public_ip_idx, public_ip_config_info->max_port_count, public_ip_config_info->port_free_count);
+		event_sample(task->events, EVENT_CGNAT_RELEASE_FAILED, task->task_id, 0, 0, public_ip_config_info->public_ip, udp_src_port);
 		return -1;
 	}
+	sub->n_ports--;
+	task->total_free_port_count ++;
 	return 0;
 }
 
@@ -214,9 +311,7 @@ static int get_new_ip(struct task_nat *task, uint32_t *ip_addr)
 		task->last_ip = 0;
 	for (uint32_t ip_idx = task->last_ip; ip_idx < task->public_ip_count; ip_idx++) {
 		ip_info = &task->public_ip_config_info[ip_idx];
-		plogx_dbg("Checking public IP index %d\n", ip_idx);
-		if ((ip_info->port_free_count) > 0) {
-			plogx_dbg("Public IP index %d (IP %d.%d.%d.%d) has %d free ports\n", ip_idx, IP4(ip_info->public_ip), ip_info->port_free_count);
+		if (task->port_block_size ? ip_info->n_free_blocks : ip_info->port_free_count) {
 			*ip_addr = ip_info->public_ip;
 			task->last_ip = ip_idx;
 			return ip_idx;
@@ -224,8 +319,7 @@ static int get_new_ip(struct task_nat *task, uint32_t *ip_addr)
 	}
 	for (uint32_t ip_idx = 0; ip_idx < task->last_ip; ip_idx++) {
 		ip_info = &task->public_ip_config_info[ip_idx];
-		if ((ip_info->port_free_count) > 0) {
-			plogx_dbg("Public IP index %d (IP %d.%d.%d.%d) has %d free ports\n", ip_idx, IP4(ip_info->public_ip), ip_info->port_free_count);
+		if (task->port_block_size ? ip_info->n_free_blocks : ip_info->port_free_count) {
 			*ip_addr = ip_info->public_ip;
 			task->last_ip = ip_idx;
 			return ip_idx;
@@ -234,21 +328,54 @@ static int get_new_ip(struct task_nat *task, uint32_t *ip_addr)
 	return -1;
 }
 
-static int get_new_port(struct task_nat *task, uint32_t ip_idx, uint16_t *udp_src_port)
+/* Take a port from one of the blocks owned by the subscriber, or
+   grab a new block of its public IP if they are all exhausted. */
+static int get_block_port(struct task_nat *task, struct private_ip_info *sub, struct public_ip_config_info *ip_info, uint16_t *udp_src_port)
+{
+	uint32_t bs = task->port_block_size;
+	int block = -1;
+
+	for (uint16_t i = 0; i < sub->n_blocks; i++) {
+		if (ip_info->block_free_count[sub->blocks[i]]) {
+			block = sub->blocks[i];
+			break;
+		}
+	}
+	if (block < 0) {
+		if (sub->n_blocks >= task->max_blocks)
+			return -1;
+		block = pba_get_block(ip_info);
+		if (block < 0)
+			return -1;
+		sub->blocks[sub->n_blocks++] = block;
+	}
+	ip_info->block_free_count[block]--;
+	ip_info->port_free_count--;
+	*udp_src_port = ip_info->port_list[block * bs + ip_info->block_free_count[block]];
+	return 0;
+}
+
+static int get_new_port(struct task_nat *task, uint32_t private_ip_idx, uint32_t ip_idx, uint16_t *udp_src_port)
 {
-	int ret;
 	struct public_ip_config_info *public_ip_config_info = &task->public_ip_config_info[ip_idx];
-	if (public_ip_config_info->port_free_count > 0) {
+	struct private_ip_info *sub = &task->private_ip_info[private_ip_idx];
+
+	if (task->port_quota && sub->n_ports >= task->port_quota)
+		return -EDQUOT;
+	if (task->port_block_size) {
+		if (get_block_port(task, sub, public_ip_config_info, udp_src_port) < 0)
+			return -ENOSPC;
+	} else if (public_ip_config_info->port_free_count > 0) {
 		public_ip_config_info->port_free_count--;
 		*udp_src_port = public_ip_config_info->port_list[public_ip_config_info->port_free_count];
-		task->total_free_port_count --;
-		plogx_info("Now %d free ports for IP %d.%d.%d.%d\n", public_ip_config_info->port_free_count, IP4(public_ip_config_info->public_ip));
 	} else
-		return -1;
+		return -ENOSPC;
+	sub->n_ports++;
+	task->total_free_port_count --;
 	return 0;
 }
 
-static int delete_port_entry(struct task_nat *task, uint8_t proto, uint32_t private_ip, uint16_t private_port,  uint32_t public_ip, uint16_t public_port, int public_ip_idx)
+static int delete_port_entry(struct task_nat *task, uint8_t proto, uint32_t private_ip, uint16_t private_port,  uint32_t public_ip, uint16_t public_port, int public_ip_idx, int private_ip_idx)
 {
 	int ret;
 	struct private_key private_key;
@@ -258,21 +385,19 @@ static int delete_port_entry(struct task_nat *task, uint8_t proto, uint32_t priv
 	private_key.l4_port = private_port;
 	ret = rte_hash_del_key(task->private_ip_port_hash, (const void *)&private_key);
 	if (ret < 0) {
-		plogx_info("Unable delete key ip %d.%d.%d.%d / port %x in private ip_port hash\n", IP4(private_ip), private_port);
+		event_sample(task->events, EVENT_CGNAT_DEL_FAILED, task->task_id, private_ip, private_port, public_ip, public_port);
 		return -1;
-	} else {
-		plogx_dbg("Deleted ip %d.%d.%d.%d / port %x from private ip_port hash\n", IP4(private_ip), private_port);
 	}
 	public_key.ip_addr = public_ip;
 	public_key.l4_port = public_port;
 	ret = rte_hash_del_key(task->public_ip_port_hash, (const void *)&public_key);
 	if (ret < 0) {
-		plogx_info("Unable delete key ip %d.%d.%d.%d / port %x in public ip_port hash\n", IP4(public_ip), public_port);
+		event_sample(task->events, EVENT_CGNAT_DEL_FAILED, task->task_id, private_ip, private_port, public_ip, public_port);
 		return -1;
-	} else {
-		plogx_dbg("Deleted ip %d.%d.%d.%d / port %x (hash index %d) from public ip_port hash\n", IP4(public_ip), public_port, ret);
-		release_port(task, public_ip_idx, public_port);
 	}
+	release_port(task, private_ip_idx, public_ip_idx, public_port);
+	event_count(task->events, EVENT_CGNAT_SESSION_DEL);
+	task->sessions.active--;
 	return 0;
 }
 
@@ -282,8 +407,9 @@ static int add_new_port_entry(struct task_nat *task, uint8_t proto, int public_i
 	struct public_key public_key;
 	uint32_t ip = task->public_ip_config_info[public_ip_idx].public_ip;
 	int ret;
-	if (get_new_port(task, public_ip_idx, port) < 0) {
-		plogx_info("Unable to find new port for IP %x\n", private_src_ip);
+	ret = get_new_port(task, private_ip_idx, public_ip_idx, port);
+	if (ret < 0) {
+		event_sample(task->events, ret == -EDQUOT ? EVENT_CGNAT_PORT_QUOTA : EVENT_CGNAT_NO_PORT, task->task_id, private_src_ip, private_udp_port, ip, 0);
 		return -1;
 	}
 //	private_key.proto = proto;
@@ -291,15 +417,14 @@ static int add_new_port_entry(struct task_nat *task, uint8_t proto, int public_i
 	private_key.l4_port = private_udp_port;
 	ret = rte_hash_add_key(task->private_ip_port_hash, (const void *)&private_key);
 	if (ret < 0) {
-		plogx_info("Unable add ip %d.%d.%d.%d / port %x in private ip_port hash\n", IP4(private_src_ip), private_udp_port);
-		release_port(task, public_ip_idx, *port);
+		event_sample(task->events, EVENT_CGNAT_TABLE_FULL, task->task_id, private_src_ip, private_udp_port, ip, *port);
+		release_port(task, private_ip_idx, public_ip_idx, *port);
 		return -1;
 	} else if (task->private_flow_entries[ret].ip_addr) {
-		plogx_dbg("Race condition properly handled: port alrerady added\n");
-		release_port(task, public_ip_idx, *port);
+		/* Same flow seen twice in the burst: port already added */
+		event_count(task->events, EVENT_CGNAT_RACE);
+		release_port(task, private_ip_idx, public_ip_idx, *port);
 		return ret;
-	} else {
-		plogx_dbg("Added ip %d.%d.%d.%d / port %x in private ip_port hash => %d.%d.%d.%d / %d - index = %d\n", IP4(private_src_ip), private_udp_port, IP4(ip), *port, ret);
 	}
 	task->private_flow_entries[ret].ip_addr = ip;
 	task->private_flow_entries[ret].l4_port = *port;
@@ -308,26 +433,93 @@ static int add_new_port_entry(struct task_nat *task, uint8_t proto, int public_i
 
 	public_key.ip_addr = ip;
 	public_key.l4_port = *port;
-	plogx_dbg("Adding key ip %d.%d.%d.%d / port %x in public ip_port hash\n", IP4(ip), *port);
 	ret = rte_hash_add_key(task->public_ip_port_hash, (const void *)&public_key);
 	if (ret < 0) {
-		plogx_info("Unable add ip %x / port %x in public ip_port hash\n", ip, *port);
+		event_sample(task->events, EVENT_CGNAT_TABLE_FULL, task->task_id, private_src_ip, private_udp_port, ip, *port);
 		// TODO: remove from private_ip_port_hash
-		release_port(task, public_ip_idx, *port);
+		release_port(task, private_ip_idx, public_ip_idx, *port);
 		return -1;
-	} else {
-		plogx_dbg("Added ip %d.%d.%d.%d / port %x in public ip_port hash\n", IP4(ip), *port);
 	}
 	task->public_entries[ret].ip_addr = private_src_ip;
 	task->public_entries[ret].l4_port = private_udp_port;
 	task->public_entries[ret].dpdk_port = mbuf->port;
        	task->public_entries[ret].private_ip_idx = private_ip_idx;
+	task->public_entries[ret].flow_time = tsc;
+	event_count(task->events, EVENT_CGNAT_SESSION_ADD);
+	task->sessions.created++;
+	task->sessions.active++;
 	return ret;
 }
 
+/* Remove an idle dynamic mapping from both hash tables and give its
+   port back. The private key is only known through the public
+   entry. Returns 1 if the mapping is still used from the public
+   side. */
+static int expire_flow_entry(struct task_nat *task, struct private_flow_entry *flow, uint64_t tsc)
+{
+	struct public_key public_key;
+	int public_pos, public_ip_idx;
+
+	public_key.ip_addr = flow->ip_addr;
+	public_key.l4_port = flow->l4_port;
+	public_pos = rte_hash_lookup(task->public_ip_port_hash, (const void *)&public_key);
+	if (public_pos < 0) {
+		event_sample(task->events, EVENT_CGNAT_DEL_FAILED, task->task_id, 0, 0, flow->ip_addr, flow->l4_port);
+		return -1;
+	}
+
+	struct public_entry *public_entry = &task->public_entries[public_pos];
+
+	/* Still active in the public to private direction */
+	if (tsc - public_entry->flow_time < task->session_timeout) {
+		flow->flow_time = public_entry->flow_time;
+		return 1;
+	}
+
+	public_ip_idx = task->private_ip_info[flow->private_ip_idx].public_ip_idx;
+	if (delete_port_entry(task, 0, public_entry->ip_addr, public_entry->l4_port, flow->ip_addr, flow->l4_port, public_ip_idx, flow->private_ip_idx) < 0)
+		return -1;
+
+	/* Positions are reused by the hash: entries must look unused */
+	memset(flow, 0, sizeof(*flow));
+	memset(public_entry, 0, sizeof(*public_entry));
+	return 0;
+}
+
+/* Incremental sweep: each step checks CGNAT_SWEEP_BATCH flow entries
+   so that the whole table is covered about twice per session
+   timeout, without ever stalling the datapath for long. */
+static uint64_t tsc_sweep_sessions(struct lcore_cfg *lconf, void *data)
+{
+	struct task_nat *task = data;
+	uint64_t tsc = rte_rdtsc();
+
+	for (uint32_t n = 0; n < CGNAT_SWEEP_BATCH; ++n) {
+		struct private_flow_entry *flow = &task->private_flow_entries[task->sweep_pos];
+
+		if (++task->sweep_pos == task->n_flow_entries)
+			task->sweep_pos = 0;
+		if (flow->ip_addr == 0 || flow->static_entry)
+			continue;
+		if (tsc - flow->flow_time < task->session_timeout)
+			continue;
+		if (expire_flow_entry(task, flow, tsc) == 0)
+			task->sessions.expired++;
+	}
+	return task->sweep_period;
+}
+
+const struct cgnat_session_stats *task_cgnat_get_session_stats(struct task_base *tbase)
+{
+	struct task_nat *task = (struct task_nat *)tbase;
+
+	return &task->sessions;
+}
+
 static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
         struct task_nat *task = (struct task_nat *)tbase;
+	struct lpm4 *lpm = route_table_get(task->route_table);
         uint8_t out[MAX_PKT_BURST];
         uint16_t j;
 	uint32_t *ip_addr, public_ip, private_ip;
@@ -340,6 +532,12 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 	void *keys[MAX_PKT_BURST];
 	int32_t positions[MAX_PKT_BURST];
 	int map[MAX_PKT_BURST] = {0};
+	/* Packet index of each key passed to the bulk lookups */
+	uint16_t pkt_idx[MAX_PKT_BURST];
+	uint16_t k;
+
+	task->ipv4_lpm = lpm->rte_lpm;
+	task->next_hops = lpm->next_hops;
 
 	if (unlikely(task->dump_public_hash)) {
 		const struct public_key *next_key;
@@ -375,38 +573,52 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 	}
 	if (task->private) {
        		struct private_key key[MAX_PKT_BURST];
+		uint16_t n_keys = 0;
+
         	for (j = 0; j < n_pkts; ++j) {
 			/* Currently, only support eth/ipv4 packets */
 			if (pkt[j]->ether_hdr.ether_type != ETYPE_IPv4) {
-				plogx_info("Currently, only support eth/ipv4 packets\n");
+				event_count(task->events, EVENT_CGNAT_NOT_IPV4);
 				out[j] = OUT_DISCARD;
-				keys[j] = (void *)NULL;
 				continue;
 			}
-       			key[j].ip_addr = pkt[j]->ipv4_hdr.src_addr;
-			key[j].l4_port = pkt[j]->udp_hdr.src_port;
-			keys[j] = &key[j];
+       			key[n_keys].ip_addr = pkt[j]->ipv4_hdr.src_addr;
+			key[n_keys].l4_port = pkt[j]->udp_hdr.src_port;
+			keys[n_keys] = &key[n_keys];
+			pkt_idx[n_keys++] = j;
 		}
-		ret = rte_hash_lookup_bulk(task->private_ip_port_hash, (const void **)&keys, n_pkts, positions);
-		if (unlikely(ret < 0)) {
-			plogx_info("lookup_bulk failed in private_ip_port_hash\n");
-			return -1;
+		if (n_keys) {
+			ret = rte_hash_lookup_bulk(task->private_ip_port_hash, (const void **)&keys, n_keys, positions);
+			if (unlikely(ret < 0)) {
+				event_count(task->events, EVENT_CGNAT_LOOKUP_FAILED);
+				return -1;
+			}
+		}
+		/* The flow entries, and the private ip entries they
+		   point to, are spread over tables too large to stay in
+		   cache: fetch them for the whole burst first. */
+		for (k = 0; k < n_keys; ++k) {
+			if (positions[k] >= 0)
+				PREFETCH0(&task->private_flow_entries[positions[k]]);
+		}
+		for (k = 0; k < n_keys; ++k) {
+			if (positions[k] >= 0)
+				PREFETCH0(&task->private_ip_info[task->private_flow_entries[positions[k]].private_ip_idx]);
 		}
 		int n_new_mapping = 0;
-        	for (j = 0; j < n_pkts; ++j) {
-			port_idx = positions[j];
+        	for (k = 0; k < n_keys; ++k) {
+			j = pkt_idx[k];
+			port_idx = positions[k];
 			if (unlikely(port_idx < 0)) {
-				plogx_dbg("ip %d.%d.%d.%d / port %x not found in private ip/port hash\n", IP4(pkt[j]->ipv4_hdr.src_addr), pkt[j]->udp_hdr.src_port);
 				map[n_new_mapping] = j;
 				keys[n_new_mapping++] = (void *)&(pkt[j]->ipv4_hdr.src_addr);
 			} else {
 				ip_addr = &(pkt[j]->ipv4_hdr.src_addr);
 				udp_src_port = &(pkt[j]->udp_hdr.src_port);
-				plogx_dbg("ip/port %d.%d.%d.%d / %x found in private ip/port hash\n", IP4(pkt[j]->ipv4_hdr.src_addr), pkt[j]->udp_hdr.src_port);
        				*ip_addr = task->private_flow_entries[port_idx].ip_addr;
        				*udp_src_port = task->private_flow_entries[port_idx].l4_port;
 				uint64_t flow_time = task->private_flow_entries[port_idx].flow_time;
-				if (flow_time + tsc_hz < tsc) {
+				if (tsc - flow_time > task->flow_refresh) {
 					task->private_flow_entries[port_idx].flow_time = tsc;
 				}
 				private_ip_idx = task->private_flow_entries[port_idx].private_ip_idx;
@@ -421,14 +633,18 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 			// Find whether at least IP is already known...
 			ret = rte_hash_lookup_bulk(task->private_ip_hash, (const void **)&keys, n_new_mapping, positions);
 			if (unlikely(ret < 0)) {
-				plogx_info("lookup_bulk failed for private_ip_hash\n");
-				for (int k = 0; k < n_new_mapping; ++k) {
+				event_count(task->events, EVENT_CGNAT_LOOKUP_FAILED);
+				for (k = 0; k < n_new_mapping; ++k) {
 					j = map[k];
 					out[j] = OUT_DISCARD;
 				}
 				n_new_mapping = 0;
 			}
-       			for (int k = 0; k < n_new_mapping; ++k) {
+			for (k = 0; k < n_new_mapping; ++k) {
+				if (positions[k] >= 0)
+					PREFETCH0(&task->private_ip_info[positions[k]]);
+			}
+       			for (k = 0; k < n_new_mapping; ++k) {
 				private_ip_idx = positions[k];
 				j = map[k];
 				ip_addr = &(pkt[j]->ipv4_hdr.src_addr);
@@ -439,15 +655,12 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 				if (unlikely(private_ip_idx < 0)) {
 					private_ip = *ip_addr;
 					private_port = *udp_src_port;
-					plogx_dbg("Did not find private ip %d.%d.%d.%d in ip hash table, looking for new public ip\n", IP4(*ip_addr));
 					// IP not found, need to get a new IP/port mapping
 					public_ip_idx = get_new_ip(task, &public_ip);
 					if (public_ip_idx < 0) {
-						plogx_info("Unable to find new ip/port\n");
+						event_sample(task->events, EVENT_CGNAT_NO_PUBLIC_IP, task->task_id, private_ip, private_port, 0, 0);
 						out[j] = OUT_DISCARD;
 						continue;
-					} else {
-						plogx_dbg("found new public ip %d.%d.%d.%d at public IP index %d\n", IP4(public_ip), public_ip_idx);
 					}
 					private_ip_idx = rte_hash_add_key(task->private_ip_hash, (const void *)ip_addr);
 					// The key might be added multiple time - in case the same key was present in the bulk_lookup multiple times
@@ -456,16 +669,16 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 					// as a for a new flow (flow renewal), probably only one packet will be sent (e.g. TCP SYN)
 					if (private_ip_idx < 0) {
 						release_ip(task, &public_ip, public_ip_idx);
-						plogx_info("Unable add ip %d.%d.%d.%d in private ip hash\n", IP4(*ip_addr));
+						event_sample(task->events, EVENT_CGNAT_TABLE_FULL, task->task_id, private_ip, private_port, public_ip, 0);
 						out[j] = OUT_DISCARD;
 						continue;
 					} else if (task->private_ip_info[private_ip_idx].public_ip) {
-						plogx_info("race condition properly handled : ip %d.%d.%d.%d already in private ip hash\n", IP4(*ip_addr));
+						/* Same private ip seen twice in the burst */
+						event_count(task->events, EVENT_CGNAT_RACE);
 						release_ip(task, &public_ip, public_ip_idx);
 						public_ip = task->private_ip_info[private_ip_idx].public_ip;
 						public_ip_idx = task->private_ip_info[private_ip_idx].public_ip_idx;
 					} else {
-						plogx_dbg("Added ip %d.%d.%d.%d in private ip hash\n", IP4(*ip_addr));
 						rte_memcpy(&task->private_ip_info[private_ip_idx].private_mac, ((uint8_t *)pkt) + 6, 6);
 						task->private_ip_info[private_ip_idx].public_ip = public_ip;
 						task->private_ip_info[private_ip_idx].static_entry = 0;
@@ -486,20 +699,16 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 						release_ip(task, &public_ip, public_ip_idx);
 						task->last_ip = task->public_ip_count-1;
 					}
-					plogx_info("Failed to add new port entry\n");
 					out[j] = OUT_DISCARD;
 					continue;
-				} else {
-					private_ip = *ip_addr;
-					private_port = *udp_src_port;
-					plogx_info("Added new ip/port: private ip/port = %d.%d.%d.%d/%x public ip/port = %d.%d.%d.%d/%x, index = %d\n", IP4(private_ip), private_port, IP4(public_ip), public_port, port_idx);
 				}
+				private_ip = *ip_addr;
+				private_port = *udp_src_port;
        				// task->private_flow_entries[port_idx].ip_addr = task->private_ip_info[private_ip_idx].public_ip;
-				plogx_info("Added new port: private ip/port = %d.%d.%d.%d/%x, public ip/port = %d.%d.%d.%d/%x\n", IP4(private_ip), private_port, IP4(task->private_ip_info[private_ip_idx].public_ip), public_port);
        				*ip_addr = public_ip ;
        				*udp_src_port = public_port;
 				uint64_t flow_time = task->private_flow_entries[port_idx].flow_time;
-				if (flow_time + tsc_hz < tsc) {
+				if (tsc - flow_time > task->flow_refresh) {
 					task->private_flow_entries[port_idx].flow_time = tsc;
 				}
 				if (task->private_ip_info[private_ip_idx].mac_aging_time + tsc_hz < tsc)
@@ -508,47 +717,59 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 				// TODO: if route fails while just added new key in table, should we delete the key from the table?
 				out[j] =  route_ipv4(task, mbufs[j]);
 				if (out[j] && new_entry) {
-					delete_port_entry(task, proto, private_ip, private_port, *ip_addr, *udp_src_port, public_ip_idx);
-					plogx_info("Deleted port: private ip/port = %d.%d.%d.%d/%x, public ip/port = %d.%d.%d.%d/%x\n", IP4(private_ip), private_port, IP4(*ip_addr), *udp_src_port);
+					delete_port_entry(task, proto, private_ip, private_port, *ip_addr, *udp_src_port, public_ip_idx, private_ip_idx);
 				}
 			}
 		}
         	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 	} else {
 		struct public_key public_key[MAX_PKT_BURST];
+		uint16_t n_keys = 0;
+
         	for (j = 0; j < n_pkts; ++j) {
 			/* Currently, only support eth/ipv4 packets */
 			if (pkt[j]->ether_hdr.ether_type != ETYPE_IPv4) {
-				plogx_info("Currently, only support eth/ipv4 packets\n");
+				event_count(task->events, EVENT_CGNAT_NOT_IPV4);
 				out[j] = OUT_DISCARD;
-				keys[j] = (void *)NULL;
 				continue;
 			}
-       			public_key[j].ip_addr = pkt[j]->ipv4_hdr.dst_addr;
-			public_key[j].l4_port = pkt[j]->udp_hdr.dst_port;
-			keys[j] = &public_key[j];
+       			public_key[n_keys].ip_addr = pkt[j]->ipv4_hdr.dst_addr;
+			public_key[n_keys].l4_port = pkt[j]->udp_hdr.dst_port;
+			keys[n_keys] = &public_key[n_keys];
+			pkt_idx[n_keys++] = j;
 		}
-		ret = rte_hash_lookup_bulk(task->public_ip_port_hash, (const void **)&keys, n_pkts, positions);
-		if (ret < 0) {
-			plogx_err("Failed lookup bulk public_ip_port_hash\n");
-			return -1;
+		if (n_keys) {
+			ret = rte_hash_lookup_bulk(task->public_ip_port_hash, (const void **)&keys, n_keys, positions);
+			if (ret < 0) {
+				event_count(task->events, EVENT_CGNAT_LOOKUP_FAILED);
+				return -1;
+			}
 		}
-        	for (j = 0; j < n_pkts; ++j) {
-			port_idx = positions[j];
+		for (k = 0; k < n_keys; ++k) {
+			if (positions[k] >= 0)
+				PREFETCH0(&task->public_entries[positions[k]]);
+		}
+		for (k = 0; k < n_keys; ++k) {
+			if (positions[k] >= 0)
+				PREFETCH0(&task->private_ip_info[task->public_entries[positions[k]].private_ip_idx]);
+		}
+        	for (k = 0; k < n_keys; ++k) {
+			j = pkt_idx[k];
+			port_idx = positions[k];
        			ip_addr = &(pkt[j]->ipv4_hdr.dst_addr);
 			udp_src_port = &(pkt[j]->udp_hdr.dst_port);
 			if (port_idx < 0) {
-				plogx_err("Failed to find ip/port %d.%d.%d.%d/%x in public_ip_port_hash\n", IP4(*ip_addr), *udp_src_port);
+				event_sample(task->events, EVENT_CGNAT_NO_MAPPING, task->task_id, pkt[j]->ipv4_hdr.src_addr, pkt[j]->udp_hdr.src_port, *ip_addr, *udp_src_port);
 				out[j] = OUT_DISCARD;
 			} else {
-				plogx_dbg("Found ip/port %d.%d.%d.%d/%x in public_ip_port_hash\n", IP4(*ip_addr), *udp_src_port);
         			*ip_addr = task->public_entries[port_idx].ip_addr;
 				*udp_src_port = task->public_entries[port_idx].l4_port;
 				private_ip_idx = task->public_entries[port_idx].private_ip_idx;
-				plogx_dbg("Found private IP info for ip %d.%d.%d.%d\n", IP4(*ip_addr));
 				rte_memcpy(((uint8_t *)(pkt[j])) + 0, &task->private_ip_info[private_ip_idx].private_mac, 6);
 				rte_memcpy(((uint8_t *)(pkt[j])) + 6, &task->src_mac_from_dpdk_port[task->public_entries[port_idx].dpdk_port], 6);
 				out[j] = task->public_entries[port_idx].dpdk_port;
+				if (tsc - task->public_entries[port_idx].flow_time > task->flow_refresh)
+					task->public_entries[port_idx].flow_time = tsc;
 			}
 			prox_ip_udp_cksum(mbufs[j], &pkt[j]->ipv4_hdr, sizeof(struct ether_hdr), sizeof(struct ipv4_hdr), task->offload_crc);
 		}
@@ -557,8 +778,23 @@ static int handle_nat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 
 }
 
+/* The tables are shared by all cgnat tasks of the core, but the
+   settings related to subscribers come from the first private task */
+static struct task_args *cgnat_first_private_targ(struct task_args *targ)
+{
+	for (uint8_t task_id = 0; task_id < targ->lconf->n_tasks_all; ++task_id) {
+		struct task_args *t = &targ->lconf->targs[task_id];
+
+		if (t->mode == CGNAT && t->use_src)
+			return t;
+	}
+	return NULL;
+}
+
 static int lua_to_hash_nat(struct task_args *targ, struct lua_State *L, enum lua_place from, const char *name, uint8_t socket)
 {
+	struct task_args *private_targ = cgnat_first_private_targ(targ);
+	const uint32_t port_block_size = private_targ ? private_targ->port_block_size : targ->port_block_size;
 	struct rte_hash *tmp_priv_ip_hash, *tmp_priv_hash, *tmp_pub_hash;
 	struct private_flow_entry *tmp_priv_flow_entries;
 	struct public_entry *tmp_pub_entries;
@@ -748,11 +984,8 @@ static int lua_to_hash_nat(struct task_args *targ, struct lua_State *L, enum lua
 	PROX_PANIC(tmp_public_ip_config_info == NULL, "Failed to allocate PUBLIC IP INFO\n");
 	plogx_info("%d PUBLIC IP INFO allocated\n", n_public_ip);
 
-	struct private_ip_info *tmp_priv_ip_info = (struct private_ip_info *)prox_zmalloc(4 * n_public_ip * sizeof(struct public_ip_config_info), socket);
-	PROX_PANIC(tmp_priv_ip_info == NULL, "Failed to allocate PRIVATE IP INFO\n");
-	plogx_info("%d PRIVATE IP INFO allocated\n", 4 * n_public_ip);
-
 	uint32_t ip_free_count = 0;
+	uint32_t n_blocks = 0;
 	for (i = 0; i < n_public_groups; i++) {
 		for (uint32_t ip = tmp_public_ip[i].ip_beg; ip <= tmp_public_ip[i].ip_end; ip++) {
 			ip_info = &tmp_public_ip_config_info[ip_free_count];
@@ -764,6 +997,10 @@ static int lua_to_hash_nat(struct task_args *targ, struct lua_State *L, enum lua
 				ip_info->port_free_count++;
 			}
 			ip_info->max_port_count = ip_info->port_free_count;
+			ip_info->port_beg = tmp_public_ip[i].port_beg;
+			ip_info->n_dyn_ports = ip_info->port_free_count;
+			if (port_block_size)
+				n_blocks += ip_info->n_dyn_ports / port_block_size;
 			plogx_dbg("Added IP %d.%d.%d.%d with ports from %x to %x at index %x\n", IP4(ip_info->public_ip), tmp_public_ip[i].port_beg, tmp_public_ip[i].port_end, ip_free_count);
 			ip_free_count++;
 		}
@@ -827,10 +1064,17 @@ static int lua_to_hash_nat(struct task_args *targ, struct lua_State *L, enum lua
 	plogx_info("hash table name = %s\n", hash_params.name);
 	hash_params.key_len = sizeof(uint32_t);
 	hash_params.entries = 4 * ip_free_count;
+	/* With port blocks, every block can serve a different subscriber */
+	if (n_blocks > hash_params.entries)
+		hash_params.entries = n_blocks;
 	tmp_priv_ip_hash = rte_hash_create(&hash_params);
 	PROX_PANIC(tmp_priv_ip_hash == NULL, "Failed to set up private ip hash table for NAT\n");
 	plogx_info("private ip hash table allocated, with %d entries of size %d\n", hash_params.entries, hash_params.key_len);
 
+	struct private_ip_info *tmp_priv_ip_info = (struct private_ip_info *)prox_zmalloc(hash_params.entries * sizeof(struct private_ip_info), socket);
+	PROX_PANIC(tmp_priv_ip_info == NULL, "Failed to allocate PRIVATE IP INFO\n");
+	plogx_info("%d PRIVATE IP INFO allocated\n", hash_params.entries);
+
 	hash_name[0]++;
 	//hash_params.name[0]++;
 	plogx_info("hash table name = %s\n", hash_params.name);
@@ -864,6 +1108,7 @@ static int lua_to_hash_nat(struct task_args *targ, struct lua_State *L, enum lua
 		tmp_priv_flow_entries[ret].flow_time = -1;
 		tmp_priv_flow_entries[ret].private_ip_idx = idx;
 		tmp_priv_flow_entries[ret].l4_port = port_to;
+		tmp_priv_flow_entries[ret].static_entry = 1;
 
 		public_key.ip_addr = ip_to;
 		public_key.l4_port = port_to;
@@ -888,12 +1133,56 @@ static int lua_to_hash_nat(struct task_args *targ, struct lua_State *L, enum lua
 			target_targ->private_flow_entries = tmp_priv_flow_entries;
 			target_targ->public_ip_port_hash = tmp_pub_hash;
 			target_targ->public_entries = tmp_pub_entries;
+			target_targ->n_private_flow_entries = n_entries;
 			target_targ->public_ip_config_info = tmp_public_ip_config_info;
 		}
 	}
 	return 0;
 }
 
+static int cgnat_is_first_private_task(struct task_args *targ)
+{
+	return cgnat_first_private_targ(targ) == targ;
+}
+
+/* Session timeout of the task doing the sweep for this core, 0 if
+   sessions do not expire */
+static uint32_t cgnat_session_timeout_ms(struct task_args *targ)
+{
+	struct task_args *private_targ = cgnat_first_private_targ(targ);
+
+	return private_targ ? private_targ->session_timeout_ms : 0;
+}
+
+/* Split the dynamic ports of each public IP into blocks, all free.
+   The IP info is shared by the cgnat tasks of the core: only set it
+   up once. */
+static void init_port_blocks(struct task_nat *task, int socket_id)
+{
+	uint32_t bs = task->port_block_size;
+
+	for (uint32_t ip_idx = 0; ip_idx < task->public_ip_count; ip_idx++) {
+		struct public_ip_config_info *ip_info = &task->public_ip_config_info[ip_idx];
+
+		if (ip_info->free_blocks)
+			continue;
+		ip_info->n_blocks = ip_info->n_dyn_ports / bs;
+		PROX_PANIC(ip_info->n_blocks > CGNAT_MAX_BLOCKS_PER_IP, "Too many port blocks (%u) for IP %d.%d.%d.%d, increase port block size\n", ip_info->n_blocks, IP4(ip_info->public_ip));
+		if (ip_info->n_dyn_ports % bs)
+			plog_warn("\t%u ports of IP %d.%d.%d.%d do not fill a block and are not used\n", ip_info->n_dyn_ports % bs, IP4(ip_info->public_ip));
+
+		ip_info->free_blocks = prox_zmalloc(CGNAT_MAX_BLOCKS_PER_IP / 64 * sizeof(uint64_t), socket_id);
+		PROX_PANIC(ip_info->free_blocks == NULL, "Failed to allocate port block bitmap\n");
+		ip_info->block_free_count = prox_zmalloc((ip_info->n_blocks + 1) * sizeof(uint16_t), socket_id);
+		PROX_PANIC(ip_info->block_free_count == NULL, "Failed to allocate port block counters\n");
+		for (uint32_t b = 0; b < ip_info->n_blocks; b++) {
+			ip_info->block_free_count[b] = bs;
+			pba_put_block(ip_info, b);
+		}
+		ip_info->port_free_count = ip_info->n_blocks * bs;
+	}
+}
+
 static void early_init_task_nat(struct task_args *targ)
 {
 	int ret;
@@ -925,36 +1214,13 @@ static void init_task_nat(struct task_base *tbase, struct task_args *targ)
 	task->public_ip_port_hash = targ->public_ip_port_hash;
 	task->public_entries = targ->public_entries;
 	task->public_ip_config_info = targ->public_ip_config_info;
+	task->events = event_lcore_get(targ->lconf->id, socket_id);
+	task->task_id = targ->id;
 
 	proto_ipsrc_portsrc_mask = _mm_set_epi32(BIT_0_TO_15, 0, ALL_32_BITS, BIT_8_TO_15);
 	proto_ipdst_portdst_mask = _mm_set_epi32(BIT_16_TO_31, ALL_32_BITS, 0, BIT_8_TO_15);
 
-	struct lpm4 *lpm;
-
-	PROX_PANIC(!strcmp(targ->route_table, ""), "route table not specified\n");
-	if (targ->flags & TASK_ARG_LOCAL_LPM) {
-		int ret = lua_to_lpm4(prox_lua(), GLOBAL, targ->route_table, socket_id, &lpm);
-		PROX_PANIC(ret, "Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
-		prox_sh_add_socket(socket_id, targ->route_table, lpm);
-		task->number_free_rules = lpm->n_free_rules;
-	} else {
-		lpm = prox_sh_find_socket(socket_id, targ->route_table);
-		if (!lpm) {
-			int ret = lua_to_lpm4(prox_lua(), GLOBAL, targ->route_table, socket_id, &lpm);
-			PROX_PANIC(ret, "Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
-			prox_sh_add_socket(socket_id, targ->route_table, lpm);
-		}
-	}
-	task->ipv4_lpm = lpm->rte_lpm;
-	task->next_hops = lpm->next_hops;
-	task->number_free_rules = lpm->n_free_rules;
-
-	for (uint32_t i = 0; i < MAX_HOP_INDEX; i++) {
-		int tx_port = task->next_hops[i].mac_port.out_idx;
-		if ((tx_port > targ->nb_txports - 1) && (tx_port > targ->nb_txrings - 1)) {
-			PROX_PANIC(1, "Routing Table contains port %d but only %d tx port/ %d ring:\n", tx_port, targ->nb_txports, targ->nb_txrings);
-		}
-	}
+	task->route_table = route_table_init(targ, socket_id);
 
 	if (targ->nb_txrings) {
 		struct task_args *dtarg;
@@ -979,6 +1245,48 @@ static void init_task_nat(struct task_base *tbase, struct task_args *targ)
 	if (port) {
 		task->offload_crc = port->capabilities.tx_offload_cksum;
 	}
+
+	/* The port blocks are shared by the cgnat tasks of the core:
+	   they all use the block size of the private task */
+	struct task_args *private_targ = cgnat_first_private_targ(targ);
+
+	task->port_quota = targ->port_quota;
+	task->port_block_size = private_targ ? private_targ->port_block_size : targ->port_block_size;
+	if (task->port_block_size) {
+		PROX_PANIC(task->port_block_size < 65536 / CGNAT_MAX_BLOCKS_PER_IP || task->port_block_size > UINT16_MAX,
+			   "port block size must be between %d and %d\n", 65536 / CGNAT_MAX_BLOCKS_PER_IP, UINT16_MAX);
+		task->max_blocks = CGNAT_MAX_BLOCKS_PER_SUB;
+		if (task->port_quota && (task->port_quota + task->port_block_size - 1) / task->port_block_size < task->max_blocks)
+			task->max_blocks = (task->port_quota + task->port_block_size - 1) / task->port_block_size;
+		init_port_blocks(task, socket_id);
+		plog_info("\tPorts allocated in blocks of %u, at most %u blocks per subscriber\n", task->port_block_size, task->max_blocks);
+	}
+	/* Ports that do not fill a block are not used */
+	task->total_free_port_count = 0;
+	for (uint32_t ip_idx = 0; ip_idx < task->public_ip_count; ip_idx++)
+		task->total_free_port_count += task->public_ip_config_info[ip_idx].port_free_count;
+
+	/* All cgnat tasks of the core refresh flow_time often enough
+	   for the timeout of the sweeping task */
+	uint32_t session_timeout_ms = cgnat_session_timeout_ms(targ);
+	task->flow_refresh = tsc_hz;
+	if (session_timeout_ms) {
+		PROX_PANIC(session_timeout_ms < CGNAT_MIN_SESSION_TIMEOUT_MS,
+			   "session timeout ms must be at least %d\n", CGNAT_MIN_SESSION_TIMEOUT_MS);
+		if (msec_to_tsc(session_timeout_ms) / 2 < task->flow_refresh)
+			task->flow_refresh = msec_to_tsc(session_timeout_ms) / 2;
+	}
+
+	if (targ->session_timeout_ms && task->private && cgnat_is_first_private_task(targ)) {
+		task->n_flow_entries = targ->n_private_flow_entries;
+		task->session_timeout = msec_to_tsc(targ->session_timeout_ms);
+		task->sweep_period = task->session_timeout / 2 / (task->n_flow_entries / CGNAT_SWEEP_BATCH + 1);
+		if (task->sweep_period == 0)
+			task->sweep_period = 1;
+		lconf_add_tsc_task(targ->lconf, tsc_sweep_sessions, task, task->sweep_period);
+		plog_info("\tSessions idle for %u ms are expired, sweeping %d entries every %"PRIu64" cycles\n",
+			  targ->session_timeout_ms, CGNAT_SWEEP_BATCH, task->sweep_period);
+	}
 }
 
 /* Basic static nat. */
@@ -33,9 +33,21 @@
 #ifndef _HANDLE_CGNAT_H_
 #define _HANDLE_CGNAT_H_
 
+#include <inttypes.h>
+
 struct task_nat;
+struct task_base;
+
+/* Dynamic sessions, counted by the task creating them (private
+   side). Static mappings are not included. */
+struct cgnat_session_stats {
+	uint64_t created;
+	uint64_t expired;
+	uint64_t active;
+};
 
 void task_cgnat_dump_public_hash(struct task_nat *task);
 void task_cgnat_dump_private_hash(struct task_nat *task);
+const struct cgnat_session_stats *task_cgnat_get_session_stats(struct task_base *tbase);
 
 #endif
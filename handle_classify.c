@@ -44,6 +44,7 @@
 #include "defines.h"
 #include "prefetch.h"
 #include "qinq.h"
+#include "qinq_classify.h"
 #include "prox_cfg.h"
 #include "log.h"
 #include "quit.h"
@@ -55,60 +56,13 @@ struct task_classify {
 	uint8_t             *dscp;
 };
 
-static inline void handle_classify(struct task_classify *task, struct rte_mbuf *mbuf)
-{
-	const struct qinq_hdr *pqinq = rte_pktmbuf_mtod(mbuf, const struct qinq_hdr *);
-
-	uint32_t qinq = PKT_TO_LUTQINQ(pqinq->svlan.vlan_tci, pqinq->cvlan.vlan_tci);
-
-	/* Traffic class can be set by ACL task. If this is the case,
-	   don't overwrite it using dscp. Instead, use the
-	   traffic class that had been set. */
-
-	uint32_t prev_tc;
-#if RTE_VERSION >= RTE_VERSION_NUM(1,8,0,0)
-	uint32_t dummy;
-	rte_sched_port_pkt_read_tree_path(mbuf, &dummy, &dummy, &prev_tc, &dummy);
-#else
-	struct rte_sched_port_hierarchy *sched = (struct rte_sched_port_hierarchy *) &mbuf->pkt.hash.sched;
-	prev_tc = sched->traffic_class;
-#endif
-
-	const struct ipv4_hdr *ipv4_hdr = (const struct ipv4_hdr *)(pqinq + 1);
-	uint8_t dscp = task->dscp[ipv4_hdr->type_of_service >> 2];
-
-	uint8_t queue = dscp & 0x3;
-	uint8_t tc = prev_tc? prev_tc : dscp >> 2;
-
-	rte_sched_port_pkt_write(mbuf, 0, task->user_table[qinq], tc, queue, 0);
-}
-
 static int handle_classify_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_classify *task = (struct task_classify *)tbase;
 
-	uint16_t j;
-#ifdef PROX_PREFETCH_OFFSET
-	for (j = 0; j < PROX_PREFETCH_OFFSET && j < n_pkts; ++j) {
-		prefetch_nta(mbufs[j]);
-	}
-	for (j = 1; j < PROX_PREFETCH_OFFSET && j < n_pkts; ++j) {
-		prefetch_nta(rte_pktmbuf_mtod(mbufs[j - 1], void *));
-	}
-#endif
-	for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
-#ifdef PROX_PREFETCH_OFFSET
-		prefetch_nta(mbufs[j + PREFETCH_OFFSET]);
-		prefetch_nta(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
-#endif
-		handle_classify(task, mbufs[j]);
-	}
-#ifdef PROX_PREFETCH_OFFSET
-	prefetch_nta(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
-	for (; j < n_pkts; ++j) {
-		handle_classify(task, mbufs[j]);
-	}
-#endif
+	/* Traffic class can be set by ACL task. If this is the case,
+	   don't overwrite it using dscp. */
+	qinq_classify_bulk(mbufs, n_pkts, task->user_table, task->dscp, 1);
 
 	return task->base.tx_pkt(&task->base, mbufs, n_pkts, NULL);
 }
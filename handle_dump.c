@@ -40,6 +40,10 @@
 #include "task_init.h"
 #include "task_base.h"
 #include "stats.h"
+#include "quit.h"
+#include "pcap_stream.h"
+
+#define DUMP_DEFAULT_SNAPLEN 65535
 
 struct task_dump {
 	struct task_base base;
@@ -47,6 +51,9 @@ struct task_dump {
         struct rte_mbuf **mbufs;
 	uint32_t n_pkts;
 	char pcap_file[128];
+	/* Only used in continuous capture mode */
+	struct pcap_stream *stream;
+	struct bpf_program *filter;
 };
 
 static uint16_t buffer_packets(struct task_dump *task, struct rte_mbuf **mbufs, uint16_t n_pkts)
@@ -75,17 +82,63 @@ static int handle_dump_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, ui
 	return n_pkts;
 }
 
+/* Continuous capture: packets are copied into the pcap stream and
+   released (or forwarded) immediately */
+static int handle_dump_stream_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
+{
+	struct task_dump *task = (struct task_dump *)tbase;
+	const uint64_t tsc = rte_rdtsc();
+
+	for (uint16_t j = 0; j < n_pkts; ++j) {
+		if (task->filter) {
+			struct pcap_pkthdr header = {{0}, 0, 0};
+
+			header.len = rte_pktmbuf_pkt_len(mbufs[j]);
+			header.caplen = rte_pktmbuf_data_len(mbufs[j]);
+			if (!pcap_offline_filter(task->filter, &header, rte_pktmbuf_mtod(mbufs[j], const u_char *)))
+				continue;
+		}
+		pcap_stream_add(task->stream, mbufs[j], tsc);
+	}
+
+	return task->base.tx_pkt(&task->base, mbufs, n_pkts, NULL);
+}
+
+static void init_task_dump_filter(struct task_dump *task, struct task_args *targ, int socket_id)
+{
+	pcap_t *handle = pcap_open_dead(DLT_EN10MB, targ->snaplen);
+
+	PROX_PANIC(handle == NULL, "Failed to create pcap handle for filter\n");
+	task->filter = prox_zmalloc(sizeof(*task->filter), socket_id);
+	PROX_PANIC(task->filter == NULL, "Failed to allocate pcap filter\n");
+	PROX_PANIC(pcap_compile(handle, task->filter, targ->pcap_filter, 1, PCAP_NETMASK_UNKNOWN),
+		   "Invalid pcap filter '%s': %s\n", targ->pcap_filter, pcap_geterr(handle));
+	pcap_close(handle);
+	plog_info("\tCapturing packets matching '%s'\n", targ->pcap_filter);
+}
+
 static void init_task_dump(struct task_base *tbase, __attribute__((unused)) struct task_args *targ)
 {
 	struct task_dump *task = (struct task_dump *)tbase;
 	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
 
-	task->mbufs = prox_zmalloc(sizeof(*task->mbufs) * targ->n_pkts, socket_id);
-	task->n_pkts = targ->n_pkts;
 	if (!strcmp(targ->pcap_file, "")) {
 		strcpy(targ->pcap_file, "out.pcap");
 	}
 	strncpy(task->pcap_file, targ->pcap_file, sizeof(task->pcap_file));
+
+	if (targ->pcap_stream_size) {
+		if (targ->snaplen == 0)
+			targ->snaplen = DUMP_DEFAULT_SNAPLEN;
+		if (strcmp(targ->pcap_filter, ""))
+			init_task_dump_filter(task, targ, socket_id);
+		task->stream = pcap_stream_create(targ->pcap_file, targ->pcap_stream_size, targ->snaplen, targ->pcap_rotate_size, socket_id);
+		tbase->handle_bulk = handle_dump_stream_bulk;
+		return;
+	}
+
+	task->mbufs = prox_zmalloc(sizeof(*task->mbufs) * targ->n_pkts, socket_id);
+	task->n_pkts = targ->n_pkts;
 }
 
 static void stop(struct task_base *tbase)
@@ -101,6 +154,11 @@ static void stop(struct task_base *tbase)
 	struct timeval tv = {0};
 	uint64_t tsc, beg = 0;
 
+	if (task->stream) {
+		pcap_stream_stop(task->stream);
+		return;
+	}
+
 	plogx_info("Dumping %d packets to '%s'\n", task->n_mbufs, task->pcap_file);
 	handle = pcap_open_dead(DLT_EN10MB, n_pkts);
 	pcap_dump_handle = pcap_dump_open(handle, task->pcap_file);
@@ -132,10 +190,19 @@ static void stop(struct task_base *tbase)
 	task->n_mbufs = 0;
 }
 
+static void start(struct task_base *tbase)
+{
+	struct task_dump *task = (struct task_dump *)tbase;
+
+	if (task->stream)
+		pcap_stream_start(task->stream);
+}
+
 static struct task_init task_init_dump = {
 	.mode_str = "dump",
 	.init = init_task_dump,
 	.handle = handle_dump_bulk,
+	.start = start,
 	.stop = stop,
 	.flag_features = TASK_FEATURE_ZERO_RX,
 	.size = sizeof(struct task_dump)
@@ -49,6 +49,7 @@
 #include "prox_shared.h"
 #include "etypes.h"
 #include "prox_cfg.h"
+#include "prox_events.h"
 #include "dpi/dpi.h"
 
 struct task_dpi_per_core {
@@ -63,6 +64,7 @@ struct task_fm {
 
 	struct dpi_engine        dpi_engine;
 	struct task_dpi_per_core *dpi_shared; /* Used only during init */
+	struct event_lcore       *events;
 };
 
 struct eth_ip4_udp {
@@ -184,7 +186,7 @@ static int handle_fm(struct task_fm *task, struct rte_mbuf *mbuf, uint64_t now_t
 	p = rte_pktmbuf_mtod(mbuf, struct eth_ip4_udp *);
 
 	if (0 != extract_flow_info(p, &fi, &fi_flipped, &len, &payload)) {
-		plogx_err("Unknown packet type\n");
+		event_count(task->events, EVENT_FM_UNKNOWN_PKT);
 		return OUT_DISCARD;
 	}
 
@@ -316,6 +318,7 @@ static void init_task_fm(struct task_base *tbase, struct task_args *targ)
 	static int dpi_inited = 0;
 
 	load_dpi_engine(targ->dpi_engine_path, &task->dpi_engine);
+	task->events = event_lcore_get(targ->lconf->id, rte_lcore_to_socket_id(targ->lconf->id));
 
 	task->kv_store_expire = get_shared_flow_table(targ, &task->dpi_engine);
 	task->dpi_shared = get_shared_dpi_shared(targ);
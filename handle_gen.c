@@ -39,6 +39,9 @@
 #include <rte_byteorder.h>
 #include <rte_ether.h>
 #include <rte_hash_crc.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #include "prox_shared.h"
 #include "random.h"
@@ -138,8 +141,20 @@ struct task_gen {
 	struct ether_addr  src_mac;
 	uint8_t flags;
 	uint8_t cksum_offload;
+	void (*copy_template)(uint8_t *dst, const uint8_t *src, uint16_t len); /* NULL for rte_memcpy */
+	uint32_t pkt_template_gen; /* incremented each time the templates change */
+	uint32_t n_prebuilt; /* number of pre-built mbufs, 0 if disabled */
+	uint32_t n_prebuilt_copies; /* n_prebuilt / n_pkts */
+	uint32_t prebuilt_copy; /* copy used for the current round through the templates */
+	struct rte_mbuf **prebuilt; /* prebuilt[c * n_pkts + i] is built from template i */
+	uint32_t *prebuilt_gen; /* template generation each pre-built mbuf was built from */
 } __rte_cache_aligned;
 
+/* Minimum number of pre-built mbufs. This must be large enough to
+   cover the packets still sitting in the TX descriptors when the
+   generator comes back to the same mbuf. */
+#define GEN_PREBUILT_MIN_MBUFS	4096
+
 static inline uint8_t ipv4_get_hdr_len(struct ipv4_hdr *ip)
 {
 	/* Optimize for common case of IPv4 header without options. */
@@ -360,15 +375,6 @@ static void task_gen_apply_random_fields(struct task_gen *task, uint8_t *hdr)
 	}
 }
 
-static void task_gen_apply_all_random_fields(struct task_gen *task, uint8_t **pkt_hdr, uint32_t count)
-{
-	if (!task->n_rands)
-		return;
-
-	for (uint16_t i = 0; i < count; ++i)
-		task_gen_apply_random_fields(task, pkt_hdr[i]);
-}
-
 static void task_gen_apply_accur_pos(struct task_gen *task, uint8_t *pkt_hdr, uint32_t accuracy)
 {
 	*(uint32_t *)(pkt_hdr + task->accur_pos) = accuracy;
@@ -379,34 +385,6 @@ static void task_gen_apply_sig(struct task_gen *task, uint8_t *pkt_hdr)
 	*(uint32_t *)(pkt_hdr + task->sig_pos) = task->sig;
 }
 
-static void task_gen_apply_all_accur_pos(struct task_gen *task, struct rte_mbuf **mbufs, uint8_t **pkt_hdr, uint32_t count)
-{
-	if (!task->accur_pos)
-		return;
-
-	/* The accuracy of task->pkt_queue_index - 64 is stored in
-	   packet task->pkt_queue_index. The ID modulo 64 is the
-	   same. */
-	for (uint16_t j = 0; j < count; ++j) {
-		if ((mbufs[j]->udata64 & MBUF_ARP) == 0) {
-			uint32_t accuracy = task->accur[(task->pkt_queue_index + j) & 63];
-			task_gen_apply_accur_pos(task, pkt_hdr[j], accuracy);
-		}
-	}
-}
-
-static void task_gen_apply_all_sig(struct task_gen *task, struct rte_mbuf **mbufs, uint8_t **pkt_hdr, uint32_t count)
-{
-	if (!task->sig_pos)
-		return;
-
-	for (uint16_t j = 0; j < count; ++j) {
-		if ((mbufs[j]->udata64 & MBUF_ARP) == 0) {
-			task_gen_apply_sig(task, pkt_hdr[j]);
-		}
-	}
-}
-
 static void task_gen_apply_unique_id(struct task_gen *task, uint8_t *pkt_hdr, const struct unique_id *id)
 {
 	struct unique_id *dst = (struct unique_id *)(pkt_hdr + task->packet_id_pos);
@@ -414,20 +392,6 @@ static void task_gen_apply_unique_id(struct task_gen *task, uint8_t *pkt_hdr, co
 	*dst = *id;
 }
 
-static void task_gen_apply_all_unique_id(struct task_gen *task, struct rte_mbuf **mbufs, uint8_t **pkt_hdr, uint32_t count)
-{
-	if (!task->packet_id_pos)
-		return;
-
-	for (uint16_t i = 0; i < count; ++i) {
-		if ((mbufs[i]->udata64 & MBUF_ARP) == 0) {
-			struct unique_id id;
-			unique_id_init(&id, task->generator_id, task->pkt_queue_index++);
-			task_gen_apply_unique_id(task, pkt_hdr[i], &id);
-		}
-	}
-}
-
 static void task_gen_checksum_packets(struct task_gen *task, struct rte_mbuf **mbufs, uint8_t **pkt_hdr, uint32_t count)
 {
 	if (!(task->runtime_flags & TASK_TX_CRC))
@@ -549,21 +513,196 @@ static void task_gen_load_and_prefetch(struct rte_mbuf **mbufs, uint8_t **pkt_hd
 		rte_prefetch0(pkt_hdr[i]);
 }
 
+/* Apply the fields that differ for each transmitted packet, except
+   for the time stamp. */
+static void task_gen_apply_per_pkt_fields(struct task_gen *task, uint8_t *hdr, uint64_t queue_index)
+{
+	/* The accuracy of task->pkt_queue_index - 64 is stored
+	   in packet task->pkt_queue_index. The ID modulo 64 is
+	   the same. */
+	if (task->accur_pos)
+		task_gen_apply_accur_pos(task, hdr, task->accur[queue_index & 63]);
+	if (task->packet_id_pos) {
+		struct unique_id id;
+
+		unique_id_init(&id, task->generator_id, task->pkt_queue_index++);
+		task_gen_apply_unique_id(task, hdr, &id);
+	}
+}
+
+/* Vector variants to copy a packet template into an mbuf. They copy
+   in chunks and finish with a (possibly overlapping) chunk ending at
+   len, so they never read beyond the template nor write beyond the
+   packet. They are only used if selected through "template copy":
+   AVX-512 can lower the core frequency. */
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void copy_template_avx2(uint8_t *dst, const uint8_t *src, uint16_t len)
+{
+	if (len < 32) {
+		rte_memcpy(dst, src, len);
+		return;
+	}
+
+	uint16_t last = len - 32;
+
+	for (uint16_t i = 0; i < last; i += 32)
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+	_mm256_storeu_si256((__m256i *)(dst + last), _mm256_loadu_si256((const __m256i *)(src + last)));
+}
+
+__attribute__((target("avx512f")))
+static void copy_template_avx512(uint8_t *dst, const uint8_t *src, uint16_t len)
+{
+	if (len < 64) {
+		rte_memcpy(dst, src, len);
+		return;
+	}
+
+	uint16_t last = len - 64;
+
+	for (uint16_t i = 0; i < last; i += 64)
+		_mm512_storeu_si512((void *)(dst + i), _mm512_loadu_si512((const void *)(src + i)));
+	_mm512_storeu_si512((void *)(dst + last), _mm512_loadu_si512((const void *)(src + last)));
+}
+#endif
+
+static void task_gen_select_copy_template(struct task_gen *task, const char *copy)
+{
+	task->copy_template = NULL;
+	if (!strcmp(copy, "") || !strcmp(copy, "memcpy"))
+		return;
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (!strcmp(copy, "avx512")) {
+		PROX_PANIC(!__builtin_cpu_supports("avx512f"), "AVX-512 is not supported by the CPU\n");
+		plog_info("\tUsing AVX-512 to build packets\n");
+		task->copy_template = copy_template_avx512;
+		return;
+	}
+	if (!strcmp(copy, "avx2")) {
+		PROX_PANIC(!__builtin_cpu_supports("avx2"), "AVX2 is not supported by the CPU\n");
+		plog_info("\tUsing AVX2 to build packets\n");
+		task->copy_template = copy_template_avx2;
+		return;
+	}
+#endif
+	PROX_PANIC(1, "Unsupported template copy '%s', expected memcpy, avx2 or avx512\n", copy);
+}
+
+static inline void task_gen_copy_template(struct task_gen *task, uint8_t *dst, const struct pkt_template *pkt_template)
+{
+	if (likely(task->copy_template == NULL))
+		rte_memcpy(dst, pkt_template->buf, pkt_template->len);
+	else
+		task->copy_template(dst, pkt_template->buf, pkt_template->len);
+}
+
+/* Build all packets of the burst in a single pass: copy the template
+   and apply randoms, accuracy, signature and unique id while the
+   packet is hot in the cache. Time stamps are written separately,
+   just before transmitting, by task_gen_write_latency(). */
 static void task_gen_build_packets(struct task_gen *task, struct rte_mbuf **mbufs, uint8_t **pkt_hdr, uint32_t count)
 {
+	const uint64_t first_queue_index = task->pkt_queue_index;
 	uint64_t will_send_bytes = 0;
 
 	for (uint16_t i = 0; i < count; ++i) {
-		struct pkt_template *pktpl = &task->pkt_template[task->pkt_idx];
 		struct pkt_template *pkt_template = &task->pkt_template[task->pkt_idx];
-		pkt_template_init_mbuf(pkt_template, mbufs[i], pkt_hdr[i]);
+		uint8_t *hdr = pkt_hdr[i];
+
+		rte_pktmbuf_pkt_len(mbufs[i]) = pkt_template->len;
+		rte_pktmbuf_data_len(mbufs[i]) = pkt_template->len;
+		init_mbuf_seg(mbufs[i]);
+		task_gen_copy_template(task, hdr, pkt_template);
 		mbufs[i]->udata64 = task->pkt_idx & TEMPLATE_INDEX_MASK;
-		struct ether_hdr *hdr = (struct ether_hdr *)pkt_hdr[i];
 		if (task->lat_enabled) {
 			task->pkt_tsc_offset[i] = bytes_to_tsc(task, will_send_bytes);
 			will_send_bytes += pkt_len_to_wire_size(pkt_template->len);
 		}
 		task->pkt_idx = task_gen_next_pkt_idx(task, task->pkt_idx);
+
+		if (task->n_rands)
+			task_gen_apply_random_fields(task, hdr);
+		if (task->sig_pos)
+			task_gen_apply_sig(task, hdr);
+		task_gen_apply_per_pkt_fields(task, hdr, first_queue_index + i);
+	}
+}
+
+/* Build pre-built mbuf k from its template. The mbuf must not be in
+   flight. Only the fields that never change between transmissions
+   are written here. */
+static void task_gen_prebuild_one(struct task_gen *task, uint32_t k)
+{
+	struct rte_mbuf *mbuf = task->prebuilt[k];
+	const uint32_t pkt_idx = k % task->n_pkts;
+	struct pkt_template *pkt_template = &task->pkt_template[pkt_idx];
+	uint8_t *hdr = rte_pktmbuf_mtod(mbuf, uint8_t *);
+
+	rte_pktmbuf_pkt_len(mbuf) = pkt_template->len;
+	rte_pktmbuf_data_len(mbuf) = pkt_template->len;
+	init_mbuf_seg(mbuf);
+	task_gen_copy_template(task, hdr, pkt_template);
+	mbuf->udata64 = pkt_idx & TEMPLATE_INDEX_MASK;
+	if (task->sig_pos)
+		task_gen_apply_sig(task, hdr);
+	task->prebuilt_gen[k] = task->pkt_template_gen;
+}
+
+static int task_gen_use_prebuilt(const struct task_gen *task)
+{
+	/* Randoms change the content of every packet. */
+	return task->n_prebuilt && !task->n_rands;
+}
+
+/* Select the pre-built mbufs for the next count packets without
+   changing any state. Fails if one of them has not yet been freed by
+   the PMD since it was last transmitted. */
+static int task_gen_take_prebuilt(struct task_gen *task, struct rte_mbuf **mbufs, uint32_t count)
+{
+	uint32_t pkt_idx = task->pkt_idx;
+	uint32_t copy = task->prebuilt_copy;
+
+	for (uint16_t i = 0; i < count; ++i) {
+		struct rte_mbuf *mbuf = task->prebuilt[copy * task->n_pkts + pkt_idx];
+
+		if (rte_mbuf_refcnt_read(mbuf) != 1)
+			return -1;
+		mbufs[i] = mbuf;
+		pkt_idx = task_gen_next_pkt_idx(task, pkt_idx);
+		if (pkt_idx == 0 && ++copy == task->n_prebuilt_copies)
+			copy = 0;
+	}
+	return 0;
+}
+
+/* Prepare the mbufs returned by task_gen_take_prebuilt(). Only the
+   per-packet fields are written, unless the templates changed since
+   the mbuf was built. The extra reference is dropped by the PMD once
+   the packet has been sent, returning the mbuf to us instead of to
+   the mempool. */
+static void task_gen_patch_prebuilt(struct task_gen *task, struct rte_mbuf **mbufs, uint8_t **pkt_hdr, uint32_t count)
+{
+	const uint64_t first_queue_index = task->pkt_queue_index;
+	uint64_t will_send_bytes = 0;
+
+	for (uint16_t i = 0; i < count; ++i) {
+		struct pkt_template *pkt_template = &task->pkt_template[task->pkt_idx];
+		const uint32_t k = task->prebuilt_copy * task->n_pkts + task->pkt_idx;
+
+		if (task->prebuilt_gen[k] != task->pkt_template_gen)
+			task_gen_prebuild_one(task, k);
+		rte_mbuf_refcnt_update(mbufs[i], 1);
+		if (task->lat_enabled) {
+			task->pkt_tsc_offset[i] = bytes_to_tsc(task, will_send_bytes);
+			will_send_bytes += pkt_len_to_wire_size(pkt_template->len);
+		}
+		task->pkt_idx = task_gen_next_pkt_idx(task, task->pkt_idx);
+		if (task->pkt_idx == 0 && ++task->prebuilt_copy == task->n_prebuilt_copies)
+			task->prebuilt_copy = 0;
+
+		task_gen_apply_per_pkt_fields(task, pkt_hdr[i], first_queue_index + i);
 	}
 }
 
@@ -675,17 +814,21 @@ static int handle_gen_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uin
 	task_gen_take_count(task, send_bulk);
 	task_gen_consume_tokens(task, would_send_bytes, send_bulk);
 
-	struct rte_mbuf **new_pkts = local_mbuf_refill_and_take(&task->local_mbuf, send_bulk);
-	if (new_pkts == NULL)
-		return 0;
+	struct rte_mbuf *prebuilt_pkts[MAX_RING_BURST];
+	struct rte_mbuf **new_pkts;
 	uint8_t *pkt_hdr[MAX_RING_BURST];
 
-	task_gen_load_and_prefetch(new_pkts, pkt_hdr, send_bulk);
-	task_gen_build_packets(task, new_pkts, pkt_hdr, send_bulk);
-	task_gen_apply_all_random_fields(task, pkt_hdr, send_bulk);
-	task_gen_apply_all_accur_pos(task, new_pkts, pkt_hdr, send_bulk);
-	task_gen_apply_all_sig(task, new_pkts, pkt_hdr, send_bulk);
-	task_gen_apply_all_unique_id(task, new_pkts, pkt_hdr, send_bulk);
+	if (task_gen_use_prebuilt(task) && task_gen_take_prebuilt(task, prebuilt_pkts, send_bulk) == 0) {
+		new_pkts = prebuilt_pkts;
+		task_gen_load_and_prefetch(new_pkts, pkt_hdr, send_bulk);
+		task_gen_patch_prebuilt(task, new_pkts, pkt_hdr, send_bulk);
+	} else {
+		new_pkts = local_mbuf_refill_and_take(&task->local_mbuf, send_bulk);
+		if (new_pkts == NULL)
+			return 0;
+		task_gen_load_and_prefetch(new_pkts, pkt_hdr, send_bulk);
+		task_gen_build_packets(task, new_pkts, pkt_hdr, send_bulk);
+	}
 
 	uint64_t tsc_before_tx;
 
@@ -899,6 +1042,7 @@ static void task_gen_pkt_template_recalc_all(struct task_gen *task)
 	task_gen_pkt_template_set_ip(task);
 	task_gen_pkt_template_recalc_metadata(task);
 	task_gen_pkt_template_recalc_checksum(task);
+	task->pkt_template_gen++;
 }
 
 static void task_gen_reset_pkt_templates_len(struct task_gen *task)
@@ -995,6 +1139,36 @@ static struct rte_mempool *task_gen_create_mempool(struct task_args *targ)
 	return ret;
 }
 
+static void task_gen_init_prebuilt(struct task_gen *task, struct task_args *targ)
+{
+	static char name[] = "gen_prebuilt_pool";
+	const int sock_id = rte_lcore_to_socket_id(targ->lconf->id);
+	struct rte_mempool *mempool;
+
+	task->n_prebuilt_copies = (GEN_PREBUILT_MIN_MBUFS + task->n_pkts - 1) / task->n_pkts;
+	task->n_prebuilt = task->n_prebuilt_copies * task->n_pkts;
+
+	name[0]++;
+	mempool = rte_mempool_create(name, task->n_prebuilt, MBUF_SIZE,
+				     0, sizeof(struct rte_pktmbuf_pool_private),
+				     rte_pktmbuf_pool_init, NULL, rte_pktmbuf_init, 0,
+				     sock_id, 0);
+	PROX_PANIC(mempool == NULL, "Failed to allocate pre-built mbuf pool on socket %u with %u elements\n",
+		   sock_id, task->n_prebuilt);
+
+	task->prebuilt = prox_zmalloc(task->n_prebuilt * sizeof(task->prebuilt[0]), sock_id);
+	task->prebuilt_gen = prox_zmalloc(task->n_prebuilt * sizeof(task->prebuilt_gen[0]), sock_id);
+	PROX_PANIC(task->prebuilt == NULL || task->prebuilt_gen == NULL, "Failed to allocate pre-built mbuf array\n");
+
+	for (uint32_t k = 0; k < task->n_prebuilt; ++k) {
+		task->prebuilt[k] = rte_pktmbuf_alloc(mempool);
+		PROX_PANIC(task->prebuilt[k] == NULL, "Failed to allocate pre-built mbuf %u\n", k);
+		task_gen_prebuild_one(task, k);
+	}
+	task->prebuilt_copy = 0;
+	plog_info("\tUsing %u pre-built mbufs (%u copies of %u templates)\n", task->n_prebuilt, task->n_prebuilt_copies, task->n_pkts);
+}
+
 void task_gen_set_pkt_count(struct task_base *tbase, uint32_t count)
 {
 	struct task_gen *task = (struct task_gen *)tbase;
@@ -1008,12 +1182,31 @@ int task_gen_set_pkt_size(struct task_base *tbase, uint32_t pkt_size)
 	int rc;
 
 	task->pkt_template[0].len = pkt_size;
+	task->pkt_template_gen++;
 	if ((rc = check_all_pkt_size(task, 0)) != 0)
 		return rc;
 	check_fields_in_bounds(task);
 	return rc;
 }
 
+int task_gen_check_pkt_size(struct task_base *tbase, uint32_t pkt_size)
+{
+	struct task_gen *task = (struct task_gen *)tbase;
+
+	return check_pkt_size(task, pkt_size, 0);
+}
+
+void task_gen_msg_set_pkt_size(struct task_base *tbase, uint64_t pkt_size)
+{
+	if (task_gen_set_pkt_size(tbase, pkt_size))
+		plog_err("Failed to set packet size to %"PRIu64"\n", pkt_size);
+}
+
+void task_gen_msg_set_pkt_count(struct task_base *tbase, uint64_t count)
+{
+	task_gen_set_pkt_count(tbase, count);
+}
+
 void task_gen_set_rate(struct task_base *tbase, uint64_t bps)
 {
 	struct task_gen *task = (struct task_gen *)tbase;
@@ -1054,6 +1247,7 @@ void task_gen_reset_values(struct task_base *tbase)
 	struct task_gen *task = (struct task_gen *)tbase;
 
 	task_gen_reset_pkt_templates_content(task);
+	task->pkt_template_gen++;
 }
 
 uint32_t task_gen_get_n_randoms(struct task_base *tbase)
@@ -1205,6 +1399,7 @@ static void init_task_gen(struct task_base *tbase, struct task_args *targ)
 	task->sig_pos = targ->sig_pos;
 	task->sig = targ->sig;
 	task->new_rate_bps = targ->rate_bps;
+	task_gen_select_copy_template(task, targ->template_copy);
 
 	struct token_time_cfg tt_cfg = token_time_cfg_create(1250000000, rte_get_tsc_hz(), -1);
 
@@ -1254,6 +1449,19 @@ static void init_task_gen(struct task_base *tbase, struct task_args *targ)
 	if (port) {
 		task->cksum_offload = port->capabilities.tx_offload_cksum;
 	}
+
+	if (targ->flags & TASK_ARG_PREBUILT_MBUFS) {
+		/* In l3 mode, packets can be handed over to the master
+		   which can reuse the mbuf. */
+		if (tbase->l3.tmaster)
+			plog_warn("\tPre-built mbufs not supported in l3 mode, building packets at runtime\n");
+		/* Tasks receiving from a ring modify the packets in place,
+		   which would corrupt the shared pre-built mbufs. */
+		else if (!targ->nb_txports || targ->nb_txrings)
+			plog_warn("\tPre-built mbufs only supported when transmitting to ports, building packets at runtime\n");
+		else
+			task_gen_init_prebuilt(task, targ);
+	}
 }
 
 static struct task_init task_init_gen = {
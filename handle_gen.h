@@ -55,6 +55,10 @@ struct task_base;
 void task_gen_set_pkt_count(struct task_base *tbase, uint32_t count);
 int task_gen_set_pkt_size(struct task_base *tbase, uint32_t pkt_size);
 void task_gen_set_rate(struct task_base *tbase, uint64_t bps);
+int task_gen_check_pkt_size(struct task_base *tbase, uint32_t pkt_size);
+/* Same as above, to be passed to cmd_task_set() */
+void task_gen_msg_set_pkt_size(struct task_base *tbase, uint64_t pkt_size);
+void task_gen_msg_set_pkt_count(struct task_base *tbase, uint64_t count);
 void task_gen_reset_randoms(struct task_base *tbase);
 void task_gen_reset_values(struct task_base *tbase);
 int task_gen_set_value(struct task_base *tbase, uint32_t value, uint32_t offset, uint32_t len);
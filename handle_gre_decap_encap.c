@@ -79,6 +79,7 @@ struct task_gre_decap {
 	const void* key_ptr[16];
 	struct cpe_gre_key key[16];
 	uint64_t           cpe_timeout;
+	uint64_t           expire_period;
 #ifdef GRE_TP
 	double cycles_per_byte;
 	uint32_t tb_size;
@@ -92,7 +93,7 @@ static inline uint8_t handle_gre_encap(struct task_gre_decap *task, struct rte_m
 static inline void handle_gre_encap16(struct task_gre_decap *task, struct rte_mbuf **mbufs, uint16_t n_pkts, uint8_t *out);
 static inline uint8_t handle_gre_decap(struct task_gre_decap *tbase, struct rte_mbuf *mbuf);
 
-void update_arp_entries_gre(void *data);
+static uint64_t update_arp_entries_gre(struct lcore_cfg *lconf, void *data);
 
 static void init_cpe_gre_hash(struct task_args *targ)
 {
@@ -151,9 +152,8 @@ static void init_task_gre_decap(struct task_base *tbase, struct task_args *targ)
 	task->lconf = targ->lconf;
 	task->cpe_timeout = msec_to_tsc(targ->cpe_table_timeout_ms);
 
-	targ->lconf->period_func = update_arp_entries_gre;
-	targ->lconf->period_data = tbase;
-	targ->lconf->period_timeout = msec_to_tsc(500) / NUM_VCPES;
+	task->expire_period = msec_to_tsc(500) / NUM_VCPES;
+	lconf_add_tsc_task(targ->lconf, update_arp_entries_gre, task, task->expire_period);
 
 	for (uint8_t i = 0; i < 16; ++i) {
 		task->key_ptr[i] = &task->key[i];
@@ -449,7 +449,7 @@ static inline uint8_t handle_gre_encap(struct task_gre_decap *task, struct rte_m
 	return 0;
 }
 
-void update_arp_entries_gre(void *data)
+static uint64_t update_arp_entries_gre(struct lcore_cfg *lconf, void *data)
 {
 	uint64_t cur_tsc = rte_rdtsc();
 	struct task_gre_decap *task = (struct task_gre_decap *)data;
@@ -475,4 +475,5 @@ void update_arp_entries_gre(void *data)
 	++task->bucket_index;
 	task->bucket_index &= task->cpe_gre_hash->bucket_bitmask;
 #endif
+	return task->expire_period;
 }
@@ -32,6 +32,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <math.h>
 #include <rte_cycles.h>
 #include <rte_version.h>
 
@@ -42,40 +43,61 @@
 #include "handle_impair.h"
 #include "prefetch.h"
 #include "prox_port_cfg.h"
+#include "clock.h"
+#include "cdf.h"
 
 #if RTE_VERSION < RTE_VERSION_NUM(1,8,0,0)
 #define RTE_CACHE_LINE_SIZE CACHE_LINE_SIZE
 #endif
 
 #define DELAY_ACCURACY	11		// accuracy of 2048 cycles ~= 1 micro-second
-#define DELAY_MAX_MASK	0x1FFFFF	// Maximum 2M * 2K cycles ~1 second
-
-struct queue_elem {
+#define IMPAIR_MAX_SLOTS	(1 << 18)	// Slots are made wider for longer delays
+#define IMPAIR_MAX_ELEMS	(1 << 24)	// Maximum number of packets being delayed
+#define IMPAIR_DELAY_TABLE_SIZE	(1 << 16)	// Samples of the normal and pareto distributions
+#define IMPAIR_NO_ELEM		UINT32_MAX
+
+/* Packets are delayed in a calendar queue: each packet is appended to
+   the slot corresponding to the time at which it must be sent. Slots
+   are drained in order as time passes. The wheel can be smaller than
+   the maximum delay, in which case a slot holds packets for different
+   rounds and only the ones that are due are taken out. Elements come
+   from a single pool, so the memory used does not depend on how the
+   delays are spread. */
+struct impair_elem {
 	struct rte_mbuf *mbuf;
-	uint64_t        tsc;
+	uint32_t        slot;	/* absolute slot at which the packet is due */
+	uint32_t        next;
 };
 
-struct queue {
-	struct queue_elem *queue_elem;
-	unsigned queue_head;
-	unsigned queue_tail;
+struct impair_slot {
+	uint32_t head;
+	uint32_t tail;
 };
 
 struct task_impair {
 	struct task_base base;
-	struct queue_elem *queue;
+	struct impair_slot *slots;
+	struct impair_elem *elems;
+	uint32_t slot_mask;
+	uint32_t slot_shift;
+	uint32_t cur_slot;	/* next slot to drain */
+	uint32_t free_head;
+	uint32_t n_queued;
+	uint32_t n_elems;
+	enum delay_distr delay_distr;
 	uint32_t random_delay_us;
 	uint32_t delay_us;
 	uint64_t delay_time;
+	uint64_t random_delay_time;
 	uint64_t delay_time_mask;
-	unsigned queue_head;
-	unsigned queue_tail;
-	unsigned queue_mask;
+	uint64_t max_delay_time;
+	uint64_t *delay_table;	/* normal and pareto: delays in tsc */
+	struct cdf *cdf;
+	uint64_t *cdf_delay;	/* cdf: delay in tsc of each entry of the cdf */
+	uint32_t n_cdf;
 	int tresh;
 	unsigned int seed;
 	struct random state;
-	uint64_t last_idx;
-	struct queue *buffer;
 	uint32_t socket_id;
 	uint32_t flags;
 	uint8_t src_mac[6];
@@ -85,7 +107,6 @@ struct task_impair {
 #define IMPAIR_SET_MAC         2
 
 static int handle_bulk_impair(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
-static int handle_bulk_impair_random(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
 static int handle_bulk_random_drop(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
 
 void task_impair_set_proba(struct task_base *tbase, float proba)
@@ -102,106 +123,285 @@ void task_impair_set_delay_us(struct task_base *tbase, uint32_t delay_us, uint32
 	task->delay_us = delay_us;
 }
 
-static void task_impair_update(struct task_base *tbase)
+/*
+ * We want to avoid using division and mod for performance reasons.
+ * We also want to support up to one second delay, and express it in tsc
+ * So the delay in tsc needs up to 32 bits (supposing procesor freq is less than 4GHz).
+ * If the max_delay is smaller, we make sure we use less bits.
+ * Note that we lose the MSB of the xorshift - 64 bits could hold
+ * two or three delays in TSC - but would probably make implementation more complex
+ * and not huge gain expected. Maybe room for optimization.
+ * Using this implementation, we might have to run random more than once for a delay
+ * but in average this should occur less than 50% of the time.
+*/
+
+static inline uint64_t random_delay(struct random *state, uint64_t max_delay, uint64_t max_delay_mask)
 {
-	struct task_impair *task = (struct task_impair *)tbase;
-	uint32_t queue_len = 0;
-	size_t mem_size;
-	if ((task->flags & IMPAIR_NEED_UPDATE) == 0)
-		return;
-	task->flags &= ~IMPAIR_NEED_UPDATE;
-	uint64_t now = rte_rdtsc();
-	uint8_t out[MAX_PKT_BURST] = {0};
-	uint64_t now_idx = (now >> DELAY_ACCURACY) & DELAY_MAX_MASK;
-
-	if (task->random_delay_us) {
-		tbase->handle_bulk = handle_bulk_impair_random;
-		task->delay_time = usec_to_tsc(task->random_delay_us);
-		task->delay_time_mask = rte_align32pow2(task->delay_time) - 1;
-		queue_len = rte_align32pow2((1250L * task->random_delay_us) / 84 / (DELAY_MAX_MASK + 1));
-	} else if (task->delay_us == 0) {
-		tbase->handle_bulk = handle_bulk_random_drop;
-		task->delay_time = 0;
-	} else {
-		tbase->handle_bulk = handle_bulk_impair;
-		task->delay_time = usec_to_tsc(task->delay_us);
-		queue_len = rte_align32pow2(1250 * task->delay_us / 84);
+	uint64_t val;
+	while(1) {
+		val = random_next(state);
+		if ((val & max_delay_mask) < max_delay)
+			return (val & max_delay_mask);
 	}
-	if (task->queue) {
-		struct rte_mbuf *new_mbufs[MAX_PKT_BURST];
-		while (task->queue_tail != task->queue_head) {
-			now = rte_rdtsc();
-			uint16_t idx = 0;
-			while (idx < MAX_PKT_BURST && task->queue_tail != task->queue_head) {
-				if (task->queue[task->queue_tail].tsc <= now) {
-					out[idx] = rand_r(&task->seed) <= task->tresh? 0 : OUT_DISCARD;
-					new_mbufs[idx++] = task->queue[task->queue_tail].mbuf;
-					task->queue_tail = (task->queue_tail + 1) & task->queue_mask;
-				}
-				else {
-					break;
-				}
+}
+
+static inline uint64_t impair_delay(struct task_impair *task)
+{
+	switch (task->delay_distr) {
+	case DELAY_DISTR_UNIFORM:
+		if (task->random_delay_time)
+			return task->delay_time + random_delay(&task->state, task->random_delay_time, task->delay_time_mask);
+		return task->delay_time;
+	case DELAY_DISTR_CDF:
+		return task->delay_time + task->cdf_delay[cdf_sample(task->cdf)];
+	default:
+		return task->delay_table[random_next(&task->state) & (IMPAIR_DELAY_TABLE_SIZE - 1)];
+	}
+}
+
+static inline int impair_enqueue(struct task_impair *task, struct rte_mbuf *mbuf, uint64_t now)
+{
+	const uint32_t e = task->free_head;
+
+	if (unlikely(e == IMPAIR_NO_ELEM))
+		return -1;
+
+	struct impair_elem *elem = &task->elems[e];
+	uint32_t slot = (now + impair_delay(task)) >> task->slot_shift;
+
+	/* The current slot might already have been drained */
+	if ((int32_t)(slot - task->cur_slot) < 0)
+		slot = task->cur_slot;
+
+	task->free_head = elem->next;
+	elem->mbuf = mbuf;
+	elem->slot = slot;
+	elem->next = IMPAIR_NO_ELEM;
+
+	struct impair_slot *s = &task->slots[slot & task->slot_mask];
+
+	if (s->head == IMPAIR_NO_ELEM)
+		s->head = e;
+	else
+		task->elems[s->tail].next = e;
+	s->tail = e;
+	task->n_queued++;
+	return 0;
+}
+
+/* Take up to MAX_PKT_BURST packets that are due at now. Packets due
+   in the same slot are returned in the order they were received. */
+static uint16_t impair_dequeue(struct task_impair *task, struct rte_mbuf **mbufs, uint64_t now)
+{
+	const uint32_t now_slot = now >> task->slot_shift;
+	uint16_t n = 0;
+
+	while (task->n_queued && (int32_t)(now_slot - task->cur_slot) >= 0) {
+		struct impair_slot *s = &task->slots[task->cur_slot & task->slot_mask];
+		uint32_t prev = IMPAIR_NO_ELEM;
+		uint32_t e = s->head;
+
+		while (e != IMPAIR_NO_ELEM) {
+			struct impair_elem *elem = &task->elems[e];
+			const uint32_t next = elem->next;
+
+			if ((int32_t)(elem->slot - task->cur_slot) <= 0) {
+				/* Continue with this slot next time */
+				if (n == MAX_PKT_BURST)
+					return n;
+				mbufs[n] = elem->mbuf;
+				PREFETCH0(mbufs[n]);
+				PREFETCH0(&mbufs[n]->cacheline1);
+				n++;
+
+				if (prev == IMPAIR_NO_ELEM)
+					s->head = next;
+				else
+					task->elems[prev].next = next;
+				if (s->tail == e)
+					s->tail = prev;
+				elem->next = task->free_head;
+				task->free_head = e;
+				task->n_queued--;
+			} else {
+				prev = e;
 			}
-			if (idx)
-				task->base.tx_pkt(&task->base, new_mbufs, idx, out);
+			e = next;
 		}
-		prox_free(task->queue);
-		task->queue = NULL;
+		task->cur_slot++;
 	}
-	if (task->buffer) {
-		struct rte_mbuf *new_mbufs[MAX_PKT_BURST];
-		while (task->last_idx != ((now_idx - 1) & DELAY_MAX_MASK)) {
-			now = rte_rdtsc();
-			uint16_t pkt_idx = 0;
-			while ((pkt_idx < MAX_PKT_BURST) && (task->last_idx != ((now_idx - 1) & DELAY_MAX_MASK))) {
-				struct queue *queue = &task->buffer[task->last_idx];
-				while ((pkt_idx < MAX_PKT_BURST) && (queue->queue_tail != queue->queue_head)) {
-					out[pkt_idx] = rand_r(&task->seed) <= task->tresh? 0 : OUT_DISCARD;
-					new_mbufs[pkt_idx++] = queue->queue_elem[queue->queue_tail].mbuf;
-					queue->queue_tail = (queue->queue_tail + 1) & task->queue_mask;
-				}
-				task->last_idx = (task->last_idx + 1) & DELAY_MAX_MASK;
-			}
+	if (task->n_queued == 0)
+		task->cur_slot = now_slot;
+	return n;
+}
 
-			if (pkt_idx)
-				task->base.tx_pkt(&task->base, new_mbufs, pkt_idx, out);
+static void impair_build_delay_table(struct task_impair *task)
+{
+	/* Pareto distribution with shape 3 and scale 1,
+	   standardized using its mean and standard deviation */
+	const double pareto_mean = 1.5;
+	const double pareto_stddev = sqrt(3) / 2;
+	double z, u1, u2, d;
+
+	for (uint32_t i = 0; i < IMPAIR_DELAY_TABLE_SIZE; ++i) {
+		if (task->delay_distr == DELAY_DISTR_NORMAL) {
+			/* Box-Muller */
+			u1 = (rand_r(&task->seed) + 1.0) / (RAND_MAX + 2.0);
+			u2 = (rand_r(&task->seed) + 1.0) / (RAND_MAX + 2.0);
+			z = sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+		} else {
+			u1 = (i + 0.5) / IMPAIR_DELAY_TABLE_SIZE;
+			z = (pow(1 - u1, -1.0 / 3) - pareto_mean) / pareto_stddev;
 		}
-		for (int i = 0; i < DELAY_MAX_MASK + 1; i++) {
-			if (task->buffer[i].queue_elem)
-				prox_free(task->buffer[i].queue_elem);
+		d = task->delay_time + z * task->random_delay_time;
+		task->delay_table[i] = d < 0 ? 0 : (uint64_t)d;
+	}
+}
+
+static void impair_load_cdf(struct task_impair *task, const char *file_name)
+{
+	char line[256];
+	uint32_t delay_us, weight, n_vals = 0;
+	FILE *f = fopen(file_name, "r");
+
+	PROX_PANIC(f == NULL, "Failed to open delay cdf file %s\n", file_name);
+
+	/* Each line holds a delay in usec and its weight */
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%u %u", &delay_us, &weight) == 2 && weight)
+			n_vals++;
+	}
+	PROX_PANIC(n_vals == 0, "No entries found in delay cdf file %s\n", file_name);
+
+	task->cdf = cdf_create(n_vals, task->socket_id);
+	PROX_PANIC(task->cdf == NULL, "Failed to create cdf with %u entries\n", n_vals);
+	task->cdf_delay = prox_zmalloc(n_vals * sizeof(task->cdf_delay[0]), task->socket_id);
+	PROX_PANIC(task->cdf_delay == NULL, "Not enough memory to allocate cdf\n");
+
+	uint32_t i = 0;
+
+	rewind(f);
+	while (i < n_vals && fgets(line, sizeof(line), f) != NULL) {
+		if (sscanf(line, "%u %u", &delay_us, &weight) == 2 && weight) {
+			cdf_add(task->cdf, weight);
+			task->cdf_delay[i++] = usec_to_tsc(delay_us);
 		}
-		prox_free(task->buffer);
-		task->buffer = NULL;
 	}
+	fclose(f);
+	task->n_cdf = n_vals;
+	PROX_PANIC(cdf_setup(task->cdf), "Failed to setup cdf from %s\n", file_name);
+	plog_info("\tLoaded %u delays from %s\n", n_vals, file_name);
+}
 
-	if (queue_len < MAX_PKT_BURST)
-		queue_len= MAX_PKT_BURST;
-	task->queue_mask = queue_len - 1;
-	if (task->queue_mask < MAX_PKT_BURST - 1)
-		task->queue_mask = MAX_PKT_BURST - 1;
-	mem_size = (task->queue_mask + 1) * sizeof(task->queue[0]);
-
-	if (task->delay_us) {
-		task->queue_head = 0;
-		task->queue_tail = 0;
-		task->queue = prox_zmalloc(mem_size, task->socket_id);
-		if (task->queue == NULL) {
-			plog_err("Not enough memory to allocate queue\n");
-			task->queue_mask = 0;
+static uint64_t impair_max_delay(struct task_impair *task)
+{
+	uint64_t max = task->delay_time;
+
+	switch (task->delay_distr) {
+	case DELAY_DISTR_UNIFORM:
+		max += task->random_delay_time;
+		break;
+	case DELAY_DISTR_CDF:
+		for (uint32_t i = 0; i < task->n_cdf; ++i) {
+			if (task->delay_time + task->cdf_delay[i] > max)
+				max = task->delay_time + task->cdf_delay[i];
 		}
-	} else if (task->random_delay_us) {
-		size_t size = (DELAY_MAX_MASK + 1) * sizeof(struct queue);
-		plog_info("Allocating %zd bytes\n", size);
-		task->buffer = prox_zmalloc(size, task->socket_id);
-		PROX_PANIC(task->buffer == NULL, "Not enough memory to allocate buffer\n");
-		plog_info("Allocating %d x %zd bytes\n", DELAY_MAX_MASK + 1, mem_size);
-
-		for (int i = 0; i < DELAY_MAX_MASK + 1; i++) {
-			task->buffer[i].queue_elem = prox_zmalloc(mem_size, task->socket_id);
-			PROX_PANIC(task->buffer[i].queue_elem == NULL, "Not enough memory to allocate buffer elems\n");
+		break;
+	default:
+		for (uint32_t i = 0; i < IMPAIR_DELAY_TABLE_SIZE; ++i) {
+			if (task->delay_table[i] > max)
+				max = task->delay_table[i];
 		}
+		break;
 	}
+	return max;
+}
+
+static void task_impair_setup(struct task_impair *task)
+{
+	struct task_base *tbase = (struct task_base *)task;
+
+	task->delay_time = usec_to_tsc(task->delay_us);
+	task->random_delay_time = usec_to_tsc(task->random_delay_us);
+	task->delay_time_mask = rte_align32pow2(task->random_delay_time) - 1;
 	random_init_seed(&task->state);
+
+	if (task->delay_distr == DELAY_DISTR_NORMAL || task->delay_distr == DELAY_DISTR_PARETO) {
+		if (task->delay_table == NULL) {
+			task->delay_table = prox_zmalloc(IMPAIR_DELAY_TABLE_SIZE * sizeof(task->delay_table[0]), task->socket_id);
+			PROX_PANIC(task->delay_table == NULL, "Not enough memory to allocate delay table\n");
+		}
+		impair_build_delay_table(task);
+	}
+
+	task->max_delay_time = impair_max_delay(task);
+	if (task->max_delay_time == 0) {
+		tbase->handle_bulk = handle_bulk_random_drop;
+		return;
+	}
+	tbase->handle_bulk = handle_bulk_impair;
+
+	/* Make the slots wider until the wheel covers the maximum delay */
+	task->slot_shift = DELAY_ACCURACY;
+	while ((task->max_delay_time >> task->slot_shift) + 1 >= IMPAIR_MAX_SLOTS)
+		task->slot_shift++;
+	uint32_t n_slots = rte_align32pow2((task->max_delay_time >> task->slot_shift) + 2);
+
+	/* Assume Line-rate is maximum transmit speed.
+	   TODO: take link speed if tx is port.
+	*/
+	uint64_t n_elems = 1250 * tsc_to_usec(task->max_delay_time) / 84;
+
+	if (n_elems < MAX_PKT_BURST)
+		n_elems = MAX_PKT_BURST;
+	if (n_elems > IMPAIR_MAX_ELEMS)
+		n_elems = IMPAIR_MAX_ELEMS;
+	task->n_elems = n_elems;
+
+	plog_info("\tDelay line with %u slots of %u cycles and %u packets\n", n_slots, 1 << task->slot_shift, task->n_elems);
+	task->slots = prox_zmalloc(n_slots * sizeof(task->slots[0]), task->socket_id);
+	PROX_PANIC(task->slots == NULL, "Not enough memory to allocate delay slots\n");
+	task->elems = prox_zmalloc(task->n_elems * sizeof(task->elems[0]), task->socket_id);
+	PROX_PANIC(task->elems == NULL, "Not enough memory to allocate delay queue\n");
+
+	task->slot_mask = n_slots - 1;
+	for (uint32_t i = 0; i < n_slots; ++i) {
+		task->slots[i].head = IMPAIR_NO_ELEM;
+		task->slots[i].tail = IMPAIR_NO_ELEM;
+	}
+	for (uint32_t i = 0; i < task->n_elems; ++i)
+		task->elems[i].next = i + 1 < task->n_elems ? i + 1 : IMPAIR_NO_ELEM;
+	task->free_head = 0;
+	task->n_queued = 0;
+	task->cur_slot = rte_rdtsc() >> task->slot_shift;
+}
+
+static void task_impair_update(struct task_base *tbase)
+{
+	struct task_impair *task = (struct task_impair *)tbase;
+	uint8_t out[MAX_PKT_BURST] = {0};
+	struct rte_mbuf *new_mbufs[MAX_PKT_BURST];
+
+	if ((task->flags & IMPAIR_NEED_UPDATE) == 0)
+		return;
+	task->flags &= ~IMPAIR_NEED_UPDATE;
+
+	if (task->slots) {
+		/* Send out all delayed packets before changing the delay */
+		while (task->n_queued) {
+			uint16_t idx = impair_dequeue(task, new_mbufs, rte_rdtsc());
+
+			for (uint16_t i = 0; i < idx; ++i)
+				out[i] = rand_r(&task->seed) <= task->tresh? 0 : OUT_DISCARD;
+			if (idx)
+				task->base.tx_pkt(&task->base, new_mbufs, idx, out);
+		}
+		prox_free(task->slots);
+		prox_free(task->elems);
+		task->slots = NULL;
+		task->elems = NULL;
+	}
+	task_impair_setup(task);
 }
 
 static int handle_bulk_random_drop(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
@@ -209,6 +409,8 @@ static int handle_bulk_random_drop(struct task_base *tbase, struct rte_mbuf **mb
 	struct task_impair *task = (struct task_impair *)tbase;
 	uint8_t out[MAX_PKT_BURST];
 	struct ether_hdr * hdr[MAX_PKT_BURST];
+	int ret;
+
 	for (uint16_t i = 0; i < n_pkts; ++i) {
 		PREFETCH0(mbufs[i]);
 	}
@@ -226,17 +428,18 @@ static int handle_bulk_random_drop(struct task_base *tbase, struct rte_mbuf **mb
 			out[i] = rand_r(&task->seed) <= task->tresh? 0 : OUT_DISCARD;
 		}
 	}
-	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
+	ret = task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 	task_impair_update(tbase);
+	return ret;
 }
 
 static int handle_bulk_impair(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_impair *task = (struct task_impair *)tbase;
 	uint64_t now = rte_rdtsc();
-	uint8_t out[MAX_PKT_BURST] = {0};
-	uint16_t enqueue_failed;
-	uint16_t i;
+	uint8_t out[MAX_PKT_BURST];
+	struct rte_mbuf *drop_mbufs[MAX_PKT_BURST];
+	uint16_t n_drop = 0;
 	int ret = 0;
 	struct ether_hdr * hdr[MAX_PKT_BURST];
 	for (uint16_t i = 0; i < n_pkts; ++i) {
@@ -247,69 +450,26 @@ static int handle_bulk_impair(struct task_base *tbase, struct rte_mbuf **mbufs,
 		PREFETCH0(hdr[i]);
 	}
 
-	int nb_empty_slots = (task->queue_tail - task->queue_head + task->queue_mask) & task->queue_mask;
-	if (likely(nb_empty_slots >= n_pkts)) {
-		/* We know n_pkts fits, no need to check for every packet */
-		for (i = 0; i < n_pkts; ++i) {
-			if (task->flags & IMPAIR_SET_MAC)
-				ether_addr_copy((struct ether_addr *)&task->src_mac[0], &hdr[i]->s_addr);
-			task->queue[task->queue_head].tsc = now + task->delay_time;
-			task->queue[task->queue_head].mbuf = mbufs[i];
-			task->queue_head = (task->queue_head + 1) & task->queue_mask;
-		}
-	} else {
-		for (i = 0; i < n_pkts; ++i) {
-			if (((task->queue_head + 1) & task->queue_mask) != task->queue_tail) {
-				if (task->flags & IMPAIR_SET_MAC)
-					ether_addr_copy((struct ether_addr *)&task->src_mac[0], &hdr[i]->s_addr);
-				task->queue[task->queue_head].tsc = now + task->delay_time;
-				task->queue[task->queue_head].mbuf = mbufs[i];
-				task->queue_head = (task->queue_head + 1) & task->queue_mask;
-			}
-			else {
-				/* Rest does not fit, need to drop those packets. */
-				enqueue_failed = i;
-				for (;i < n_pkts; ++i) {
-					out[i] = OUT_DISCARD;
-				}
-				ret+= task->base.tx_pkt(&task->base, mbufs + enqueue_failed,
-					  	n_pkts - enqueue_failed, out + enqueue_failed);
-				break;
-			}
+	for (uint16_t i = 0; i < n_pkts; ++i) {
+		if (task->flags & IMPAIR_SET_MAC)
+			ether_addr_copy((struct ether_addr *)&task->src_mac[0], &hdr[i]->s_addr);
+		if (impair_enqueue(task, mbufs[i], now)) {
+			/* All elements in use, need to drop packet. */
+			out[n_drop] = OUT_DISCARD;
+			drop_mbufs[n_drop++] = mbufs[i];
 		}
 	}
+	if (n_drop)
+		ret+= task->base.tx_pkt(&task->base, drop_mbufs, n_drop, out);
 
 	struct rte_mbuf *new_mbufs[MAX_PKT_BURST];
-	uint16_t idx = 0;
+	uint16_t idx = impair_dequeue(task, new_mbufs, now);
 
 	if (task->tresh != RAND_MAX) {
-		while (idx < MAX_PKT_BURST && task->queue_tail != task->queue_head) {
-			if (task->queue[task->queue_tail].tsc <= now) {
-				out[idx] = rand_r(&task->seed) <= task->tresh? 0 : OUT_DISCARD;
-				new_mbufs[idx] = task->queue[task->queue_tail].mbuf;
-				PREFETCH0(new_mbufs[idx]);
-				PREFETCH0(&new_mbufs[idx]->cacheline1);
-				idx++;
-				task->queue_tail = (task->queue_tail + 1) & task->queue_mask;
-			}
-			else {
-				break;
-			}
-		}
+		for (uint16_t i = 0; i < idx; ++i)
+			out[i] = rand_r(&task->seed) <= task->tresh? 0 : OUT_DISCARD;
 	} else {
-		while (idx < MAX_PKT_BURST && task->queue_tail != task->queue_head) {
-			if (task->queue[task->queue_tail].tsc <= now) {
-				out[idx] = 0;
-				new_mbufs[idx] = task->queue[task->queue_tail].mbuf;
-				PREFETCH0(new_mbufs[idx]);
-				PREFETCH0(&new_mbufs[idx]->cacheline1);
-				idx++;
-				task->queue_tail = (task->queue_tail + 1) & task->queue_mask;
-			}
-			else {
-				break;
-			}
-		}
+		memset(out, 0, idx);
 	}
 
 	if (idx)
@@ -318,151 +478,25 @@ static int handle_bulk_impair(struct task_base *tbase, struct rte_mbuf **mbufs,
 	return ret;
 }
 
-/*
- * We want to avoid using division and mod for performance reasons.
- * We also want to support up to one second delay, and express it in tsc
- * So the delay in tsc needs up to 32 bits (supposing procesor freq is less than 4GHz).
- * If the max_delay is smaller, we make sure we use less bits.
- * Note that we lose the MSB of the xorshift - 64 bits could hold
- * two or three delays in TSC - but would probably make implementation more complex
- * and not huge gain expected. Maybe room for optimization.
- * Using this implementation, we might have to run random more than once for a delay
- * but in average this should occur less than 50% of the time.
-*/
-
-static inline uint64_t random_delay(struct random *state, uint64_t max_delay, uint64_t max_delay_mask)
-{
-	uint64_t val;
-	while(1) {
-		val = random_next(state);
-		if ((val & max_delay_mask) < max_delay)
-			return (val & max_delay_mask);
-	}
-}
-
-static int handle_bulk_impair_random(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
-{
-	struct task_impair *task = (struct task_impair *)tbase;
-	uint64_t now = rte_rdtsc();
-	uint8_t out[MAX_PKT_BURST];
-	uint16_t enqueue_failed;
-	uint16_t i;
-	int ret = 0;
-	uint64_t packet_time, idx;
-	uint64_t now_idx = (now >> DELAY_ACCURACY) & DELAY_MAX_MASK;
-	struct ether_hdr * hdr[MAX_PKT_BURST];
-	for (uint16_t i = 0; i < n_pkts; ++i) {
-		PREFETCH0(mbufs[i]);
-	}
-	for (uint16_t i = 0; i < n_pkts; ++i) {
-		hdr[i] = rte_pktmbuf_mtod(mbufs[i], struct ether_hdr *);
-		PREFETCH0(hdr[i]);
-	}
-
-	for (i = 0; i < n_pkts; ++i) {
-		packet_time = now + random_delay(&task->state, task->delay_time, task->delay_time_mask);
-		idx = (packet_time >> DELAY_ACCURACY) & DELAY_MAX_MASK;
-		while (idx != ((now_idx - 1) & DELAY_MAX_MASK)) {
-			struct queue *queue = &task->buffer[idx];
-			if (((queue->queue_head + 1) & task->queue_mask) != queue->queue_tail) {
-				if (task->flags & IMPAIR_SET_MAC)
-					ether_addr_copy((struct ether_addr *)&task->src_mac[0], &hdr[i]->s_addr);
-				queue->queue_elem[queue->queue_head].mbuf = mbufs[i];
-				queue->queue_head = (queue->queue_head + 1) & task->queue_mask;
-				break;
-			} else {
-				idx = (idx + 1) & DELAY_MAX_MASK;
-			}
-		}
-		if (idx == ((now_idx - 1) & DELAY_MAX_MASK)) {
-			/* Rest does not fit, need to drop packet. Note that further packets might fit as might want to be sent earlier */
-			out[0] = OUT_DISCARD;
-			ret+= task->base.tx_pkt(&task->base, mbufs + i, 1, out);
-			plog_warn("Unexpectdly dropping packets\n");
-		}
-	}
-
-	struct rte_mbuf *new_mbufs[MAX_PKT_BURST];
-	uint16_t pkt_idx = 0;
-
-	while ((pkt_idx < MAX_PKT_BURST) && (task->last_idx != ((now_idx - 1) & DELAY_MAX_MASK))) {
-		struct queue *queue = &task->buffer[task->last_idx];
-		while ((pkt_idx < MAX_PKT_BURST) && (queue->queue_tail != queue->queue_head)) {
-			out[pkt_idx] = rand_r(&task->seed) <= task->tresh? 0 : OUT_DISCARD;
-			new_mbufs[pkt_idx] = queue->queue_elem[queue->queue_tail].mbuf;
-			PREFETCH0(new_mbufs[pkt_idx]);
-			PREFETCH0(&new_mbufs[pkt_idx]->cacheline1);
-			pkt_idx++;
-			queue->queue_tail = (queue->queue_tail + 1) & task->queue_mask;
-		}
-		task->last_idx = (task->last_idx + 1) & DELAY_MAX_MASK;
-	}
-
-	if (pkt_idx)
-		ret+= task->base.tx_pkt(&task->base, new_mbufs, pkt_idx, out);
-	task_impair_update(tbase);
-	return ret;
-}
-
 static void init_task(struct task_base *tbase, struct task_args *targ)
 {
 	struct task_impair *task = (struct task_impair *)tbase;
-	uint32_t queue_len = 0;
-	size_t mem_size;
-	unsigned socket_id;
-	uint64_t delay_us = 0;
 
 	task->seed = rte_rdtsc();
 	if (targ->probability == 0)
 		targ->probability = 1000000;
 
 	task->tresh = ((uint64_t) RAND_MAX) * targ->probability / 1000000;
-
-	if ((targ->delay_us == 0) && (targ->random_delay_us == 0)) {
-		tbase->handle_bulk = handle_bulk_random_drop;
-		task->delay_time = 0;
-	} else if (targ->random_delay_us) {
-		tbase->handle_bulk = handle_bulk_impair_random;
-		task->delay_time = usec_to_tsc(targ->random_delay_us);
-		task->delay_time_mask = rte_align32pow2(task->delay_time) - 1;
-		delay_us = targ->random_delay_us;
-		queue_len = rte_align32pow2((1250L * delay_us) / 84 / (DELAY_MAX_MASK + 1));
-	} else {
-		task->delay_time = usec_to_tsc(targ->delay_us);
-		delay_us = targ->delay_us;
-		queue_len = rte_align32pow2(1250 * delay_us / 84);
-	}
-	/* Assume Line-rate is maximum transmit speed.
-   	   TODO: take link speed if tx is port.
-	*/
-	if (queue_len < MAX_PKT_BURST)
-		queue_len= MAX_PKT_BURST;
-	task->queue_mask = queue_len - 1;
-	if (task->queue_mask < MAX_PKT_BURST - 1)
-		task->queue_mask = MAX_PKT_BURST - 1;
-
-	mem_size = (task->queue_mask + 1) * sizeof(task->queue[0]);
-	socket_id = rte_lcore_to_socket_id(targ->lconf->id);
 	task->socket_id = rte_lcore_to_socket_id(targ->lconf->id);
-
-	if (targ->delay_us) {
-		task->queue = prox_zmalloc(mem_size, socket_id);
-		PROX_PANIC(task->queue == NULL, "Not enough memory to allocate queue\n");
-		task->queue_head = 0;
-		task->queue_tail = 0;
-	} else if (targ->random_delay_us) {
-		size_t size = (DELAY_MAX_MASK + 1) * sizeof(struct queue);
-		plog_info("Allocating %zd bytes\n", size);
-		task->buffer = prox_zmalloc(size, socket_id);
-		PROX_PANIC(task->buffer == NULL, "Not enough memory to allocate buffer\n");
-		plog_info("Allocating %d x %zd bytes\n", DELAY_MAX_MASK + 1, mem_size);
-
-		for (int i = 0; i < DELAY_MAX_MASK + 1; i++) {
-			task->buffer[i].queue_elem = prox_zmalloc(mem_size, socket_id);
-			PROX_PANIC(task->buffer[i].queue_elem == NULL, "Not enough memory to allocate buffer elems\n");
-		}
+	task->delay_us = targ->delay_us;
+	task->random_delay_us = targ->random_delay_us;
+	task->delay_distr = targ->delay_distr;
+	if (task->delay_distr == DELAY_DISTR_CDF) {
+		PROX_PANIC(targ->delay_cdf_file[0] == '\0', "delay distribution cdf requires delay cdf file\n");
+		impair_load_cdf(task, targ->delay_cdf_file);
 	}
-	random_init_seed(&task->state);
+	task_impair_setup(task);
+
 	if (targ->nb_txports) {
 		memcpy(&task->src_mac[0], &prox_port_cfg[tbase->tx_params_hw.tx_port_queue[0].port].eth_addr, sizeof(struct ether_addr));
 		task->flags = IMPAIR_SET_MAC;
@@ -48,6 +48,7 @@
 #include "quit.h"
 #include "eld.h"
 #include "prox_shared.h"
+#include "lat_stream.h"
 
 #define DEFAULT_BUCKET_SIZE	10
 
@@ -106,6 +107,7 @@ struct task_lat {
 	uint64_t last_pkts_tsc;
 	struct delayed_latency delayed_latency;
 	struct lat_info *latency_buffer;
+	struct lat_stream *lat_stream;
 	uint32_t latency_buffer_idx;
 	uint32_t latency_buffer_size;
 	uint64_t begin;
@@ -338,6 +340,16 @@ static void lat_stop(struct task_base *tbase)
 	}
 	if (task->latency_buffer)
 		lat_write_latency_to_file(task);
+	if (task->lat_stream)
+		lat_stream_stop(task->lat_stream);
+}
+
+static void lat_start(struct task_base *tbase)
+{
+	struct task_lat *task = (struct task_lat *)tbase;
+
+	if (task->lat_stream)
+		lat_stream_start(task->lat_stream);
 }
 
 #ifdef LAT_DEBUG
@@ -439,6 +451,8 @@ static void lat_test_add_latency(struct lat_test *lat_test, uint64_t lat_tsc, ui
 		lat_test->min_lat_error = error;
 	}
 
+	lat_test->hist[lat_hist_bucket_id(lat_tsc)]++;
+
 #ifdef LATENCY_HISTOGRAM
 	lat_test_histogram_add(lat_test, lat_tsc);
 #endif
@@ -449,6 +463,25 @@ static int task_lat_can_store_latency(struct task_lat *task)
 	return task->latency_buffer_idx < task->latency_buffer_size;
 }
 
+static void task_lat_stream_lat(struct task_lat *task, uint64_t rx_packet_index, struct unique_id *unique_id, uint64_t rx_time, uint64_t tx_time, uint64_t rx_err, uint64_t tx_err)
+{
+	struct lat_stream_record rec;
+	uint8_t generator_id = 0;
+	uint32_t packet_index = 0;
+
+	if (unique_id)
+		unique_id_get(unique_id, &generator_id, &packet_index);
+
+	rec.rx_packet_index = rx_packet_index;
+	rec.tx_packet_index = packet_index;
+	rec.generator_id = generator_id;
+	rec.rx_time = rx_time;
+	rec.tx_time = tx_time;
+	rec.rx_err = rx_err;
+	rec.tx_err = tx_err;
+	lat_stream_add(task->lat_stream, &rec);
+}
+
 static void task_lat_store_lat(struct task_lat *task, uint64_t rx_packet_index, uint64_t rx_time, uint64_t tx_time, uint64_t rx_error, uint64_t tx_error, struct unique_id *unique_id)
 {
 	if (tx_time == 0)
@@ -460,6 +493,9 @@ static void task_lat_store_lat(struct task_lat *task, uint64_t rx_packet_index,
 	if (task_lat_can_store_latency(task)) {
 		task_lat_store_lat_buf(task, rx_packet_index, unique_id, rx_time, tx_time, rx_error, tx_error);
 	}
+	if (task->lat_stream) {
+		task_lat_stream_lat(task, rx_packet_index, unique_id, rx_time, tx_time, rx_error, tx_error);
+	}
 }
 
 static int handle_lat_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
@@ -633,6 +669,9 @@ static void init_task_lat(struct task_base *tbase, struct task_args *targ)
 	if (task->latency_buffer_size) {
 		init_task_lat_latency_buffer(task, targ->lconf->id);
 	}
+	if (targ->latency_stream_size) {
+		task->lat_stream = lat_stream_create(targ->lconf->id, targ->id, targ->latency_stream_size, socket_id);
+	}
 
 	if (targ->bucket_size < LATENCY_ACCURACY) {
 		targ->bucket_size = DEFAULT_BUCKET_SIZE;
@@ -655,6 +694,7 @@ static struct task_init task_init_lat = {
 	.mode_str = "lat",
 	.init = init_task_lat,
 	.handle = handle_lat_bulk,
+	.start = lat_start,
 	.stop = lat_stop,
 	.flag_features = TASK_FEATURE_TSC_RX | TASK_FEATURE_RX_ALL | TASK_FEATURE_ZERO_RX | TASK_FEATURE_NEVER_DISCARDS,
 	.size = sizeof(struct task_lat)
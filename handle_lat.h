@@ -43,6 +43,15 @@
 #define MAX_PACKETS_FOR_LATENCY 64
 #define LATENCY_ACCURACY	1
 
+/* Log-linear (HDR style) latency histogram. Latencies below
+   LAT_HIST_SUB_BUCKETS tsc are counted exactly. Above that, each
+   power of two range is split in LAT_HIST_SUB_BUCKETS equal buckets
+   so that the relative error of a bucket never exceeds
+   1/LAT_HIST_SUB_BUCKETS, independently of the latency range. */
+#define LAT_HIST_SUB_BUCKET_BITS	5
+#define LAT_HIST_SUB_BUCKETS		(1 << LAT_HIST_SUB_BUCKET_BITS)
+#define LAT_HIST_BUCKETS		((64 - LAT_HIST_SUB_BUCKET_BITS + 1) * LAT_HIST_SUB_BUCKETS)
+
 struct lat_test {
 	uint64_t tot_all_pkts;
 	uint64_t tot_pkts;
@@ -60,8 +69,31 @@ struct lat_test {
 	uint64_t buckets[128];
 	uint64_t bucket_size;
 	uint64_t lost_packets;
+
+	uint64_t hist[LAT_HIST_BUCKETS];
 };
 
+static uint32_t lat_hist_bucket_id(uint64_t tsc)
+{
+	if (tsc < LAT_HIST_SUB_BUCKETS)
+		return tsc;
+
+	uint32_t shift = 63 - __builtin_clzll(tsc) - LAT_HIST_SUB_BUCKET_BITS;
+
+	return ((shift + 1) << LAT_HIST_SUB_BUCKET_BITS) + ((tsc >> shift) & (LAT_HIST_SUB_BUCKETS - 1));
+}
+
+/* Middle of the range of latencies counted in bucket_id */
+static uint64_t lat_hist_bucket_tsc(uint32_t bucket_id)
+{
+	uint32_t range = bucket_id >> LAT_HIST_SUB_BUCKET_BITS;
+	uint64_t sub = bucket_id & (LAT_HIST_SUB_BUCKETS - 1);
+
+	if (range == 0)
+		return sub;
+	return ((LAT_HIST_SUB_BUCKETS + sub) << (range - 1)) + ((1ULL << (range - 1)) >> 1);
+}
+
 static struct time_unit lat_test_get_accuracy_limit(struct lat_test *lat_test)
 {
 	return tsc_to_time_unit(lat_test->accuracy_limit_tsc);
@@ -134,6 +166,37 @@ static struct time_unit_err lat_test_get_stddev(struct lat_test *lat_test)
 	return ret;
 }
 
+/* Latency (in tsc) below which ppm parts per million of the
+   accurately measured packets were received, within the precision
+   of the histogram. */
+static uint64_t lat_test_get_percentile_tsc(struct lat_test *lat_test, uint32_t ppm)
+{
+	uint64_t rank = ((unsigned __int128)lat_test->tot_pkts * ppm + 999999) / 1000000;
+	uint64_t count = 0;
+
+	if (rank == 0)
+		rank = 1;
+
+	for (uint32_t i = 0; i < LAT_HIST_BUCKETS; ++i) {
+		count += lat_test->hist[i];
+		if (count >= rank) {
+			uint64_t tsc = lat_hist_bucket_tsc(i);
+
+			if (tsc < lat_test->min_lat)
+				return lat_test->min_lat;
+			if (tsc > lat_test->max_lat)
+				return lat_test->max_lat;
+			return tsc;
+		}
+	}
+	return lat_test->max_lat;
+}
+
+static struct time_unit lat_test_get_percentile(struct lat_test *lat_test, uint32_t ppm)
+{
+	return tsc_to_time_unit(lat_test_get_percentile_tsc(lat_test, ppm));
+}
+
 static void _lat_test_histogram_combine(struct lat_test *dst, struct lat_test *src)
 {
 	for (size_t i = 0; i < sizeof(dst->buckets)/sizeof(dst->buckets[0]); ++i)
@@ -166,6 +229,9 @@ static void lat_test_combine(struct lat_test *dst, struct lat_test *src)
 		dst->accuracy_limit_tsc = src->accuracy_limit_tsc;
 	dst->lost_packets += src->lost_packets;
 
+	for (uint32_t i = 0; i < LAT_HIST_BUCKETS; ++i)
+		dst->hist[i] += src->hist[i];
+
 #ifdef LATENCY_HISTOGRAM
 	_lat_test_histogram_combine(dst, src);
 #endif
@@ -188,6 +254,7 @@ static void lat_test_reset(struct lat_test *lat_test)
 	lat_test->lost_packets = 0;
 
 	memset(lat_test->buckets, 0, sizeof(lat_test->buckets));
+	memset(lat_test->hist, 0, sizeof(lat_test->hist));
 }
 
 static void lat_test_copy(struct lat_test *dst, struct lat_test *src)
@@ -54,11 +54,26 @@
 #define RTE_CACHE_LINE_SIZE CACHE_LINE_SIZE
 #endif
 
+/* In grouped mode every meter starts on its own cache line so that
+   touching one subscriber never pulls in (or false-shares) its
+   neighbours. */
+struct police_flow {
+	union {
+		struct rte_meter_srtcm sr;
+		struct rte_meter_trtcm tr;
+	};
+} __rte_cache_aligned;
+
+/* Hash size used to group packets of the same flow within a burst,
+   must be a power of 2 larger than MAX_PKT_BURST. */
+#define POLICE_GROUP_HASH_SIZE (2 * MAX_PKT_BURST)
+
 struct task_police {
 	struct task_base base;
 	union {
 		struct rte_meter_srtcm *sr_flows;
 		struct rte_meter_trtcm *tr_flows;
+		struct police_flow     *flows;
 	};
 
 	uint16_t           *user_table;
@@ -69,22 +84,22 @@ struct task_police {
 
 typedef uint8_t (*hp) (struct task_police *task, struct rte_mbuf *mbuf, uint64_t tsc, uint32_t user);
 
-static uint8_t handle_police(struct task_police *task, struct rte_mbuf *mbuf, uint64_t tsc, uint32_t user)
+static inline uint8_t police_sr(struct task_police *task, struct rte_mbuf *mbuf, uint64_t tsc, struct rte_meter_srtcm *meter)
 {
 	enum rte_meter_color in_color = e_RTE_METER_GREEN;
 	enum rte_meter_color out_color;
 	uint32_t pkt_len = rte_pktmbuf_pkt_len(mbuf) + task->overhead;
-	out_color = rte_meter_srtcm_color_aware_check(&task->sr_flows[user], tsc, pkt_len, in_color);
+	out_color = rte_meter_srtcm_color_aware_check(meter, tsc, pkt_len, in_color);
 
 	return task->police_act[in_color][out_color] == ACT_DROP? OUT_DISCARD : 0;
 }
 
-static uint8_t handle_police_tr(struct task_police *task, struct rte_mbuf *mbuf, uint64_t tsc, uint32_t user)
+static inline uint8_t police_tr(struct task_police *task, struct rte_mbuf *mbuf, uint64_t tsc, struct rte_meter_trtcm *meter)
 {
 	enum rte_meter_color in_color = e_RTE_METER_GREEN;
 	enum rte_meter_color out_color;
 	uint32_t pkt_len = rte_pktmbuf_pkt_len(mbuf) + task->overhead;
-	out_color = rte_meter_trtcm_color_aware_check(&task->tr_flows[user], tsc, pkt_len, in_color);
+	out_color = rte_meter_trtcm_color_aware_check(meter, tsc, pkt_len, in_color);
 
 	if (task->runtime_flags  & TASK_MARK) {
 #if RTE_VERSION >= RTE_VERSION_NUM(1,8,0,0)
@@ -105,6 +120,16 @@ static uint8_t handle_police_tr(struct task_police *task, struct rte_mbuf *mbuf,
 	return task->police_act[in_color][out_color] == ACT_DROP? OUT_DISCARD : 0;
 }
 
+static uint8_t handle_police(struct task_police *task, struct rte_mbuf *mbuf, uint64_t tsc, uint32_t user)
+{
+	return police_sr(task, mbuf, tsc, &task->sr_flows[user]);
+}
+
+static uint8_t handle_police_tr(struct task_police *task, struct rte_mbuf *mbuf, uint64_t tsc, uint32_t user)
+{
+	return police_tr(task, mbuf, tsc, &task->tr_flows[user]);
+}
+
 static inline int get_user(struct task_police *task, struct rte_mbuf *mbuf)
 {
 	if (task->runtime_flags & TASK_CLASSIFY) {
@@ -192,6 +217,77 @@ static inline int handle_pb(struct task_base *tbase, struct rte_mbuf **mbufs, ui
 	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 }
 
+/* Grouped mode: packets of the same flow within a burst are chained
+   together so that each meter is looked up and prefetched once and
+   then updated by all its packets back to back. Packet order within
+   a flow is preserved, so the colors are the same as in handle_pb(). */
+static inline int handle_pb_group(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts, int trtcm)
+{
+	struct task_police *task = (struct task_police *)tbase;
+	uint64_t cur_tsc = rte_rdtsc();
+	uint8_t  out[MAX_PKT_BURST];
+	uint32_t flow[MAX_PKT_BURST];
+	uint8_t  next[MAX_PKT_BURST];
+	uint8_t  last[MAX_PKT_BURST];
+	uint8_t  first[MAX_PKT_BURST];
+	uint8_t  slot[POLICE_GROUP_HASH_SIZE];
+	uint16_t n_groups = 0;
+	uint16_t j;
+
+	memset(slot, 0xff, sizeof(slot));
+
+	for (j = 0; j < n_pkts; ++j) {
+		PREFETCH0(mbufs[j]);
+	}
+	for (j = 0; j < n_pkts; ++j) {
+		PREFETCH0(rte_pktmbuf_mtod(mbufs[j], void*));
+	}
+	for (j = 0; j < n_pkts; ++j) {
+		uint32_t user = get_user(task, mbufs[j]);
+		flow[j] = user;
+		PREFETCH0(&task->user_table[user]);
+	}
+
+	for (j = 0; j < n_pkts; ++j) {
+		uint32_t f = task->user_table[flow[j]];
+		uint32_t h = f & (POLICE_GROUP_HASH_SIZE - 1);
+
+		flow[j] = f;
+		next[j] = 0xff;
+		while (slot[h] != 0xff && flow[first[slot[h]]] != f)
+			h = (h + 1) & (POLICE_GROUP_HASH_SIZE - 1);
+
+		if (slot[h] == 0xff) {
+			slot[h] = n_groups;
+			first[n_groups] = j;
+			last[n_groups] = j;
+			n_groups++;
+			PREFETCH0(&task->flows[f]);
+			if (trtcm && sizeof(struct police_flow) > RTE_CACHE_LINE_SIZE)
+				PREFETCH0((uint8_t *)&task->flows[f] + RTE_CACHE_LINE_SIZE);
+		}
+		else {
+			uint8_t g = slot[h];
+
+			next[last[g]] = j;
+			last[g] = j;
+		}
+	}
+
+	for (uint16_t g = 0; g < n_groups; ++g) {
+		struct police_flow *pf = &task->flows[flow[first[g]]];
+
+		for (j = first[g]; j != 0xff; j = next[j]) {
+			if (trtcm)
+				out[j] = police_tr(task, mbufs[j], cur_tsc, &pf->tr);
+			else
+				out[j] = police_sr(task, mbufs[j], cur_tsc, &pf->sr);
+		}
+	}
+
+	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
+}
+
 static int handle_police_bulk(struct task_base *tbase, struct rte_mbuf **mbuf, uint16_t n_pkts)
 {
         return handle_pb(tbase, mbuf, n_pkts, handle_police);
@@ -202,6 +298,16 @@ static int handle_police_tr_bulk(struct task_base *tbase, struct rte_mbuf **mbuf
         return handle_pb(tbase, mbuf, n_pkts, handle_police_tr);
 }
 
+static int handle_police_group_bulk(struct task_base *tbase, struct rte_mbuf **mbuf, uint16_t n_pkts)
+{
+	return handle_pb_group(tbase, mbuf, n_pkts, 0);
+}
+
+static int handle_police_tr_group_bulk(struct task_base *tbase, struct rte_mbuf **mbuf, uint16_t n_pkts)
+{
+	return handle_pb_group(tbase, mbuf, n_pkts, 1);
+}
+
 static void init_task_police(struct task_base *tbase, struct task_args *targ)
 {
 	struct task_police *task = (struct task_police *)tbase;
@@ -218,9 +324,20 @@ static void init_task_police(struct task_base *tbase, struct task_args *targ)
 		prox_sh_add_socket(socket_id, "user_table", task->user_table);
 	}
 
+	const int group = !!(targ->flags & TASK_ARG_POLICE_GROUP);
+
+	if (group) {
+		PROX_PANIC(targ->n_flows == 0, "Number of users is set to 0\n");
+		task->flows = prox_zmalloc(targ->n_flows * sizeof(*task->flows), socket_id);
+		PROX_PANIC(task->flows == NULL, "Failed to allocate flow contexts\n");
+		plog_info("\tPolicing grouped per flow, %u meters of %zu bytes\n", targ->n_flows, sizeof(*task->flows));
+	}
+
 	if (strcmp(targ->task_init->sub_mode_str, "trtcm")) {
-		task->sr_flows = prox_zmalloc(targ->n_flows * sizeof(*task->sr_flows), socket_id);
-		PROX_PANIC(task->sr_flows == NULL, "Failed to allocate flow contexts\n");
+		if (!group) {
+			task->sr_flows = prox_zmalloc(targ->n_flows * sizeof(*task->sr_flows), socket_id);
+			PROX_PANIC(task->sr_flows == NULL, "Failed to allocate flow contexts\n");
+		}
 		PROX_PANIC(!targ->cir, "Commited information rate is set to 0\n");
 		PROX_PANIC(!targ->cbs, "Commited information bucket size is set to 0\n");
 		PROX_PANIC(!targ->ebs, "Execess information bucket size is set to 0\n");
@@ -232,12 +349,16 @@ static void init_task_police(struct task_base *tbase, struct task_args *targ)
 		};
 
 		for (uint32_t i = 0; i < targ->n_flows; ++i) {
-			rte_meter_srtcm_config(&task->sr_flows[i], &params);
+			rte_meter_srtcm_config(group? &task->flows[i].sr : &task->sr_flows[i], &params);
 		}
+		if (group)
+			tbase->handle_bulk = handle_police_group_bulk;
 	}
 	else {
-		task->tr_flows = prox_zmalloc(targ->n_flows * sizeof(*task->tr_flows), socket_id);
-		PROX_PANIC(task->tr_flows == NULL, "Failed to allocate flow contexts\n");
+		if (!group) {
+			task->tr_flows = prox_zmalloc(targ->n_flows * sizeof(*task->tr_flows), socket_id);
+			PROX_PANIC(task->tr_flows == NULL, "Failed to allocate flow contexts\n");
+		}
 		PROX_PANIC(!targ->pir, "Peak information rate is set to 0\n");
 		PROX_PANIC(!targ->cir, "Commited information rate is set to 0\n");
 		PROX_PANIC(!targ->pbs, "Peak information bucket size is set to 0\n");
@@ -251,8 +372,10 @@ static void init_task_police(struct task_base *tbase, struct task_args *targ)
 		};
 
 		for (uint32_t i = 0; i < targ->n_flows; ++i) {
-			rte_meter_trtcm_config(&task->tr_flows[i], &params);
+			rte_meter_trtcm_config(group? &task->flows[i].tr : &task->tr_flows[i], &params);
 		}
+		if (group)
+			tbase->handle_bulk = handle_police_tr_group_bulk;
 	}
 
 	for (uint32_t i = 0; i < 3; ++i) {
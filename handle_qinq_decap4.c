@@ -58,13 +58,16 @@
 #include "prox_cfg.h"
 #include "lconf.h"
 #include "prox_cfg.h"
-#include "prox_shared.h"
+#include "route_table.h"
+#include "prox_events.h"
 
 struct task_qinq_decap4 {
 	struct task_base        base;
 	struct rte_table_hash   *cpe_table;
 	struct rte_table_hash   *qinq_gre_table;
 	struct qinq_gre_data    *qinq_gre_data;
+	struct route_table      *route_table;
+	/* Tables in use by the current bulk, see route_table_get() */
 	struct next_hop         *next_hops;
 	struct rte_lpm          *ipv4_lpm;
 	uint32_t                local_ipv4;
@@ -75,8 +78,11 @@ struct task_qinq_decap4 {
 	uint64_t                src_mac[PROX_MAX_PORTS];
 	struct rte_mbuf*        fake_packets[64];
 	struct expire_cpe       expire_cpe;
+	uint64_t                expire_period;
 	uint64_t                cpe_timeout;
 	uint8_t                 mapping[PROX_MAX_PORTS];
+	struct event_lcore      *events;
+	uint8_t                 task_id;
 };
 
 static uint8_t handle_qinq_decap4(struct task_qinq_decap4 *task, struct rte_mbuf *mbuf, struct qinq_gre_data* entry);
@@ -84,24 +90,25 @@ static uint8_t handle_qinq_decap4(struct task_qinq_decap4 *task, struct rte_mbuf
 static void arp_update(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
 static void arp_msg(struct task_base *tbase, void **data, uint16_t n_msgs);
 
+static uint64_t tsc_expire_cpe(struct lcore_cfg *lconf, void *data)
+{
+	struct task_qinq_decap4 *task = (struct task_qinq_decap4 *)data;
+
+	check_expire_cpe(&task->expire_cpe);
+	return task->expire_period;
+}
+
 static void init_task_qinq_decap4(struct task_base *tbase, struct task_args *targ)
 {
 	struct task_qinq_decap4 *task = (struct task_qinq_decap4 *)tbase;
 	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
-	struct lpm4 *lpm;
 
 	task->cpe_table = targ->cpe_table;
 	task->cpe_timeout = msec_to_tsc(targ->cpe_table_timeout_ms);
+	task->events = event_lcore_get(targ->lconf->id, socket_id);
+	task->task_id = targ->id;
 
-	PROX_PANIC(!strcmp(targ->route_table, ""), "route table not specified\n");
-	lpm = prox_sh_find_socket(socket_id, targ->route_table);
-	if (!lpm) {
-		int ret = lua_to_lpm4(prox_lua(), GLOBAL, targ->route_table, socket_id, &lpm);
-		PROX_PANIC(ret, "Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
-		prox_sh_add_socket(socket_id, targ->route_table, lpm);
-	}
-	task->ipv4_lpm = lpm->rte_lpm;
-	task->next_hops = lpm->next_hops;
+	task->route_table = route_table_init(targ, socket_id);
 
 	task->qinq_tag = targ->qinq_tag;
 	task->local_ipv4 = targ->local_ipv4;
@@ -112,10 +119,9 @@ static void init_task_qinq_decap4(struct task_base *tbase, struct task_args *tar
 	task->qinq_gre_table = targ->qinq_gre_table;
 
 	if (targ->cpe_table_timeout_ms) {
-		targ->lconf->period_func = check_expire_cpe;
 		task->expire_cpe.cpe_table = task->cpe_table;
-		targ->lconf->period_data = &task->expire_cpe;
-		targ->lconf->period_timeout = msec_to_tsc(500) / NUM_VCPES;
+		task->expire_period = msec_to_tsc(500) / NUM_VCPES;
+		lconf_add_tsc_task(targ->lconf, tsc_expire_cpe, task, task->expire_period);
 	}
 
 	for (uint32_t i = 0; i < 64; ++i) {
@@ -360,10 +366,14 @@ static void arp_update(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_
 static int handle_qinq_decap4_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_qinq_decap4 *task = (struct task_qinq_decap4 *)tbase;
+	struct lpm4 *lpm = route_table_get(task->route_table);
 	uint64_t pkts_mask = RTE_LEN2MASK(n_pkts, uint64_t);
 	struct qinq_gre_data* entries[64];
 	uint8_t out[MAX_PKT_BURST];
 	uint64_t lookup_hit_mask;
+
+	task->ipv4_lpm = lpm->rte_lpm;
+	task->next_hops = lpm->next_hops;
 	prefetch_pkts(mbufs, n_pkts);
 
 	// Prefetch headroom, as we will prepend mbuf and write to this cache line
@@ -471,7 +481,7 @@ static inline uint8_t gre_encap_route(uint32_t src_ipv4, struct rte_mbuf *mbuf,
 	uint8_t next_hop_index;
 #endif
 	if (unlikely(rte_lpm_lookup(task->ipv4_lpm, rte_bswap32(pip->dst_addr), &next_hop_index) != 0)) {
-		plog_warn("lpm_lookup failed for ip %x: rc = %d\n", rte_bswap32(pip->dst_addr), -ENOENT);
+		event_sample(task->events, EVENT_QINQ_DECAP4_NO_ROUTE, task->task_id, pip->src_addr, 0, pip->dst_addr, 0);
 		return ROUTE_ERR;
 	}
 	PREFETCH0(&task->next_hops[next_hop_index]);
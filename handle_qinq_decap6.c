@@ -62,12 +62,11 @@ struct task_qinq_decap6 {
 	uint32_t                        bucket_index;
 	struct ether_addr 		edaddr;
 	struct rte_lpm6                 *rte_lpm6;
-	void*                           period_data; /* used if using dual stack*/
-	void (*period_func)(void* data);
 	uint64_t                        cpe_timeout;
+	uint64_t                        expire_period;
 };
 
-void update_arp_entries6(void* data);
+static uint64_t update_arp_entries6(struct lcore_cfg *lconf, void *data);
 
 static void init_task_qinq_decap6(struct task_base *tbase, struct task_args *targ)
 {
@@ -78,14 +77,11 @@ static void init_task_qinq_decap6(struct task_base *tbase, struct task_args *tar
 	task->cpe_table = targ->cpe_table;
 	task->cpe_timeout = msec_to_tsc(targ->cpe_table_timeout_ms);
 
+	/* When running dual stack, the IPv4 part registers its own
+	   tsc_task on the same core. */
 	if (targ->cpe_table_timeout_ms) {
-		if (targ->lconf->period_func) {
-			task->period_func = targ->lconf->period_func;
-			task->period_data = targ->lconf->period_data;
-		}
-		targ->lconf->period_func = update_arp_entries6;
-		targ->lconf->period_data = tbase;
-		targ->lconf->period_timeout = msec_to_tsc(500) / NUM_VCPES;
+		task->expire_period = msec_to_tsc(500) / NUM_VCPES;
+		lconf_add_tsc_task(targ->lconf, update_arp_entries6, task, task->expire_period);
 	}
 
 	task->user_table = prox_sh_find_socket(socket_id, "user_table");
@@ -173,7 +169,7 @@ static int handle_qinq_decap6_bulk(struct task_base *tbase, struct rte_mbuf **mb
 	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 }
 
-void update_arp_entries6(void* data)
+static uint64_t update_arp_entries6(struct lcore_cfg *lconf, void *data)
 {
 	uint64_t cur_tsc = rte_rdtsc();
 	struct task_qinq_decap6 *task = (struct task_qinq_decap6 *)data;
@@ -193,9 +189,7 @@ void update_arp_entries6(void* data)
 	task->bucket_index++;
 	task->bucket_index &= (n_buckets - 1);
 
-	if (task->period_func) {
-		task->period_func(task->period_data);
-	}
+	return task->expire_period;
 }
 
 static struct task_init task_init_qinq_decap6 = {
@@ -32,6 +32,7 @@
 
 #include <rte_ip.h>
 #include <rte_mbuf.h>
+#include <rte_ring.h>
 #include <rte_sched.h>
 
 #include "prox_lua.h"
@@ -48,8 +49,17 @@
 #include "log.h"
 #include "quit.h"
 #include "qinq.h"
+#include "qinq_classify.h"
 #include "prox_cfg.h"
 #include "prox_shared.h"
+#include "clock.h"
+
+/* Maximum number of packets dequeued per call when dequeue is done
+   from the enqueue path */
+#define QOS_DEQUEUE_BURST 32
+
+/* Interval at which per traffic class drop counters are collected */
+#define QOS_TC_STATS_PERIOD_MSEC 1
 
 struct task_qos {
 	struct task_base base;
@@ -58,6 +68,13 @@ struct task_qos {
 	uint8_t  *dscp;
 	uint32_t nb_buffered_pkts;
 	uint8_t runtime_flags;
+	uint8_t tc_stats;
+	uint8_t task_id;
+	/* Only used if dequeue is driven by its own timer */
+	uint32_t dequeue_budget;
+	uint64_t dequeue_tsc;
+	struct rte_ring *tx_ring;
+	struct qos_tc_stats tc[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
 };
 
 uint32_t task_qos_n_pkts_buffered(struct task_base *tbase)
@@ -67,75 +84,125 @@ uint32_t task_qos_n_pkts_buffered(struct task_base *tbase)
 	return task->nb_buffered_pkts;
 }
 
+const struct qos_tc_stats *task_qos_get_tc_stats(struct task_base *tbase)
+{
+	struct task_qos *task = (struct task_qos *)tbase;
+
+	return task->tc_stats? task->tc : NULL;
+}
+
+static inline uint32_t qos_mbuf_tc(struct rte_mbuf *mbuf)
+{
+	uint32_t dummy, tc;
+
+	rte_sched_port_pkt_read_tree_path(mbuf, &dummy, &dummy, &tc, &dummy);
+	return tc;
+}
+
+static inline void qos_enqueue(struct task_qos *task, struct rte_mbuf **mbufs, uint16_t n_pkts)
+{
+	if (task->tc_stats) {
+		for (uint16_t j = 0; j < n_pkts; ++j)
+			task->tc[qos_mbuf_tc(mbufs[j])].enqueued++;
+	}
+
+	int16_t ret = rte_sched_port_enqueue(task->sched_port, mbufs, n_pkts);
+	task->nb_buffered_pkts += ret;
+	TASK_STATS_ADD_IDLE(&task->base.aux->stats, n_pkts - ret);
+}
+
+static inline int qos_dequeue(struct task_qos *task, struct rte_mbuf **mbufs, uint16_t max_pkts)
+{
+	uint16_t n_pkts = rte_sched_port_dequeue(task->sched_port, mbufs, max_pkts);
+
+	if (unlikely(n_pkts == 0))
+		return 0;
+	task->nb_buffered_pkts -= n_pkts;
+	if (task->tc_stats) {
+		for (uint16_t j = 0; j < n_pkts; ++j)
+			task->tc[qos_mbuf_tc(mbufs[j])].dequeued++;
+	}
+	return task->base.tx_pkt(&task->base, mbufs, n_pkts, NULL);
+}
+
 static inline int handle_qos_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_qos *task = (struct task_qos *)tbase;
 	int ret = 0;
 
 	if (n_pkts) {
-		if (task->runtime_flags & TASK_CLASSIFY) {
-			uint16_t j;
-#ifdef PROX_PREFETCH_OFFSET
-			for (j = 0; j < PROX_PREFETCH_OFFSET && j < n_pkts; ++j) {
-				prefetch_nta(mbufs[j]);
-			}
-			for (j = 1; j < PROX_PREFETCH_OFFSET && j < n_pkts; ++j) {
-				prefetch_nta(rte_pktmbuf_mtod(mbufs[j - 1], void *));
-			}
-#endif
-			uint8_t queue = 0;
-			uint8_t tc = 0;
-			for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
-				prefetch_nta(mbufs[j + PREFETCH_OFFSET]);
-				prefetch_nta(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
-				const struct qinq_hdr *pqinq = rte_pktmbuf_mtod(mbufs[j], const struct qinq_hdr *);
-				uint32_t qinq = PKT_TO_LUTQINQ(pqinq->svlan.vlan_tci, pqinq->cvlan.vlan_tci);
-				if (pqinq->ether_type == ETYPE_IPv4) {
-					const struct ipv4_hdr *ipv4_hdr = (const struct ipv4_hdr *)(pqinq + 1);
-					queue = task->dscp[ipv4_hdr->type_of_service >> 2] & 0x3;
-					tc = task->dscp[ipv4_hdr->type_of_service >> 2] >> 2;
-				} else {
-					// Keep queue and tc = 0 for other packet types like ARP
-					queue = 0;
-					tc = 0;
-				}
-
-				rte_sched_port_pkt_write(mbufs[j], 0, task->user_table[qinq], tc, queue, 0);
-			}
-#ifdef PROX_PREFETCH_OFFSET
-			prefetch_nta(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
-			for (; j < n_pkts; ++j) {
-				const struct qinq_hdr *pqinq = rte_pktmbuf_mtod(mbufs[j], const struct qinq_hdr *);
-				uint32_t qinq = PKT_TO_LUTQINQ(pqinq->svlan.vlan_tci, pqinq->cvlan.vlan_tci);
-				if (pqinq->ether_type == ETYPE_IPv4) {
-					const struct ipv4_hdr *ipv4_hdr = (const struct ipv4_hdr *)(pqinq + 1);
-					queue = task->dscp[ipv4_hdr->type_of_service >> 2] & 0x3;
-					tc = task->dscp[ipv4_hdr->type_of_service >> 2] >> 2;
-				} else {
-					// Keep queue and tc = 0 for other packet types like ARP
-					queue = 0;
-					tc = 0;
-				}
-
-				rte_sched_port_pkt_write(mbufs[j], 0, task->user_table[qinq], tc, queue, 0);
-			}
-#endif
-		}
-		int16_t ret = rte_sched_port_enqueue(task->sched_port, mbufs, n_pkts);
-		task->nb_buffered_pkts += ret;
-		TASK_STATS_ADD_IDLE(&task->base.aux->stats, n_pkts - ret);
+		if (task->runtime_flags & TASK_CLASSIFY)
+			qinq_classify_bulk(mbufs, n_pkts, task->user_table, task->dscp, 0);
+		qos_enqueue(task, mbufs, n_pkts);
 	}
 
-	if (task->nb_buffered_pkts) {
-		n_pkts = rte_sched_port_dequeue(task->sched_port, mbufs, 32);
-		if (likely(n_pkts)) {
-			task->nb_buffered_pkts -= n_pkts;
-			ret = task->base.tx_pkt(&task->base, mbufs, n_pkts, NULL);
-		}
-	}
+	if (task->nb_buffered_pkts)
+		ret = qos_dequeue(task, mbufs, QOS_DEQUEUE_BURST);
 	return ret;
 }
 
+/* Used when dequeue is driven by tsc_dequeue(): the rx path only
+   enqueues so that the dequeue rate does not depend on the rate at
+   which packets are received. */
+static int handle_qos_enqueue_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
+{
+	struct task_qos *task = (struct task_qos *)tbase;
+
+	if (n_pkts) {
+		if (task->runtime_flags & TASK_CLASSIFY)
+			qinq_classify_bulk(mbufs, n_pkts, task->user_table, task->dscp, 0);
+		qos_enqueue(task, mbufs, n_pkts);
+	}
+	return 0;
+}
+
+/* Dequeue up to dequeue_budget packets, limited by the space left in
+   the tx ring (if any) so that no packets leave the scheduler only
+   to be dropped on tx. */
+static uint64_t tsc_dequeue(struct lcore_cfg *lconf, void *data)
+{
+	struct task_qos *task = data;
+	struct rte_mbuf *mbufs[MAX_PKT_BURST];
+	uint32_t budget = task->dequeue_budget;
+
+	if (!task->nb_buffered_pkts || !lconf_task_is_running(lconf, task->task_id))
+		return task->dequeue_tsc;
+
+	if (task->tx_ring) {
+		uint32_t space = rte_ring_free_count(task->tx_ring);
+		if (space < budget)
+			budget = space;
+	}
+
+	while (budget && task->nb_buffered_pkts) {
+		uint16_t n = budget < MAX_PKT_BURST? budget : MAX_PKT_BURST;
+		uint32_t prev = task->nb_buffered_pkts;
+
+		qos_dequeue(task, mbufs, n);
+		/* Less than requested: the shaper is holding back the rest */
+		if (prev - task->nb_buffered_pkts < n)
+			break;
+		budget -= n;
+	}
+	return task->dequeue_tsc;
+}
+
+/* Packets dropped by the scheduler are only known per traffic class
+   through the subport counters, which are cleared on each read. They
+   are only maintained if DPDK is built with RTE_SCHED_COLLECT_STATS. */
+static uint64_t tsc_tc_stats(struct lcore_cfg *lconf, void *data)
+{
+	struct task_qos *task = data;
+	struct rte_sched_subport_stats stats;
+	uint32_t tc_ov;
+
+	if (rte_sched_subport_read_stats(task->sched_port, 0, &stats, &tc_ov) == 0) {
+		for (uint32_t i = 0; i < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; ++i)
+			task->tc[i].dropped += stats.n_pkts_tc_dropped[i];
+	}
+	return msec_to_tsc(QOS_TC_STATS_PERIOD_MSEC);
+}
+
 static void init_task_qos(struct task_base *tbase, struct task_args *targ)
 {
 	struct task_qos *task = (struct task_qos *)tbase;
@@ -161,6 +228,24 @@ static void init_task_qos(struct task_base *tbase, struct task_args *targ)
 	}
 
 	task->runtime_flags = targ->runtime_flags;
+	task->task_id = targ->task;
+
+	if (targ->qos_conf.dequeue_ns) {
+		task->dequeue_tsc = nsec_to_tsc(targ->qos_conf.dequeue_ns);
+		if (task->dequeue_tsc == 0)
+			task->dequeue_tsc = 1;
+		task->dequeue_budget = targ->qos_conf.dequeue_budget? targ->qos_conf.dequeue_budget : QOS_DEQUEUE_BURST;
+		if (targ->nb_txrings == 1 && targ->nb_txports == 0)
+			task->tx_ring = targ->tx_rings[0];
+		tbase->handle_bulk = handle_qos_enqueue_bulk;
+		lconf_add_tsc_task(targ->lconf, tsc_dequeue, task, task->dequeue_tsc);
+		plog_info("\tQoS dequeue every %u ns, up to %u packets\n", targ->qos_conf.dequeue_ns, task->dequeue_budget);
+	}
+
+	if (targ->flags & TASK_ARG_QOS_TC_STATS) {
+		task->tc_stats = 1;
+		lconf_add_tsc_task(targ->lconf, tsc_tc_stats, task, msec_to_tsc(QOS_TC_STATS_PERIOD_MSEC));
+	}
 
 	task->user_table = prox_sh_find_socket(socket_id, "user_table");
 	if (!task->user_table) {
@@ -34,9 +34,21 @@
 #define _HANDLE_QOS_H_
 
 #include <inttypes.h>
+#include <rte_sched.h>
 
 struct task_base;
 
+/* Occupancy of a traffic class is enqueued - dropped - dequeued.
+   Packets counted as enqueued include those dropped by the
+   scheduler. */
+struct qos_tc_stats {
+	uint64_t enqueued;
+	uint64_t dequeued;
+	uint64_t dropped;
+};
+
 uint32_t task_qos_n_pkts_buffered(struct task_base *tbase);
+/* Returns NULL unless "qos tc stats" is enabled for the task */
+const struct qos_tc_stats *task_qos_get_tc_stats(struct task_base *tbase);
 
 #endif /* _HANDLE_QOS_H_ */
@@ -54,42 +54,62 @@
 #include "qinq.h"
 #include "prox_cfg.h"
 #include "ip6_addr.h"
-#include "prox_shared.h"
+#include "route_table.h"
 #include "prox_cksum.h"
 #include "mbuf_utils.h"
+#include "prox_events.h"
 
 struct task_routing {
 	struct task_base                base;
 	uint8_t                         runtime_flags;
 	struct lcore_cfg                *lconf;
+	struct route_table              *route_table;
+	/* Tables in use by the current bulk, see route_table_get() */
 	struct rte_lpm                  *ipv4_lpm;
 	struct next_hop                 *next_hops;
 	int                             offload_crc;
-	uint32_t			number_free_rules;
 	uint16_t                        qinq_tag;
 	uint32_t                        marking[4];
 	uint64_t                        src_mac[PROX_MAX_PORTS];
+	uint64_t                        n_lpm_miss;
+	struct event_lcore              *events;
 };
 
+#if RTE_VERSION >= RTE_VERSION_NUM(16,4,0,1)
+typedef uint32_t lpm_next_hop_t;
+#define LPM_NEXT_HOP_MASK 0x00ffffff
+#else
+typedef uint16_t lpm_next_hop_t;
+#define LPM_NEXT_HOP_MASK 0x00ff
+#endif
+
+uint64_t task_routing_get_n_lpm_miss(struct task_base *tbase)
+{
+	struct task_routing *task = (struct task_routing *)tbase;
+
+	return task->n_lpm_miss;
+}
+
 static void routing_update(struct task_base *tbase, void **data, uint16_t n_msgs)
 {
 	struct task_routing *task = (struct task_routing *)tbase;
+	struct lpm4 *lpm = route_table_get(task->route_table);
 	struct route_msg *msg;
 
 	for (uint16_t i = 0; i < n_msgs; ++i) {
 		msg = (struct route_msg *)data[i];
 
-		if (task->number_free_rules == 0) {
+		if (lpm->n_free_rules == 0) {
 			plog_warn("Failed adding route: %u.%u.%u.%u/%u: lpm table full\n",
 				msg->ip_bytes[0], msg->ip_bytes[1], msg->ip_bytes[2],
 				msg->ip_bytes[3], msg->prefix);
 		} else {
-			if (rte_lpm_add(task->ipv4_lpm, rte_bswap32(msg->ip), msg->prefix, msg->nh)) {
+			if (rte_lpm_add(lpm->rte_lpm, rte_bswap32(msg->ip), msg->prefix, msg->nh)) {
 				plog_warn("Failed adding route: %u.%u.%u.%u/%u\n",
 					msg->ip_bytes[0], msg->ip_bytes[1], msg->ip_bytes[2],
 					msg->ip_bytes[3], msg->prefix);
 			} else {
-				task->number_free_rules--;
+				lpm->n_free_rules--;
 			}
 		}
 	}
@@ -99,38 +119,13 @@ static void init_task_routing(struct task_base *tbase, struct task_args *targ)
 {
 	struct task_routing *task = (struct task_routing *)tbase;
 	const int socket_id = rte_lcore_to_socket_id(targ->lconf->id);
-	struct lpm4 *lpm;
 
 	task->lconf = targ->lconf;
 	task->qinq_tag = targ->qinq_tag;
 	task->runtime_flags = targ->runtime_flags;
 
-	PROX_PANIC(!strcmp(targ->route_table, ""), "route table not specified\n");
-	if (targ->flags & TASK_ARG_LOCAL_LPM) {
-		int ret = lua_to_lpm4(prox_lua(), GLOBAL, targ->route_table, socket_id, &lpm);
-		PROX_PANIC(ret, "Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
-		prox_sh_add_socket(socket_id, targ->route_table, lpm);
-
-		task->number_free_rules = lpm->n_free_rules;
-	}
-	else {
-		lpm = prox_sh_find_socket(socket_id, targ->route_table);
-		if (!lpm) {
-			int ret = lua_to_lpm4(prox_lua(), GLOBAL, targ->route_table, socket_id, &lpm);
-			PROX_PANIC(ret, "Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
-			prox_sh_add_socket(socket_id, targ->route_table, lpm);
-		}
-	}
-	task->ipv4_lpm = lpm->rte_lpm;
-	task->next_hops = lpm->next_hops;
-	task->number_free_rules = lpm->n_free_rules;
-
-	for (uint32_t i = 0; i < MAX_HOP_INDEX; i++) {
-		int tx_port = task->next_hops[i].mac_port.out_idx;
-		if ((tx_port > targ->nb_txports - 1) && (tx_port > targ->nb_txrings - 1)) {
-			PROX_PANIC(1, "Routing Table contains port %d but only %d tx port/ %d ring:\n", tx_port, targ->nb_txports, targ->nb_txrings);
-		}
-	}
+	task->route_table = route_table_init(targ, socket_id);
+	task->events = event_lcore_get(targ->lconf->id, socket_id);
 
         if (targ->nb_txrings) {
 		struct task_args *dtarg;
@@ -168,30 +163,54 @@ static void init_task_routing(struct task_base *tbase, struct task_args *targ)
 	targ->lconf->ctrl_timeout = freq_to_tsc(20);
 }
 
-static inline uint8_t handle_routing(struct task_routing *task, struct rte_mbuf *mbuf);
+static inline uint8_t routing_parse(struct task_routing *task, struct rte_mbuf *mbuf, uint32_t *ip_offset, uint32_t *dst_ip);
+static uint8_t route_ipv4(struct task_routing *task, struct rte_mbuf *mbuf, uint32_t ip_offset, uint32_t next_hop_index);
 
 static int handle_routing_bulk(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts)
 {
 	struct task_routing *task = (struct task_routing *)tbase;
+	struct lpm4 *lpm = route_table_get(task->route_table);
 	uint8_t out[MAX_PKT_BURST];
+	uint32_t ip_offset[MAX_PKT_BURST];
+	uint32_t dst_ip[MAX_PKT_BURST];
+	lpm_next_hop_t next_hop[MAX_PKT_BURST];
 	uint16_t j;
 
+	task->ipv4_lpm = lpm->rte_lpm;
+	task->next_hops = lpm->next_hops;
+
 	prefetch_first(mbufs, n_pkts);
 
+	/* First find the destination of all packets, ... */
 	for (j = 0; j + PREFETCH_OFFSET < n_pkts; ++j) {
 #ifdef PROX_PREFETCH_OFFSET
 		PREFETCH0(mbufs[j + PREFETCH_OFFSET]);
 		PREFETCH0(rte_pktmbuf_mtod(mbufs[j + PREFETCH_OFFSET - 1], void *));
 #endif
-		out[j] = handle_routing(task, mbufs[j]);
+		out[j] = routing_parse(task, mbufs[j], &ip_offset[j], &dst_ip[j]);
 	}
 #ifdef PROX_PREFETCH_OFFSET
 	PREFETCH0(rte_pktmbuf_mtod(mbufs[n_pkts - 1], void *));
 	for (; j < n_pkts; ++j) {
-		out[j] = handle_routing(task, mbufs[j]);
+		out[j] = routing_parse(task, mbufs[j], &ip_offset[j], &dst_ip[j]);
 	}
 #endif
 
+	/* ... then look them all up at once, ... */
+	rte_lpm_lookup_bulk(task->ipv4_lpm, dst_ip, next_hop, n_pkts);
+
+	/* ... and finally update the packets that can be routed. */
+	for (j = 0; j < n_pkts; ++j) {
+		if (out[j] == OUT_DISCARD)
+			continue;
+		if (unlikely(!(next_hop[j] & RTE_LPM_LOOKUP_SUCCESS))) {
+			task->n_lpm_miss++;
+			out[j] = OUT_DISCARD;
+			continue;
+		}
+		out[j] = route_ipv4(task, mbufs[j], ip_offset[j], next_hop[j] & LPM_NEXT_HOP_MASK);
+	}
+
 	return task->base.tx_pkt(&task->base, mbufs, n_pkts, out);
 }
 
@@ -223,49 +242,42 @@ static void set_l2_mpls(struct task_routing *task, struct rte_mbuf *mbuf, uint8_
 	}
 }
 
-static uint8_t route_ipv4(struct task_routing *task, uint8_t *beg, uint32_t ip_offset, struct rte_mbuf *mbuf)
+/* Find the IPv4 header and the destination IP address (in host byte
+   order) used to route the packet. Returns OUT_DISCARD if the packet
+   can't be routed, 0 otherwise. */
+static uint8_t parse_ipv4(struct task_routing *task, uint8_t *beg, uint32_t ip_offset, uint32_t *dst_ip)
 {
 	struct ipv4_hdr *ip = (struct ipv4_hdr*)(beg + ip_offset);
-	struct ether_hdr *peth_out;
-	uint8_t tx_port;
-	uint32_t dst_ip;
 
 	if (unlikely(ip->version_ihl >> 4 != 4)) {
-                plog_warn("Offset: %d\n", ip_offset);
-		plog_warn("Expected to receive IPv4 packet but IP version was %d\n",
-			ip->version_ihl >> 4);
+		event_count(task->events, EVENT_ROUTING_NOT_IPV4);
 		return OUT_DISCARD;
 	}
 
 	switch(ip->next_proto_id) {
 	case IPPROTO_GRE: {
 		struct gre_hdr *pgre = (struct gre_hdr *)(ip + 1);
-		dst_ip = ((struct ipv4_hdr *)(pgre + 1))->dst_addr;
+		*dst_ip = rte_bswap32(((struct ipv4_hdr *)(pgre + 1))->dst_addr);
 		break;
 	}
 	case IPPROTO_TCP:
 	case IPPROTO_UDP:
-		dst_ip = ip->dst_addr;
+		*dst_ip = rte_bswap32(ip->dst_addr);
 		break;
 	default:
 		/* Routing for other protocols is not implemented */
 		return OUT_DISCARD;
 	}
+	return 0;
+}
 
-#if RTE_VERSION >= RTE_VERSION_NUM(16,4,0,1)
-	uint32_t next_hop_index;
-#else
-	uint8_t next_hop_index;
-#endif
-	if (unlikely(rte_lpm_lookup(task->ipv4_lpm, rte_bswap32(dst_ip), &next_hop_index) != 0)) {
-		uint8_t* dst_ipp = (uint8_t*)&dst_ip;
-		plog_warn("lpm_lookup failed for ip %d.%d.%d.%d: rc = %d\n",
-			dst_ipp[0], dst_ipp[1], dst_ipp[2], dst_ipp[3], -ENOENT);
-		return OUT_DISCARD;
-	}
+static uint8_t route_ipv4(struct task_routing *task, struct rte_mbuf *mbuf, uint32_t ip_offset, uint32_t next_hop_index)
+{
+	uint8_t tx_port;
 
 	tx_port = task->next_hops[next_hop_index].mac_port.out_idx;
 	if (task->runtime_flags & TASK_MPLS_TAGGING) {
+		struct ipv4_hdr *ip = (struct ipv4_hdr *)(rte_pktmbuf_mtod(mbuf, uint8_t *) + ip_offset);
 	        uint16_t padlen = rte_pktmbuf_pkt_len(mbuf) - rte_be_to_cpu_16(ip->total_length) - ip_offset;
 		if (padlen) {
 			rte_pktmbuf_trim(mbuf, padlen);
@@ -279,23 +291,27 @@ static uint8_t route_ipv4(struct task_routing *task, uint8_t *beg, uint32_t ip_o
 	return tx_port;
 }
 
-static inline uint8_t handle_routing(struct task_routing *task, struct rte_mbuf *mbuf)
+static inline uint8_t routing_parse(struct task_routing *task, struct rte_mbuf *mbuf, uint32_t *ip_offset, uint32_t *dst_ip)
 {
-	struct qinq_hdr *qinq;
 	struct ether_hdr *peth = rte_pktmbuf_mtod(mbuf, struct ether_hdr *);
 
+	/* Looked up even if the packet is discarded */
+	*dst_ip = 0;
+
 	switch (peth->ether_type) {
 	case ETYPE_8021ad: {
 		struct qinq_hdr *qinq = (struct qinq_hdr *)peth;
 		if ((qinq->cvlan.eth_proto != ETYPE_VLAN)) {
-			plog_warn("Unexpected proto in QinQ = %#04x\n", qinq->cvlan.eth_proto);
+			event_count(task->events, EVENT_ROUTING_BAD_QINQ);
 			return OUT_DISCARD;
 		}
 
-		return route_ipv4(task, (uint8_t*)qinq, sizeof(*qinq), mbuf);
+		*ip_offset = sizeof(*qinq);
+		break;
 	}
 	case ETYPE_IPv4:
-		return route_ipv4(task, (uint8_t*)peth, sizeof(*peth), mbuf);
+		*ip_offset = sizeof(*peth);
+		break;
 	case ETYPE_MPLSU: {
 		/* skip MPLS headers if any for routing */
 		struct mpls_hdr *mpls = (struct mpls_hdr *)(peth + 1);
@@ -306,21 +322,24 @@ static inline uint8_t handle_routing(struct task_routing *task, struct rte_mbuf
 		}
 		count += sizeof(struct mpls_hdr);
 
-		return route_ipv4(task, (uint8_t*)peth, count, mbuf);
+		*ip_offset = count;
+		break;
 	}
 	default:
 		if (peth->ether_type == task->qinq_tag) {
 			struct qinq_hdr *qinq = (struct qinq_hdr *)peth;
 			if ((qinq->cvlan.eth_proto != ETYPE_VLAN)) {
-				plog_warn("Unexpected proto in QinQ = %#04x\n", qinq->cvlan.eth_proto);
+				event_count(task->events, EVENT_ROUTING_BAD_QINQ);
 				return OUT_DISCARD;
 			}
 
-			return route_ipv4(task, (uint8_t*)qinq, sizeof(*qinq), mbuf);
+			*ip_offset = sizeof(*qinq);
+			break;
 		}
-		plog_warn("Failed routing packet: ether_type %#06x is unknown\n", peth->ether_type);
+		event_count(task->events, EVENT_ROUTING_UNKNOWN_ETYPE);
 		return OUT_DISCARD;
 	}
+	return parse_ipv4(task, (uint8_t *)peth, *ip_offset, dst_ip);
 }
 
 static struct task_init task_init_routing = {
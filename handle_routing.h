@@ -42,4 +42,9 @@ struct route_msg {
 	uint32_t nh;
 };
 
+struct task_base;
+
+/* Number of packets dropped because their destination was not found in the LPM */
+uint64_t task_routing_get_n_lpm_miss(struct task_base *tbase);
+
 #endif /* _HANDLE_ROUTING_H_ */
@@ -64,6 +64,11 @@ int heap_top_is_lower(struct heap *h, uint64_t prio)
 	return !heap_is_empty(h) && h->top->priority < prio;
 }
 
+uint64_t heap_top_priority(const struct heap *h)
+{
+	return heap_is_empty(h) ? UINT64_MAX : h->top->priority;
+}
+
 static int heap_elem_check(struct heap_elem *e, int is_top)
 {
 	if (!e)
@@ -58,6 +58,8 @@ static int heap_is_empty(const struct heap *h)
 }
 
 int heap_top_is_lower(struct heap *h, uint64_t prio);
+/* Returns the priority of the top element or UINT64_MAX if the heap is empty */
+uint64_t heap_top_priority(const struct heap *h);
 
 void heap_print(struct heap *h, char *result, size_t buf_len);
 
@@ -0,0 +1,251 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include <rte_cycles.h>
+#include <rte_common.h>
+
+#include "lat_stream.h"
+#include "handle_lat.h"
+#include "prox_malloc.h"
+#include "quit.h"
+#include "log.h"
+
+#define LAT_STREAM_MAX		64
+/* How long the writer sleeps when none of the rings had records */
+#define LAT_STREAM_IDLE_NSEC	1000000
+
+static struct lat_stream *lat_streams[LAT_STREAM_MAX];
+static volatile uint32_t n_lat_streams;
+static pthread_t lat_stream_writer;
+static int lat_stream_writer_started;
+static volatile int lat_stream_writer_quit;
+
+static void lat_stream_header_write(FILE *fp, uint32_t lcore_id, uint32_t task_id)
+{
+	struct lat_stream_header hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.hz = rte_get_tsc_hz();
+	hdr.lcore_id = lcore_id;
+	hdr.task_id = task_id;
+	hdr.tsc_shift = LATENCY_ACCURACY;
+	hdr.record_size = sizeof(struct lat_stream_record);
+	hdr.n_record_fields = sizeof(struct lat_stream_record)/sizeof(uint32_t);
+	for (uint32_t i = 0; i < hdr.n_record_fields; ++i)
+		hdr.record_field_size[i] = sizeof(uint32_t);
+
+	PROX_PANIC(fwrite(&hdr, sizeof(hdr), 1, fp) != 1, "Failed to write latency stream header\n");
+}
+
+static size_t lat_stream_drain(struct lat_stream *ls)
+{
+	uint32_t tail = ls->tail;
+	uint32_t head = ls->head;
+	uint32_t n = head - tail;
+
+	if (n == 0)
+		return 0;
+	/* Records must not be read before head */
+	rte_smp_rmb();
+
+	uint32_t idx = tail & ls->mask;
+	uint32_t n_first = RTE_MIN(n, ls->mask + 1 - idx);
+
+	size_t written = fwrite(&ls->records[idx], sizeof(ls->records[0]), n_first, ls->fp);
+	if (n_first < n)
+		written += fwrite(&ls->records[0], sizeof(ls->records[0]), n - n_first, ls->fp);
+	ls->n_write_failed += n - written;
+
+	/* Records must be copied before they can be overwritten */
+	rte_smp_mb();
+	ls->tail = head;
+	return n;
+}
+
+/* The lat task no longer adds records: write what is left, close
+   the file and publish the results for the master */
+static void lat_stream_writer_close(struct lat_stream *ls)
+{
+	lat_stream_drain(ls);
+	if (fflush(ls->fp) || ferror(ls->fp))
+		ls->n_write_failed++;
+	if (fclose(ls->fp))
+		ls->n_write_failed++;
+	ls->fp = NULL;
+	ls->last_dropped = ls->n_dropped - ls->drop_base;
+	ls->last_write_failed = ls->n_write_failed;
+	rte_smp_wmb();
+	ls->n_closed++;
+}
+
+/* The lat task started again: records are appended to the file */
+static void lat_stream_writer_open(struct lat_stream *ls)
+{
+	/* Records added before the file could be opened are lost */
+	ls->tail = ls->head;
+	ls->fp = fopen(ls->name, "a");
+	if (ls->fp == NULL) {
+		ls->open_failed = 1;
+		ls->n_open_failed++;
+		return;
+	}
+	ls->n_write_failed = 0;
+	ls->drop_base = ls->n_dropped;
+}
+
+static void *lat_stream_writer_main(void *arg)
+{
+	const struct timespec idle = {.tv_sec = 0, .tv_nsec = LAT_STREAM_IDLE_NSEC};
+	int need_flush = 0;
+
+	while (!lat_stream_writer_quit) {
+		size_t n = 0;
+
+		for (uint32_t i = 0; i < n_lat_streams; ++i) {
+			struct lat_stream *ls = lat_streams[i];
+
+			if (!ls->want_open) {
+				ls->open_failed = 0;
+				if (ls->fp)
+					lat_stream_writer_close(ls);
+			} else if (ls->fp) {
+				n += lat_stream_drain(ls);
+			} else if (!ls->open_failed) {
+				lat_stream_writer_open(ls);
+			} else {
+				/* Nowhere to write to: free the ring */
+				ls->tail = ls->head;
+			}
+		}
+
+		if (n) {
+			need_flush = 1;
+			continue;
+		}
+		if (need_flush) {
+			for (uint32_t i = 0; i < n_lat_streams; ++i) {
+				struct lat_stream *ls = lat_streams[i];
+
+				if (ls->fp && fflush(ls->fp))
+					ls->n_write_failed++;
+			}
+			need_flush = 0;
+		}
+		nanosleep(&idle, NULL);
+	}
+
+	for (uint32_t i = 0; i < n_lat_streams; ++i) {
+		if (lat_streams[i]->fp)
+			lat_stream_writer_close(lat_streams[i]);
+	}
+	return NULL;
+}
+
+void lat_stream_stop(struct lat_stream *ls)
+{
+	ls->want_open = 0;
+}
+
+void lat_stream_start(struct lat_stream *ls)
+{
+	ls->want_open = 1;
+}
+
+void lat_stream_report(void)
+{
+	for (uint32_t i = 0; i < n_lat_streams; ++i) {
+		struct lat_stream *ls = lat_streams[i];
+		uint32_t n_closed = ls->n_closed;
+		uint32_t n_open_failed = ls->n_open_failed;
+
+		if (n_open_failed != ls->n_open_failed_reported) {
+			plog_err("Failed to reopen %s, latency records are not streamed\n", ls->name);
+			ls->n_open_failed_reported = n_open_failed;
+		}
+		if (n_closed == ls->n_closed_reported)
+			continue;
+		rte_smp_rmb();
+		if (ls->last_dropped)
+			plog_warn("Latency stream dropped %"PRIu64" records, writer could not keep up\n", ls->last_dropped);
+		if (ls->last_write_failed)
+			plog_err("Failed to write %"PRIu64" records to %s\n", ls->last_write_failed, ls->name);
+		ls->n_closed_reported = n_closed;
+	}
+}
+
+void lat_stream_exit(void)
+{
+	if (!lat_stream_writer_started)
+		return;
+	lat_stream_writer_quit = 1;
+	pthread_join(lat_stream_writer, NULL);
+	lat_stream_writer_started = 0;
+	lat_stream_report();
+}
+
+struct lat_stream *lat_stream_create(uint32_t lcore_id, uint32_t task_id, uint32_t n_records, int socket_id)
+{
+	struct lat_stream *ls;
+	size_t mem_size;
+
+	PROX_PANIC(n_lat_streams == LAT_STREAM_MAX, "Too many latency streams, max is %u\n", LAT_STREAM_MAX);
+	PROX_PANIC(n_records > (1U << 31), "Latency stream size too big\n");
+
+	n_records = rte_align32pow2(n_records);
+	mem_size = sizeof(*ls) + n_records * sizeof(ls->records[0]);
+	ls = prox_zmalloc(mem_size, socket_id);
+	PROX_PANIC(ls == NULL, "Failed to allocate %zu kbytes for latency stream\n", mem_size / 1024);
+	ls->mask = n_records - 1;
+
+	snprintf(ls->name, sizeof(ls->name), "latency.stream_%u_%u.bin", lcore_id, task_id);
+	ls->fp = fopen(ls->name, "w+");
+	PROX_PANIC(ls->fp == NULL, "Failed to open %s\n", ls->name);
+	lat_stream_header_write(ls->fp, lcore_id, task_id);
+	ls->want_open = 1;
+
+	lat_streams[n_lat_streams] = ls;
+	rte_smp_wmb();
+	n_lat_streams++;
+
+	/* The writer inherits the CPU affinity of the master core */
+	if (!lat_stream_writer_started) {
+		PROX_PANIC(pthread_create(&lat_stream_writer, NULL, lat_stream_writer_main, NULL),
+			   "Failed to start latency stream writer\n");
+		lat_stream_writer_started = 1;
+	}
+	plog_info("\tStreaming latency records to %s (%u records buffered)\n", ls->name, n_records);
+	return ls;
+}
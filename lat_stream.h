@@ -0,0 +1,127 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _LAT_STREAM_H_
+#define _LAT_STREAM_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <rte_memory.h>
+#include <rte_atomic.h>
+
+/* Continuous export of per-packet latency records. Each lat task
+   pushes records into its own single producer/single consumer ring
+   and a writer thread, running next to the master core, appends them
+   to a binary file while traffic keeps running. The file starts with
+   a struct lat_stream_header followed by fixed size records so that
+   it can be mmap'ed and processed offline. */
+
+struct lat_stream_header {
+	uint64_t hz;
+	uint32_t lcore_id;
+	uint32_t task_id;
+	uint32_t tsc_shift;          /* times and errors are in units of (1 << tsc_shift) tsc */
+	uint32_t record_size;
+	uint32_t n_record_fields;
+	uint8_t  record_field_size[36];
+};
+
+struct lat_stream_record {
+	uint32_t rx_packet_index;
+	uint32_t tx_packet_index;
+	uint32_t generator_id;
+	uint32_t rx_time;
+	uint32_t tx_time;
+	uint32_t rx_err;
+	uint32_t tx_err;
+};
+
+struct lat_stream {
+	/* Written by the lat task only */
+	volatile uint32_t head __rte_cache_aligned;
+	uint32_t tail_cache;
+	uint32_t mask;
+	uint64_t n_dropped;
+	/* Set while the lat task runs. The writer opens and closes the
+	   file to match, so that no file I/O is done by the task. */
+	volatile int want_open;
+	char name[64];
+	/* Written by the writer thread only */
+	volatile uint32_t tail __rte_cache_aligned;
+	FILE *fp;
+	int open_failed;
+	uint64_t n_write_failed;
+	uint64_t drop_base;
+	/* Results of the last run, reported by the master once
+	   n_closed has changed */
+	uint64_t last_dropped;
+	uint64_t last_write_failed;
+	volatile uint32_t n_closed;
+	volatile uint32_t n_open_failed;
+	/* Written by the master only */
+	uint32_t n_closed_reported;
+	uint32_t n_open_failed_reported;
+	struct lat_stream_record records[0] __rte_cache_aligned;
+};
+
+struct lat_stream *lat_stream_create(uint32_t lcore_id, uint32_t task_id, uint32_t n_records, int socket_id);
+/* Called by the lat task when it stops: the writer writes the
+   records left and closes the file. Does not wait. */
+void lat_stream_stop(struct lat_stream *ls);
+/* Called by the lat task when it starts again: the writer reopens
+   the file and records are appended */
+void lat_stream_start(struct lat_stream *ls);
+/* Called periodically by the master to log lost records */
+void lat_stream_report(void);
+/* Called by the master on exit: closes all files and joins the
+   writer thread */
+void lat_stream_exit(void);
+
+/* Records are dropped (and counted) if the writer can't keep up */
+static inline void lat_stream_add(struct lat_stream *ls, const struct lat_stream_record *rec)
+{
+	uint32_t head = ls->head;
+
+	if (head - ls->tail_cache > ls->mask) {
+		ls->tail_cache = ls->tail;
+		if (head - ls->tail_cache > ls->mask) {
+			ls->n_dropped++;
+			return;
+		}
+	}
+	ls->records[head & ls->mask] = *rec;
+	rte_smp_wmb();
+	ls->head = head + 1;
+}
+
+#endif /* _LAT_STREAM_H_ */
@@ -30,6 +30,8 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <rte_launch.h>
+
 #include "prox_malloc.h"
 #include "lconf.h"
 #include "rx_pkt.h"
@@ -37,6 +39,7 @@
 #include "log.h"
 #include "quit.h"
 #include "prox_cfg.h"
+#include "clock.h"
 
 struct lcore_cfg *lcore_cfg;
 /* only used at initialization time */
@@ -98,6 +101,18 @@ void lcore_cfg_alloc_hp(void)
 	lcore_cfg[rte_lcore_id()].thread_id = pthread_self();
 }
 
+void lconf_add_tsc_task(struct lcore_cfg *lconf, uint64_t (*tsc_task)(struct lcore_cfg *lconf, void *data), void *data, uint64_t timeout)
+{
+	PROX_PANIC(lconf->n_tsc_tasks == MAX_TSC_TASKS_PER_CORE, "Too many tsc tasks on core %u (max %d)\n", lconf->id, MAX_TSC_TASKS_PER_CORE);
+
+	struct tsc_task *t = &lconf->tsc_tasks[lconf->n_tsc_tasks++];
+
+	t->heap_ref.elem = NULL;
+	t->start_timeout = timeout;
+	t->tsc_task = tsc_task;
+	t->data = data;
+}
+
 int lconf_run(__attribute__((unused)) void *dummy)
 {
 	uint32_t lcore_id = rte_lcore_id();
@@ -113,12 +128,36 @@ int lconf_run(__attribute__((unused)) void *dummy)
 	return lconf->thread_x(lconf);
 }
 
-static void msg_stop(struct lcore_cfg *lconf)
+/* Installed in place of handle_bulk while cycle accounting is active */
+static int handle_bulk_cycles(struct task_base *tbase, struct rte_mbuf **mbufs, const uint16_t n_pkts)
+{
+	struct lcore_cfg *lconf = &lcore_cfg[rte_lcore_id()];
+	struct task_rt_cycles *rt_cycles = &tbase->aux->rt_cycles;
+
+	if (lconf->in_cycles)
+		return tbase->aux->handle_bulk_orig(tbase, mbufs, n_pkts);
+
+	lconf->in_cycles = 1;
+	uint64_t before = rte_rdtsc();
+	int ret = tbase->aux->handle_bulk_orig(tbase, mbufs, n_pkts);
+	uint64_t cycles = rte_rdtsc() - before;
+	uint16_t bucket = n_pkts < MAX_RING_BURST ? n_pkts : MAX_RING_BURST;
+	lconf->in_cycles = 0;
+
+	cycles = cycles > rdtsc_overhead ? cycles - rdtsc_overhead : 0;
+	rt_cycles->calls[bucket]++;
+	rt_cycles->cycles[bucket] += cycles;
+	rt_cycles->tot_pkts += n_pkts;
+	rt_cycles->tot_cycles += cycles;
+	return ret;
+}
+
+static void msg_stop(struct lcore_cfg *lconf, const struct lconf_msg *msg)
 {
 	int idx = -1;
 	struct task_base *t = NULL;
 
-	if (lconf->msg.task_id == -1) {
+	if (msg->task_id == -1) {
 		for (int i = 0; i < lconf->n_tasks_all; ++i) {
 			if (lconf->task_is_running[i]) {
 				lconf->task_is_running[i] = 0;
@@ -134,7 +173,7 @@ static void msg_stop(struct lcore_cfg *lconf)
 	}
 	else {
 		for (int i = 0; i < lconf->n_tasks_run; ++i) {
-			if (lconf_get_task_id(lconf, lconf->tasks_run[i]) == lconf->msg.task_id) {
+			if (lconf_get_task_id(lconf, lconf->tasks_run[i]) == msg->task_id) {
 				idx = i;
 			}
 			else if (idx != -1) {
@@ -143,9 +182,9 @@ static void msg_stop(struct lcore_cfg *lconf)
 				idx++;
 			}
 		}
-		lconf->task_is_running[lconf->msg.task_id] = 0;
+		lconf->task_is_running[msg->task_id] = 0;
 
-		t = lconf->tasks_all[lconf->msg.task_id];
+		t = lconf->tasks_all[msg->task_id];
 		if (t->aux->stop)
 			t->aux->stop(t);
 		lconf->n_tasks_run--;
@@ -154,12 +193,12 @@ static void msg_stop(struct lcore_cfg *lconf)
 	}
 }
 
-static void msg_start(struct lcore_cfg *lconf)
+static void msg_start(struct lcore_cfg *lconf, const struct lconf_msg *msg)
 {
 	int idx = 1;
 	struct task_base *t = NULL;
 
-	if (lconf->msg.task_id == -1) {
+	if (msg->task_id == -1) {
 		for (int i = 0; i < lconf->n_tasks_all; ++i) {
 			t = lconf->tasks_run[i] = lconf->tasks_all[i];
 			lconf->task_is_running[i] = 1;
@@ -173,9 +212,9 @@ static void msg_start(struct lcore_cfg *lconf)
 		lconf->n_tasks_run = lconf->n_tasks_all;
 	}
 	else if (lconf->n_tasks_run == 0) {
-		t = lconf->tasks_run[0] = lconf->tasks_all[lconf->msg.task_id];
+		t = lconf->tasks_run[0] = lconf->tasks_all[msg->task_id];
 		lconf->n_tasks_run = 1;
-		lconf->task_is_running[lconf->msg.task_id] = 1;
+		lconf->task_is_running[msg->task_id] = 1;
 
 		if (t->aux->start_first)
 			t->aux->start_first(t);
@@ -185,60 +224,60 @@ static void msg_start(struct lcore_cfg *lconf)
 	else {
 		for (int i = lconf->n_tasks_run - 1; i >= 0; --i) {
 			idx = lconf_get_task_id(lconf, lconf->tasks_run[i]);
-			if (idx == lconf->msg.task_id) {
+			if (idx == msg->task_id) {
 				break;
 			}
-			else if (idx > lconf->msg.task_id) {
+			else if (idx > msg->task_id) {
 				lconf->tasks_run[i + 1] = lconf->tasks_run[i];
 				if (i == 0) {
-					lconf->tasks_run[i] = lconf->tasks_all[lconf->msg.task_id];
+					lconf->tasks_run[i] = lconf->tasks_all[msg->task_id];
 					lconf->n_tasks_run++;
 					break;
 				}
 			}
 			else {
-				lconf->tasks_run[i + 1] = lconf->tasks_all[lconf->msg.task_id];
+				lconf->tasks_run[i + 1] = lconf->tasks_all[msg->task_id];
 				lconf->n_tasks_run++;
 				break;
 			}
 		}
-		lconf->task_is_running[lconf->msg.task_id] = 1;
+		lconf->task_is_running[msg->task_id] = 1;
 
-		if (lconf->tasks_all[lconf->msg.task_id]->aux->start)
-			lconf->tasks_all[lconf->msg.task_id]->aux->start(lconf->tasks_all[lconf->msg.task_id]);
+		if (lconf->tasks_all[msg->task_id]->aux->start)
+			lconf->tasks_all[msg->task_id]->aux->start(lconf->tasks_all[msg->task_id]);
 	}
 }
 
-int lconf_do_flags(struct lcore_cfg *lconf)
+static int lconf_handle_msg(struct lcore_cfg *lconf, const struct lconf_msg *msg)
 {
 	struct task_base *t;
 	int ret = 0;
 
-	switch (lconf->msg.type) {
+	switch (msg->type) {
 	case LCONF_MSG_STOP:
-		msg_stop(lconf);
+		msg_stop(lconf, msg);
 		ret = -1;
 		break;
 	case LCONF_MSG_START:
-		msg_start(lconf);
+		msg_start(lconf, msg);
 		ret = -1;
 		break;
 	case LCONF_MSG_DUMP_RX:
 	case LCONF_MSG_DUMP_TX:
 	case LCONF_MSG_DUMP:
-		t = lconf->tasks_all[lconf->msg.task_id];
+		t = lconf->tasks_all[msg->task_id];
 
-		if (lconf->msg.val) {
-			if (lconf->msg.type == LCONF_MSG_DUMP ||
-			    lconf->msg.type == LCONF_MSG_DUMP_RX) {
-				t->aux->task_rt_dump.n_print_rx = lconf->msg.val;
+		if (msg->val) {
+			if (msg->type == LCONF_MSG_DUMP ||
+			    msg->type == LCONF_MSG_DUMP_RX) {
+				t->aux->task_rt_dump.n_print_rx = msg->val;
 
 				task_base_add_rx_pkt_function(t, rx_pkt_dump);
 			}
 
-			if (lconf->msg.type == LCONF_MSG_DUMP ||
-			    lconf->msg.type == LCONF_MSG_DUMP_TX) {
-				t->aux->task_rt_dump.n_print_tx = lconf->msg.val;
+			if (msg->type == LCONF_MSG_DUMP ||
+			    msg->type == LCONF_MSG_DUMP_TX) {
+				t->aux->task_rt_dump.n_print_tx = msg->val;
 				if (t->tx_pkt == tx_pkt_l3) {
 					if (t->aux->tx_pkt_orig)
 						t->aux->tx_pkt_l2 = t->aux->tx_pkt_orig;
@@ -254,10 +293,10 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 		}
 		break;
 	case LCONF_MSG_TRACE:
-		t = lconf->tasks_all[lconf->msg.task_id];
+		t = lconf->tasks_all[msg->task_id];
 
-		if (lconf->msg.val) {
-			t->aux->task_rt_dump.n_trace = lconf->msg.val;
+		if (msg->val) {
+			t->aux->task_rt_dump.n_trace = msg->val;
 
 			if (task_base_get_original_rx_pkt_function(t) != rx_pkt_dummy) {
 				task_base_add_rx_pkt_function(t, rx_pkt_trace);
@@ -273,7 +312,7 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 					t->tx_pkt = tx_pkt_trace;
 				}
 			} else {
-				t->aux->task_rt_dump.n_print_tx = lconf->msg.val;
+				t->aux->task_rt_dump.n_print_tx = msg->val;
 				if (t->tx_pkt == tx_pkt_l3) {
 					if (t->aux->tx_pkt_orig)
 						t->aux->tx_pkt_l2 = t->aux->tx_pkt_orig;
@@ -390,12 +429,75 @@ int lconf_do_flags(struct lcore_cfg *lconf)
 			}
 		}
 		break;
+	case LCONF_MSG_CYCLES_START:
+		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			t = lconf->tasks_all[task_id];
+			memset(&t->aux->rt_cycles, 0, sizeof(t->aux->rt_cycles));
+			if (t->handle_bulk != handle_bulk_cycles) {
+				t->aux->handle_bulk_orig = t->handle_bulk;
+				t->handle_bulk = handle_bulk_cycles;
+			}
+		}
+		lconf->flags |= LCONF_FLAG_CYCLES_ACTIVE;
+		break;
+	case LCONF_MSG_CYCLES_STOP:
+		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			t = lconf->tasks_all[task_id];
+			/* handle_bulk might have been changed by the task itself in the meantime */
+			if (t->handle_bulk == handle_bulk_cycles)
+				t->handle_bulk = t->aux->handle_bulk_orig;
+			t->aux->handle_bulk_orig = NULL;
+		}
+		lconf->flags &= ~LCONF_FLAG_CYCLES_ACTIVE;
+		break;
+	case LCONF_MSG_CYCLES_RESET:
+		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+			t = lconf->tasks_all[task_id];
+
+			memset(&t->aux->rt_cycles, 0, sizeof(t->aux->rt_cycles));
+		}
+		break;
+	case LCONF_MSG_TASK_SET:
+		msg->task_set(lconf->tasks_all[msg->task_id], msg->val64);
+		break;
+	case LCONF_MSG_QUIESCE:
+		break;
 	}
 
-	lconf_unset_req(lconf);
 	return ret;
 }
 
+int lconf_do_flags(struct lcore_cfg *lconf)
+{
+	struct lconf_msg *msg;
+	int ret = 0;
+
+	while ((msg = lconf_peek_msg(lconf)) != NULL) {
+		if (lconf_handle_msg(lconf, msg))
+			ret = -1;
+		lconf_msg_done(lconf);
+	}
+	return ret;
+}
+
+int lconf_is_launched(const struct lcore_cfg *lconf)
+{
+	/* LCONF_FLAG_RUNNING is only cleared once the thread has been
+	   waited for, but a stop or start that timed out can leave it
+	   out of sync: check the lcore as well. */
+	return (lconf->flags & LCONF_FLAG_RUNNING) ||
+		rte_eal_get_lcore_state(lconf->id) == RUNNING;
+}
+
+int lconf_send_msg(struct lcore_cfg *lconf, const struct lconf_msg *msg)
+{
+	if (lconf_post_msg(lconf, msg))
+		return -1;
+	if (!lconf_is_launched(lconf))
+		lconf_do_flags(lconf);
+	return 0;
+}
+
 int lconf_get_task_id(const struct lcore_cfg *lconf, const struct task_base *task)
 {
 	for (int i = 0; i < lconf->n_tasks_all; ++i) {
@@ -33,8 +33,14 @@
 #ifndef _LCONF_H_
 #define _LCONF_H_
 
+#include <stddef.h>
+
+#include <rte_atomic.h>
+
 #include "task_init.h"
 #include "stats.h"
+#include "heap.h"
+#include "stats_core.h"
 
 enum lconf_msg_type {
 	LCONF_MSG_STOP,
@@ -53,34 +59,81 @@ enum lconf_msg_type {
 	LCONF_MSG_RX_BW_STOP,
 	LCONF_MSG_TX_BW_START,
 	LCONF_MSG_TX_BW_STOP,
+	LCONF_MSG_CYCLES_START,
+	LCONF_MSG_CYCLES_STOP,
+	LCONF_MSG_CYCLES_RESET,
+	LCONF_MSG_TASK_SET,
+	/* Does nothing. Once handled, the core is known to have
+	   finished any bulk of packets started before it was sent. */
+	LCONF_MSG_QUIESCE,
 };
 
 struct lconf_msg {
-	/* Set by master core (if not set), unset by worker after consumption. */
-	uint32_t            req;
 	enum lconf_msg_type type;
 	int                 task_id;
 	int                 val;
+	/* LCONF_MSG_TASK_SET: task_set is called on the core running
+	   the task, with val64 as argument. */
+	uint64_t            val64;
+	void (*task_set)(struct task_base *tbase, uint64_t val);
+};
+
+#define LCONF_MSG_RING_SIZE 64
+
+/* Commands sent to a core. The master core is the only producer and
+   the worker the only consumer. head and tail are free running: tail
+   is only incremented once the message has been handled, so that
+   head == tail means all commands have been executed. */
+struct lconf_msg_ring {
+	uint32_t            head;
+	uint32_t            tail;
+	struct lconf_msg    msgs[LCONF_MSG_RING_SIZE];
+};
+
+struct lcore_cfg;
+
+/* A tsc_task is a callback executed from the housekeeping part of
+   the main loop once its deadline has passed. The value returned by
+   the callback is the number of cycles after the previous deadline at
+   which it has to be executed again. Returning TSC_TASK_STOP
+   unschedules the tsc_task. */
+#define TSC_TASK_STOP ((uint64_t)-1)
+
+struct tsc_task {
+	struct heap_ref heap_ref;   /* Back reference into heap */
+	uint64_t        tsc;
+	uint64_t        start_timeout; /* first run, relative to core start */
+	uint64_t (*tsc_task)(struct lcore_cfg *lconf, void *data);
+	void            *data;
 };
 
+#define TSC_TASK_UPCAST(r) ((struct tsc_task *)((uint8_t *)r - offsetof(struct tsc_task, heap_ref)))
+
 #define LCONF_FLAG_RX_DISTR_ACTIVE 0x00000001
 #define LCONF_FLAG_RUNNING         0x00000002
 #define LCONF_FLAG_TX_DISTR_ACTIVE 0x00000004
 #define LCONF_FLAG_RX_BW_ACTIVE    0x00000008
 #define LCONF_FLAG_TX_BW_ACTIVE    0x00000010
+#define LCONF_FLAG_ADAPTIVE_POLL   0x00000020
+#define LCONF_FLAG_CYCLES_ACTIVE   0x00000040
+
+/* What a core does when a loop iteration did not receive any packet */
+enum lconf_idle_mode {
+	IDLE_MODE_NONE,  /* busy poll */
+	IDLE_MODE_PAUSE, /* escalating pause loop */
+	IDLE_MODE_SLEEP, /* escalating pause loop, then yield the CPU */
+};
 
 struct lcore_cfg {
 	/* All tasks running at the moment. This is empty when the core is stopped. */
 	struct task_base	*tasks_run[MAX_TASKS_PER_CORE];
 	uint8_t			n_tasks_run;
+	/* Set while handle_bulk_cycles() runs: tasks reached through
+	   tx_opt_ring are accounted to the outermost task only */
+	uint8_t			in_cycles;
 
 	void (*flush_queues[MAX_TASKS_PER_CORE])(struct task_base *tbase);
 
-	void (*period_func)(void *data);
-	void                    *period_data;
-	/* call periodic_func after periodic_timeout cycles */
-	uint64_t                period_timeout;
-
 	uint64_t                ctrl_timeout;
 	void (*ctrl_func_m[MAX_TASKS_PER_CORE])(struct task_base *tbase, void **data, uint16_t n_msgs);
 	struct rte_ring         *ctrl_rings_m[MAX_TASKS_PER_CORE];
@@ -88,13 +141,13 @@ struct lcore_cfg {
 	void (*ctrl_func_p[MAX_TASKS_PER_CORE])(struct task_base *tbase, struct rte_mbuf **mbufs, uint16_t n_pkts);
 	struct rte_ring         *ctrl_rings_p[MAX_TASKS_PER_CORE];
 
-	struct lconf_msg        msg __attribute__((aligned(4)));
 	struct task_base	*tasks_all[MAX_TASKS_PER_CORE];
 	int                     task_is_running[MAX_TASKS_PER_CORE];
 	uint8_t			n_tasks_all;
 	pthread_t		thread_id;
 
 	/* Following variables are not accessed in main loop */
+	struct lconf_msg_ring   msg_ring;
 	uint32_t		flags;
 	uint8_t			active_task;
 	uint8_t			id;
@@ -102,6 +155,16 @@ struct lcore_cfg {
 	struct task_args        targs[MAX_TASKS_PER_CORE];
 	int (*thread_x)(struct lcore_cfg *lconf);
 	uint32_t		cache_set;
+	/* Upper bound on the number of loop iterations an idle task
+	   is skipped when LCONF_FLAG_ADAPTIVE_POLL is set */
+	uint32_t		max_poll_skip;
+	enum lconf_idle_mode	idle_mode;
+	/* Upper bound on the time spent idle before polling again */
+	uint32_t		max_idle_us;
+	struct lcore_rt_stats	rt_stats;
+	/* tsc_tasks registered by tasks at init time */
+	struct tsc_task         tsc_tasks[MAX_TSC_TASKS_PER_CORE];
+	uint8_t                 n_tsc_tasks;
 } __rte_cache_aligned;
 
 extern struct lcore_cfg     *lcore_cfg;
@@ -123,24 +186,92 @@ static inline void lconf_flush_all_queues(struct lcore_cfg *lconf)
 	}
 }
 
-static inline void lconf_set_req(struct lcore_cfg *lconf)
+/* Make the stats of all tasks visible to the stats core, for updates
+   done outside of the handling of a bulk (flush, tsc_tasks, ...) */
+static inline void lconf_publish_stats(struct lcore_cfg *lconf)
 {
-	(*(volatile uint32_t *)&lconf->msg.req) = 1;
+	for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
+		struct task_base_aux *aux = lconf->tasks_all[task_id]->aux;
+
+		task_stats_publish(&aux->stats_pub, &aux->stats);
+	}
 }
 
-static inline void lconf_unset_req(struct lcore_cfg *lconf)
+/* Returns the number of commands that have not been handled yet */
+static inline uint32_t lconf_n_req(struct lcore_cfg *lconf)
 {
-	(*(volatile uint32_t *)&lconf->msg.req) = 0;
+	return (*(volatile uint32_t *)&lconf->msg_ring.head) - (*(volatile uint32_t *)&lconf->msg_ring.tail);
 }
 
 static inline int lconf_is_req(struct lcore_cfg *lconf)
 {
-	return (*(volatile uint32_t *)&lconf->msg.req);
+	return lconf_n_req(lconf) != 0;
 }
 
-/* Returns non-zero when terminate has been requested */
+/* Queue a command for the core. Only to be called from the master
+   core. Returns -1 if too many commands are pending. */
+static inline int lconf_post_msg(struct lcore_cfg *lconf, const struct lconf_msg *msg)
+{
+	struct lconf_msg_ring *ring = &lconf->msg_ring;
+	uint32_t head = ring->head;
+
+	if (lconf_n_req(lconf) == LCONF_MSG_RING_SIZE)
+		return -1;
+	ring->msgs[head & (LCONF_MSG_RING_SIZE - 1)] = *msg;
+	rte_wmb();
+	(*(volatile uint32_t *)&ring->head) = head + 1;
+	return 0;
+}
+
+/* Returns the oldest command not handled yet, or NULL */
+static inline struct lconf_msg *lconf_peek_msg(struct lcore_cfg *lconf)
+{
+	if (!lconf_is_req(lconf))
+		return NULL;
+	rte_rmb();
+	return &lconf->msg_ring.msgs[lconf->msg_ring.tail & (LCONF_MSG_RING_SIZE - 1)];
+}
+
+/* Mark the command returned by lconf_peek_msg() as handled */
+static inline void lconf_msg_done(struct lcore_cfg *lconf)
+{
+	rte_wmb();
+	(*(volatile uint32_t *)&lconf->msg_ring.tail) = lconf->msg_ring.tail + 1;
+}
+
+/* Returns a value identifying the commands posted so far, to be
+   passed to lconf_msg_seq_done() */
+static inline uint32_t lconf_msg_seq(const struct lcore_cfg *lconf)
+{
+	return lconf->msg_ring.head;
+}
+
+/* Returns non-zero once all commands posted before seq was taken
+   have been handled */
+static inline int lconf_msg_seq_done(const struct lcore_cfg *lconf, uint32_t seq)
+{
+	return (int32_t)((*(const volatile uint32_t *)&lconf->msg_ring.tail) - seq) >= 0;
+}
+
+/* Register a tsc_task to be run for the first time timeout cycles
+   after the core has started. Only to be called at init time. */
+void lconf_add_tsc_task(struct lcore_cfg *lconf, uint64_t (*tsc_task)(struct lcore_cfg *lconf, void *data), void *data, uint64_t timeout);
+
+/* Handle all pending commands. Returns non-zero when the set of
+   running tasks has changed. */
 int lconf_do_flags(struct lcore_cfg *lconf);
 
+/* Returns non-zero if a thread has been launched on the core, and
+   might still be consuming its commands. Only to be called from the
+   master core. */
+int lconf_is_launched(const struct lcore_cfg *lconf);
+
+/* Queue a command for the core. If no thread has been launched on
+   the core, the command is handled directly so that the mailbox
+   never has two consumers. Only to be called from the master core.
+   Returns -1 if too many commands are pending. */
+int lconf_send_msg(struct lcore_cfg *lconf, const struct lconf_msg *msg);
+
 int lconf_get_task_id(const struct lcore_cfg *lconf, const struct task_base *task);
 int lconf_task_is_running(const struct lcore_cfg *lconf, uint8_t task_id);
 
@@ -34,6 +34,9 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <string.h>
+#include <rte_common.h>
+#include <rte_atomic.h>
+#include <rte_memory.h>
 #include <rte_cycles.h>
 #include <rte_lcore.h>
 #include <rte_ether.h>
@@ -45,6 +48,36 @@
 #include "defaults.h"
 #include "etypes.h"
 #include "prox_cfg.h"
+#include "prox_malloc.h"
+
+/* Messages logged by worker cores are not written by the core itself:
+   they are copied, as fixed size records, into a single
+   producer/single consumer ring per core. The master drains the rings
+   and does the file and display output, see plog_drain(). A message
+   longer than one record spans consecutive records. When a ring is
+   full the message is dropped and counted. */
+#define LOG_RING_SIZE		256
+#define LOG_REC_TEXT		240
+
+struct log_rec {
+	uint8_t lvl;
+	uint8_t last;           /* last record of the message */
+	uint16_t len;
+	char text[LOG_REC_TEXT];
+};
+
+struct log_ring {
+	/* Written by the worker core only */
+	volatile uint32_t head __rte_cache_aligned;
+	uint64_t n_dropped;
+	/* Written by the draining core only */
+	volatile uint32_t tail __rte_cache_aligned;
+	uint64_t n_dropped_reported;
+	struct log_rec recs[LOG_RING_SIZE] __rte_cache_aligned;
+};
+
+static struct log_ring *log_rings[RTE_MAX_LCORE];
+static pthread_mutex_t drain_mtx = PTHREAD_MUTEX_INITIALIZER;
 
 static pthread_mutex_t file_mtx = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
 int log_lvl = PROX_MAX_LOG_LVL;
@@ -146,6 +179,99 @@ static void plog_buf(const char* buf)
 	}
 }
 
+/* Returns 0 if the message was queued for the master or dropped, -1 if
+   it must be written by the caller. */
+static int plog_async(int lvl, const char *buf, size_t len)
+{
+	unsigned lcore_id = rte_lcore_id();
+	struct log_ring *ring;
+
+	if (lcore_id >= RTE_MAX_LCORE || (ring = log_rings[lcore_id]) == NULL)
+		return -1;
+
+	uint32_t n_recs = len ? (len + LOG_REC_TEXT - 1) / LOG_REC_TEXT : 1;
+	uint32_t head = ring->head;
+
+	if (n_recs > LOG_RING_SIZE - (head - ring->tail)) {
+		ring->n_dropped++;
+		return 0;
+	}
+	for (uint32_t i = 0; i < n_recs; i++) {
+		struct log_rec *rec = &ring->recs[(head + i) & (LOG_RING_SIZE - 1)];
+		size_t rec_len = RTE_MIN(len - i * LOG_REC_TEXT, (size_t)LOG_REC_TEXT);
+
+		rec->lvl = lvl;
+		rec->last = i == n_recs - 1;
+		rec->len = rec_len;
+		memcpy(rec->text, buf + i * LOG_REC_TEXT, rec_len);
+	}
+	rte_smp_wmb();
+	ring->head = head + n_recs;
+	return 0;
+}
+
+void plog_async_init(void)
+{
+	uint32_t lcore_id = -1;
+
+	while (prox_core_next(&lcore_id, 0) == 0) {
+		if (log_rings[lcore_id])
+			continue;
+		log_rings[lcore_id] = prox_zmalloc(sizeof(struct log_ring), rte_lcore_to_socket_id(lcore_id));
+		/* Without a ring, the core keeps writing the log itself */
+		if (log_rings[lcore_id] == NULL)
+			plog_warn("Failed to allocate log ring for core %u\n", lcore_id);
+	}
+}
+
+void plog_drain(void)
+{
+	static char msg[32768];
+	static size_t msg_len;
+	char buf[128];
+
+	pthread_mutex_lock(&drain_mtx);
+	for (uint32_t lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		struct log_ring *ring = log_rings[lcore_id];
+
+		if (ring == NULL)
+			continue;
+
+		uint32_t head = ring->head;
+		uint32_t tail = ring->tail;
+
+		rte_smp_rmb();
+		while (tail != head) {
+			struct log_rec *rec = &ring->recs[tail & (LOG_RING_SIZE - 1)];
+
+			if (msg_len + rec->len < sizeof(msg)) {
+				memcpy(msg + msg_len, rec->text, rec->len);
+				msg_len += rec->len;
+			}
+			if (rec->last) {
+				msg[msg_len] = 0;
+				plog_buf(msg);
+				if (rec->lvl == PROX_LOG_WARN)
+					store_warning(msg);
+				msg_len = 0;
+			}
+			tail++;
+		}
+		rte_smp_mb();
+		ring->tail = tail;
+
+		uint64_t n_dropped = ring->n_dropped;
+
+		if (n_dropped != ring->n_dropped_reported) {
+			snprintf(buf, sizeof(buf), "warn %"PRIu64" log messages from core %u were dropped, log ring full\n",
+				 n_dropped - ring->n_dropped_reported, lcore_id);
+			plog_buf(buf);
+			ring->n_dropped_reported = n_dropped;
+		}
+	}
+	pthread_mutex_unlock(&drain_mtx);
+}
+
 static const char* lvl_to_str(int lvl, int always)
 {
 	switch (lvl) {
@@ -220,6 +346,9 @@ static int vplog(int lvl, const char *format, va_list ap, const struct rte_mbuf
 		ret--;
 		ret += dump_pkt(buf + ret, sizeof(buf) - ret, mbuf);
 	}
+	if (plog_async(lvl, buf, strlen(buf)) == 0)
+		return ret;
+
 	plog_buf(buf);
 
 	if (lvl == PROX_LOG_WARN) {
@@ -97,6 +97,10 @@ __attribute__((format(printf, 2, 3))) static inline int plogdx_dbg(__attribute__
 #endif
 
 void plog_init(const char *log_name, int log_name_pid);
+/* Give each worker core a ring for its messages: from then on, the
+   messages logged by the workers are written by plog_drain(). */
+void plog_async_init(void);
+void plog_drain(void);
 void file_print(const char *str);
 
 int plog_set_lvl(int lvl);
@@ -244,8 +244,10 @@ static void configure_if_tx_queues(struct task_args *targ, uint8_t socket)
 		}
 		/* Set the ETH_TXQ_FLAGS_NOREFCOUNT flag if none of
 		   the tasks up to the task transmitting to the port
-		   does not use refcnt. */
-		if (!chain_flag_state(targ, TASK_FEATURE_TXQ_FLAGS_REFCOUNT, 1)) {
+		   does not use refcnt. Generators sending pre-built
+		   mbufs rely on refcnt to get their mbufs back. */
+		if (!chain_flag_state(targ, TASK_FEATURE_TXQ_FLAGS_REFCOUNT, 1) &&
+		    !(targ->flags & TASK_ARG_PREBUILT_MBUFS)) {
 			prox_port_cfg[if_port].tx_conf.txq_flags |= ETH_TXQ_FLAGS_NOREFCOUNT;
 			plog_info("\t\tEnabling No refcnt on port %d\n", if_port);
 		}
@@ -0,0 +1,366 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include <rte_cycles.h>
+#include <rte_common.h>
+
+#include "pcap_stream.h"
+#include "prox_malloc.h"
+#include "quit.h"
+#include "log.h"
+
+#define PCAP_STREAM_MAX		64
+/* How long the writer sleeps when none of the rings had records */
+#define PCAP_STREAM_IDLE_NSEC	1000000
+/* Space is given back to the dump task at least every so many bytes */
+#define PCAP_STREAM_BATCH	(1 << 20)
+
+/* pcap with nanosecond resolution timestamps */
+#define PCAP_NSEC_MAGIC		0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET	1
+
+struct pcap_file_hdr {
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t  thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t linktype;
+};
+
+struct pcap_rec_hdr {
+	uint32_t ts_sec;
+	uint32_t ts_nsec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+static struct pcap_stream *pcap_streams[PCAP_STREAM_MAX];
+static volatile uint32_t n_pcap_streams;
+static pthread_t pcap_stream_writer;
+static int pcap_stream_writer_started;
+static volatile int pcap_stream_writer_quit;
+
+/* Without rotation, the name is used as is. Otherwise the index of
+   the file is inserted before the extension: out.pcap, out_0001.pcap,
+   ... The writer thread must not exit on errors: returns -1 and
+   leaves fp NULL if the file can't be created. */
+static int pcap_stream_open(struct pcap_stream *ps)
+{
+	struct pcap_file_hdr hdr = {
+		.magic = PCAP_NSEC_MAGIC,
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = ps->snaplen,
+		.linktype = PCAP_LINKTYPE_ETHERNET,
+	};
+	char name[sizeof(ps->name) + 16];
+
+	if (ps->file_idx == 0) {
+		strcpy(name, ps->name);
+	} else {
+		const char *ext = strrchr(ps->name, '.');
+		int base_len = ext? (int)(ext - ps->name) : (int)strlen(ps->name);
+
+		snprintf(name, sizeof(name), "%.*s_%04u%s", base_len, ps->name, ps->file_idx, ext? ext : "");
+	}
+
+	ps->fp = fopen(name, "w");
+	if (ps->fp == NULL)
+		return -1;
+	if (fwrite(&hdr, sizeof(hdr), 1, ps->fp) != 1) {
+		fclose(ps->fp);
+		ps->fp = NULL;
+		return -1;
+	}
+	ps->file_bytes = sizeof(hdr);
+	return 0;
+}
+
+static void pcap_stream_copy_out(const struct pcap_stream *ps, uint32_t pos, void *dst, uint32_t len)
+{
+	uint32_t idx = pos & ps->mask;
+	uint32_t n_first = RTE_MIN(len, ps->mask + 1 - idx);
+
+	memcpy(dst, &ps->data[idx], n_first);
+	if (n_first < len)
+		memcpy((uint8_t *)dst + n_first, &ps->data[0], len - n_first);
+}
+
+static size_t pcap_stream_write_data(struct pcap_stream *ps, uint32_t pos, uint32_t len)
+{
+	uint32_t idx = pos & ps->mask;
+	uint32_t n_first = RTE_MIN(len, ps->mask + 1 - idx);
+	size_t written;
+
+	written = fwrite(&ps->data[idx], 1, n_first, ps->fp);
+	if (n_first < len)
+		written += fwrite(&ps->data[0], 1, len - n_first, ps->fp);
+	return written;
+}
+
+static size_t pcap_stream_drain(struct pcap_stream *ps)
+{
+	const uint64_t hz = rte_get_tsc_hz();
+	uint32_t tail = ps->tail;
+	uint32_t head = ps->head;
+	size_t n = 0;
+
+	if (head == tail)
+		return 0;
+	/* Records must not be read before head */
+	rte_smp_rmb();
+
+	while (tail != head && n < PCAP_STREAM_BATCH) {
+		struct pcap_stream_rec rec;
+		struct pcap_rec_hdr hdr;
+
+		pcap_stream_copy_out(ps, tail, &rec, sizeof(rec));
+
+		uint32_t pos = tail;
+		uint32_t size = RTE_ALIGN_CEIL(sizeof(rec) + rec.caplen, 8);
+		tail += size;
+		n += size;
+
+		/* Packets are discarded once a rotation failed */
+		if (ps->fp == NULL) {
+			ps->n_write_errors++;
+			continue;
+		}
+		if (ps->rotate_bytes && ps->file_bytes + sizeof(hdr) + rec.caplen > ps->rotate_bytes &&
+		    ps->file_bytes > sizeof(struct pcap_file_hdr)) {
+			if (fclose(ps->fp))
+				ps->n_write_errors++;
+			ps->file_idx++;
+			if (pcap_stream_open(ps)) {
+				ps->n_write_errors++;
+				continue;
+			}
+		}
+
+		/* Wall clock time derived from the tsc, so that
+		   timestamps keep nanosecond precision */
+		uint64_t delta = rec.tsc > ps->tsc_start? rec.tsc - ps->tsc_start : 0;
+		uint64_t ns = ps->ns_start + (delta / hz) * 1000000000 + (delta % hz) * 1000000000 / hz;
+
+		hdr.ts_sec = ns / 1000000000;
+		hdr.ts_nsec = ns % 1000000000;
+		hdr.caplen = rec.caplen;
+		hdr.len = rec.len;
+		if (fwrite(&hdr, sizeof(hdr), 1, ps->fp) != 1 ||
+		    pcap_stream_write_data(ps, pos + sizeof(rec), rec.caplen) != rec.caplen)
+			ps->n_write_errors++;
+		else
+			ps->n_written++;
+		ps->file_bytes += sizeof(hdr) + rec.caplen;
+	}
+
+	/* Records must be copied before they can be overwritten */
+	rte_smp_mb();
+	ps->tail = tail;
+	return n;
+}
+
+/* The dump task no longer adds packets: write what is left, close
+   the file and publish the results for the master */
+static void pcap_stream_writer_close(struct pcap_stream *ps)
+{
+	while (pcap_stream_drain(ps))
+		;
+	if (ps->fp) {
+		if (fflush(ps->fp) || ferror(ps->fp))
+			ps->n_write_errors++;
+		if (fclose(ps->fp))
+			ps->n_write_errors++;
+		ps->fp = NULL;
+	}
+	ps->opened = 0;
+	ps->last_written = ps->n_written;
+	ps->last_dropped = ps->n_dropped - ps->drop_base;
+	ps->last_write_errors = ps->n_write_errors;
+	rte_smp_wmb();
+	ps->n_closed++;
+}
+
+/* The dump task started again: continue in the next file */
+static void pcap_stream_writer_open(struct pcap_stream *ps)
+{
+	/* Packets added before the file could be opened are lost */
+	ps->tail = ps->head;
+	ps->file_idx++;
+	if (pcap_stream_open(ps)) {
+		ps->open_failed = 1;
+		ps->n_open_failed++;
+		return;
+	}
+	ps->opened = 1;
+	ps->n_written = 0;
+	ps->n_write_errors = 0;
+	ps->drop_base = ps->n_dropped;
+}
+
+static void *pcap_stream_writer_main(void *arg)
+{
+	const struct timespec idle = {.tv_sec = 0, .tv_nsec = PCAP_STREAM_IDLE_NSEC};
+	int need_flush = 0;
+
+	while (!pcap_stream_writer_quit) {
+		size_t n = 0;
+
+		for (uint32_t i = 0; i < n_pcap_streams; ++i) {
+			struct pcap_stream *ps = pcap_streams[i];
+
+			if (!ps->want_open) {
+				ps->open_failed = 0;
+				if (ps->opened)
+					pcap_stream_writer_close(ps);
+			} else if (ps->opened) {
+				n += pcap_stream_drain(ps);
+			} else if (!ps->open_failed) {
+				pcap_stream_writer_open(ps);
+			} else {
+				/* Nowhere to write to: free the ring */
+				ps->tail = ps->head;
+			}
+		}
+
+		if (n) {
+			need_flush = 1;
+			continue;
+		}
+		if (need_flush) {
+			for (uint32_t i = 0; i < n_pcap_streams; ++i) {
+				struct pcap_stream *ps = pcap_streams[i];
+
+				if (ps->opened && ps->fp && fflush(ps->fp))
+					ps->n_write_errors++;
+			}
+			need_flush = 0;
+		}
+		nanosleep(&idle, NULL);
+	}
+
+	for (uint32_t i = 0; i < n_pcap_streams; ++i) {
+		if (pcap_streams[i]->opened)
+			pcap_stream_writer_close(pcap_streams[i]);
+	}
+	return NULL;
+}
+
+void pcap_stream_stop(struct pcap_stream *ps)
+{
+	ps->want_open = 0;
+}
+
+void pcap_stream_start(struct pcap_stream *ps)
+{
+	ps->want_open = 1;
+}
+
+void pcap_stream_report(void)
+{
+	for (uint32_t i = 0; i < n_pcap_streams; ++i) {
+		struct pcap_stream *ps = pcap_streams[i];
+		uint32_t n_closed = ps->n_closed;
+		uint32_t n_open_failed = ps->n_open_failed;
+
+		if (n_open_failed != ps->n_open_failed_reported) {
+			plog_err("Failed to open next file of '%s', packets are not captured\n", ps->name);
+			ps->n_open_failed_reported = n_open_failed;
+		}
+		if (n_closed == ps->n_closed_reported)
+			continue;
+		rte_smp_rmb();
+		plog_info("Captured %"PRIu64" packets to '%s', %"PRIu64" dropped\n",
+			  ps->last_written, ps->name, ps->last_dropped);
+		if (ps->last_write_errors)
+			plog_err("%"PRIu64" write errors on '%s', capture is incomplete\n", ps->last_write_errors, ps->name);
+		ps->n_closed_reported = n_closed;
+	}
+}
+
+void pcap_stream_exit(void)
+{
+	if (!pcap_stream_writer_started)
+		return;
+	pcap_stream_writer_quit = 1;
+	pthread_join(pcap_stream_writer, NULL);
+	pcap_stream_writer_started = 0;
+	pcap_stream_report();
+}
+
+struct pcap_stream *pcap_stream_create(const char *name, uint32_t size, uint32_t snaplen, uint64_t rotate_bytes, int socket_id)
+{
+	struct pcap_stream *ps;
+	struct timespec now;
+	size_t mem_size;
+
+	PROX_PANIC(n_pcap_streams == PCAP_STREAM_MAX, "Too many pcap streams, max is %u\n", PCAP_STREAM_MAX);
+	PROX_PANIC(size > (1U << 31), "pcap stream size too big\n");
+	PROX_PANIC(snaplen == 0, "snaplen must not be 0\n");
+
+	size = rte_align32pow2(size);
+	PROX_PANIC(size < RTE_ALIGN_CEIL(sizeof(struct pcap_stream_rec) + snaplen, 8),
+		   "pcap stream size (%u) too small for snaplen %u\n", size, snaplen);
+	mem_size = sizeof(*ps) + size;
+	ps = prox_zmalloc(mem_size, socket_id);
+	PROX_PANIC(ps == NULL, "Failed to allocate %zu kbytes for pcap stream\n", mem_size / 1024);
+	ps->mask = size - 1;
+	ps->snaplen = snaplen;
+	ps->rotate_bytes = rotate_bytes;
+	snprintf(ps->name, sizeof(ps->name), "%s", name);
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	ps->tsc_start = rte_rdtsc();
+	ps->ns_start = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+	PROX_PANIC(pcap_stream_open(ps), "Failed to create %s\n", ps->name);
+	ps->opened = 1;
+	ps->want_open = 1;
+
+	pcap_streams[n_pcap_streams] = ps;
+	rte_smp_wmb();
+	n_pcap_streams++;
+
+	/* The writer inherits the CPU affinity of the master core */
+	if (!pcap_stream_writer_started) {
+		PROX_PANIC(pthread_create(&pcap_stream_writer, NULL, pcap_stream_writer_main, NULL),
+			   "Failed to start pcap stream writer\n");
+		pcap_stream_writer_started = 1;
+	}
+	plog_info("\tStreaming packets to %s (%u kbytes buffered, snaplen %u)\n", name, size / 1024, snaplen);
+	return ps;
+}
@@ -0,0 +1,163 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _PCAP_STREAM_H_
+#define _PCAP_STREAM_H_
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rte_common.h>
+#include <rte_memory.h>
+#include <rte_atomic.h>
+#include <rte_mbuf.h>
+
+/* Continuous packet capture. The dump task copies (at most snaplen
+   bytes of) each packet into its own single producer/single consumer
+   byte ring so that mbufs are released immediately. A writer thread,
+   running next to the master core, streams the records to pcap files
+   with nanosecond timestamps, optionally rotating files once they
+   reach a given size. */
+
+/* Record as stored in the ring, followed by caplen bytes of packet
+   data and padded to a multiple of 8 bytes. */
+struct pcap_stream_rec {
+	uint64_t tsc;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+struct pcap_stream {
+	/* Written by the dump task only */
+	volatile uint32_t head __rte_cache_aligned;
+	uint32_t tail_cache;
+	uint32_t mask;
+	uint32_t snaplen;
+	uint64_t n_pkts;
+	uint64_t n_dropped;
+	/* Set while the dump task runs. The writer opens and closes
+	   files to match, so that no file I/O is done by the task. */
+	volatile int want_open;
+	/* Written by the writer thread only */
+	volatile uint32_t tail __rte_cache_aligned;
+	int opened;
+	int open_failed;
+	FILE *fp;                       /* NULL if a rotation failed */
+	uint64_t n_written;
+	uint64_t n_write_errors;
+	uint64_t drop_base;
+	/* Results of the last capture, reported by the master once
+	   n_closed has changed */
+	uint64_t last_written;
+	uint64_t last_dropped;
+	uint64_t last_write_errors;
+	volatile uint32_t n_closed;
+	volatile uint32_t n_open_failed;
+	uint64_t file_bytes;
+	uint64_t rotate_bytes;
+	uint32_t file_idx;
+	uint64_t tsc_start;
+	uint64_t ns_start;
+	/* Written by the master only */
+	uint32_t n_closed_reported;
+	uint32_t n_open_failed_reported;
+	char name[256];
+	uint8_t data[0] __rte_cache_aligned;
+};
+
+/* size is the size of the ring in bytes, rotate_bytes the maximum
+   size of each file (0 to never rotate) */
+struct pcap_stream *pcap_stream_create(const char *name, uint32_t size, uint32_t snaplen, uint64_t rotate_bytes, int socket_id);
+/* Called by the dump task when it stops: the writer writes the
+   packets left and closes the file. Does not wait. */
+void pcap_stream_stop(struct pcap_stream *ps);
+/* Called by the dump task when it starts again: capture continues in
+   the next file, opened by the writer */
+void pcap_stream_start(struct pcap_stream *ps);
+/* Called periodically by the master to log the results of the
+   captures that ended and any error of the writer */
+void pcap_stream_report(void);
+/* Called by the master on exit: closes all files and joins the
+   writer thread */
+void pcap_stream_exit(void);
+
+static inline void pcap_stream_copy_in(struct pcap_stream *ps, uint32_t pos, const void *src, uint32_t len)
+{
+	uint32_t idx = pos & ps->mask;
+	uint32_t n_first = RTE_MIN(len, ps->mask + 1 - idx);
+
+	memcpy(&ps->data[idx], src, n_first);
+	if (n_first < len)
+		memcpy(&ps->data[0], (const uint8_t *)src + n_first, len - n_first);
+}
+
+/* Packets are dropped from the capture (and counted) if the writer
+   can't keep up. Returns 0 if the packet has been captured. */
+static inline int pcap_stream_add(struct pcap_stream *ps, const struct rte_mbuf *mbuf, uint64_t tsc)
+{
+	struct pcap_stream_rec rec;
+	uint32_t head = ps->head;
+
+	rec.tsc = tsc;
+	rec.len = rte_pktmbuf_pkt_len(mbuf);
+	rec.caplen = RTE_MIN(rec.len, ps->snaplen);
+
+	uint32_t size = RTE_ALIGN_CEIL(sizeof(rec) + rec.caplen, 8);
+
+	if (ps->mask + 1 - (head - ps->tail_cache) < size) {
+		ps->tail_cache = ps->tail;
+		if (ps->mask + 1 - (head - ps->tail_cache) < size) {
+			ps->n_dropped++;
+			return -1;
+		}
+	}
+
+	uint32_t pos = head;
+	uint32_t left = rec.caplen;
+
+	pcap_stream_copy_in(ps, pos, &rec, sizeof(rec));
+	pos += sizeof(rec);
+	for (const struct rte_mbuf *seg = mbuf; seg && left; seg = seg->next) {
+		uint32_t n = RTE_MIN(left, seg->data_len);
+
+		pcap_stream_copy_in(ps, pos, rte_pktmbuf_mtod(seg, const void *), n);
+		pos += n;
+		left -= n;
+	}
+	rte_smp_wmb();
+	ps->head = head + size;
+	ps->n_pkts++;
+	return 0;
+}
+
+#endif /* _PCAP_STREAM_H_ */
@@ -809,6 +809,24 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "random delay us")) {
 		return parse_int(&targ->random_delay_us, pkey);
 	}
+	if (STR_EQ(str, "delay distribution")) {
+		if (STR_EQ(pkey, "uniform"))
+			targ->delay_distr = DELAY_DISTR_UNIFORM;
+		else if (STR_EQ(pkey, "normal"))
+			targ->delay_distr = DELAY_DISTR_NORMAL;
+		else if (STR_EQ(pkey, "pareto"))
+			targ->delay_distr = DELAY_DISTR_PARETO;
+		else if (STR_EQ(pkey, "cdf"))
+			targ->delay_distr = DELAY_DISTR_CDF;
+		else {
+			set_errf("Unknown delay distribution '%s', expected uniform, normal, pareto or cdf", pkey);
+			return -1;
+		}
+		return 0;
+	}
+	if (STR_EQ(str, "delay cdf file")) {
+		return parse_str(targ->delay_cdf_file, pkey, sizeof(targ->delay_cdf_file));
+	}
 	if (STR_EQ(str, "cpe table timeout ms")) {
 		return parse_int(&targ->cpe_table_timeout_ms, pkey);
 	}
@@ -879,6 +897,15 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "nat table")) {
 		return parse_str(targ->nat_table, pkey, sizeof(targ->nat_table));
 	}
+	if (STR_EQ(str, "session timeout ms")) {
+		return parse_int(&targ->session_timeout_ms, pkey);
+	}
+	if (STR_EQ(str, "port block size")) {
+		return parse_int(&targ->port_block_size, pkey);
+	}
+	if (STR_EQ(str, "port quota")) {
+		return parse_int(&targ->port_quota, pkey);
+	}
 	if (STR_EQ(str, "rules")) {
 		return parse_str(targ->rules, pkey, sizeof(targ->rules));
 	}
@@ -913,6 +940,15 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "qinq")) {
 		return parse_flag(&targ->flags, TASK_ARG_QINQ_ACL, pkey);
 	}
+	if (STR_EQ(str, "shadow acl")) {
+		return parse_flag(&targ->flags, TASK_ARG_ACL_SHADOW, pkey);
+	}
+	if (STR_EQ(str, "acl stats")) {
+		return parse_flag(&targ->flags, TASK_ARG_ACL_STATS, pkey);
+	}
+	if (STR_EQ(str, "acl algorithm")) {
+		return parse_str(targ->acl_alg, pkey, sizeof(targ->acl_alg));
+	}
 	if (STR_EQ(str, "bps")) {
 		return parse_u64(&targ->rate_bps, pkey);
 	}
@@ -933,6 +969,18 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "pcap file")) {
 		return parse_str(targ->pcap_file, pkey, sizeof(targ->pcap_file));
 	}
+	if (STR_EQ(str, "pcap stream size")) {
+		return parse_kmg(&targ->pcap_stream_size, pkey);
+	}
+	if (STR_EQ(str, "pcap rotate size")) {
+		return parse_kmg(&targ->pcap_rotate_size, pkey);
+	}
+	if (STR_EQ(str, "pcap filter")) {
+		return parse_str(targ->pcap_filter, pkey, sizeof(targ->pcap_filter));
+	}
+	if (STR_EQ(str, "snaplen")) {
+		return parse_int(&targ->snaplen, pkey);
+	}
 	if (STR_EQ(str, "pkt inline")) {
 		char pkey2[MAX_CFG_STRING_LEN];
 		if (parse_str(pkey2, pkey, sizeof(pkey2)) != 0) {
@@ -1000,6 +1048,9 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "latency buffer size")) {
 		return parse_int(&targ->latency_buffer_size, pkey);
 	}
+	if (STR_EQ(str, "latency stream size")) {
+		return parse_int(&targ->latency_stream_size, pkey);
+	}
 	if (STR_EQ(str, "accuracy pos")) {
 		return parse_int(&targ->accur_pos, pkey);
 	}
@@ -1038,6 +1089,12 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "pkt size")) {
 		return parse_int(&targ->pkt_size, pkey);
 	}
+	if (STR_EQ(str, "template copy")) {
+		return parse_str(targ->template_copy, pkey, sizeof(targ->template_copy));
+	}
+	if (STR_EQ(str, "prebuilt mbufs")) {
+		return parse_flag(&targ->flags, TASK_ARG_PREBUILT_MBUFS, pkey);
+	}
 	if (STR_EQ(str, "min bulk size")) {
 		return parse_int(&targ->min_bulk_size, pkey);
 	}
@@ -1258,6 +1315,44 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 		return parse_int(&lconf->cache_set, pkey);
 	}
 
+	if (STR_EQ(str, "adaptive polling")) {
+		return parse_flag(&lconf->flags, LCONF_FLAG_ADAPTIVE_POLL, pkey);
+	}
+
+	if (STR_EQ(str, "idle mode")) {
+		if (STR_EQ(pkey, "none"))
+			lconf->idle_mode = IDLE_MODE_NONE;
+		else if (STR_EQ(pkey, "pause"))
+			lconf->idle_mode = IDLE_MODE_PAUSE;
+		else if (STR_EQ(pkey, "sleep"))
+			lconf->idle_mode = IDLE_MODE_SLEEP;
+		else {
+			set_errf("Unknown idle mode '%s', expected none, pause or sleep", pkey);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (STR_EQ(str, "max idle latency us")) {
+		if (parse_int(&lconf->max_idle_us, pkey))
+			return -1;
+		if (lconf->max_idle_us == 0) {
+			set_errf("max idle latency us must be at least 1");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (STR_EQ(str, "max poll skip")) {
+		if (parse_int(&lconf->max_poll_skip, pkey))
+			return -1;
+		if (lconf->max_poll_skip == 0) {
+			set_errf("max poll skip must be at least 1");
+			return -1;
+		}
+		return 0;
+	}
+
 	if (STR_EQ(str, "sub mode")) {
 		const char* mode_str = targ->task_init->mode_str;
 		const char *sub_mode_str = pkey;
@@ -1431,6 +1526,15 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 	if (STR_EQ(str, "pipe tc period")) {
 		return parse_int(&targ->qos_conf.pipe_params[0].tc_period, pkey);
 	}
+	if (STR_EQ(str, "dequeue interval ns")) {
+		return parse_int(&targ->qos_conf.dequeue_ns, pkey);
+	}
+	if (STR_EQ(str, "dequeue budget")) {
+		return parse_int(&targ->qos_conf.dequeue_budget, pkey);
+	}
+	if (STR_EQ(str, "qos tc stats")) {
+		return parse_flag(&targ->flags, TASK_ARG_QOS_TC_STATS, pkey);
+	}
 	if (STR_EQ(str, "police action")) {
 		char *in = strstr(pkey, " io=");
 		if (in == NULL) {
@@ -1467,6 +1571,9 @@ static int get_core_cfg(unsigned sindex, char *str, void *data)
 
 		return 0;
 	}
+	if (STR_EQ(str, "police group")) {
+		return parse_flag(&targ->flags, TASK_ARG_POLICE_GROUP, pkey);
+	}
 	if (STR_EQ(str, "qinq tag")) {
 		return parse_int(&targ->qinq_tag, pkey);
 	}
@@ -0,0 +1,158 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_byteorder.h>
+
+#include "prox_events.h"
+#include "prox_malloc.h"
+#include "quit.h"
+#include "log.h"
+
+#define IP4(x) x & 0xff, (x >> 8) & 0xff, (x >> 16) & 0xff, x >> 24
+
+struct event_desc {
+	const char *name;
+	/* Number of ip:port pairs filled in by the samples */
+	uint8_t n_addr;
+};
+
+static const struct event_desc event_descs[N_PROX_EVENTS] = {
+	[EVENT_CGNAT_SESSION_ADD] = {"cgnat.session_add", 2},
+	[EVENT_CGNAT_SESSION_DEL] = {"cgnat.session_del", 2},
+	[EVENT_CGNAT_NO_PUBLIC_IP] = {"cgnat.no_public_ip", 1},
+	[EVENT_CGNAT_NO_PORT] = {"cgnat.no_port", 2},
+	[EVENT_CGNAT_PORT_QUOTA] = {"cgnat.port_quota", 2},
+	[EVENT_CGNAT_TABLE_FULL] = {"cgnat.table_full", 2},
+	[EVENT_CGNAT_RACE] = {"cgnat.race", 1},
+	[EVENT_CGNAT_DEL_FAILED] = {"cgnat.del_failed", 2},
+	[EVENT_CGNAT_RELEASE_FAILED] = {"cgnat.release_failed", 2},
+	[EVENT_CGNAT_LOOKUP_FAILED] = {"cgnat.lookup_failed", 0},
+	[EVENT_CGNAT_NOT_IPV4] = {"cgnat.not_ipv4", 0},
+	[EVENT_CGNAT_NO_ROUTE] = {"cgnat.no_route", 2},
+	[EVENT_CGNAT_NO_MAPPING] = {"cgnat.no_mapping", 2},
+	[EVENT_ROUTING_NOT_IPV4] = {"routing.not_ipv4", 0},
+	[EVENT_ROUTING_BAD_QINQ] = {"routing.bad_qinq", 0},
+	[EVENT_ROUTING_UNKNOWN_ETYPE] = {"routing.unknown_etype", 0},
+	[EVENT_QINQ_DECAP4_NO_ROUTE] = {"qinq_decap4.no_route", 2},
+	[EVENT_FM_UNKNOWN_PKT] = {"fm.unknown_pkt", 0},
+};
+
+static struct event_lcore *event_lcores[RTE_MAX_LCORE];
+
+struct event_lcore *event_lcore_get(uint32_t lcore_id, int socket_id)
+{
+	if (event_lcores[lcore_id] == NULL) {
+		event_lcores[lcore_id] = prox_zmalloc(sizeof(struct event_lcore), socket_id);
+		PROX_PANIC(event_lcores[lcore_id] == NULL, "Failed to allocate event counters for core %u\n", lcore_id);
+	}
+	return event_lcores[lcore_id];
+}
+
+void event_sample_slow(struct event_lcore *ev, uint64_t tsc)
+{
+	ev->window_end = tsc + rte_get_tsc_hz();
+	ev->window_budget = EVENT_SAMPLES_PER_SEC;
+}
+
+const char *event_name(enum prox_event event)
+{
+	return event_descs[event].name;
+}
+
+uint64_t event_count_get(enum prox_event event, const uint32_t *lcores, int n_lcores)
+{
+	uint64_t tot = 0;
+
+	if (lcores == NULL) {
+		for (uint32_t i = 0; i < RTE_MAX_LCORE; i++) {
+			if (event_lcores[i])
+				tot += event_lcores[i]->count[event];
+		}
+		return tot;
+	}
+	for (int i = 0; i < n_lcores; i++) {
+		if (lcores[i] < RTE_MAX_LCORE && event_lcores[lcores[i]])
+			tot += event_lcores[lcores[i]]->count[event];
+	}
+	return tot;
+}
+
+uint64_t event_suppressed_get(uint32_t lcore_id)
+{
+	if (lcore_id >= RTE_MAX_LCORE || !event_lcores[lcore_id])
+		return 0;
+	return event_lcores[lcore_id]->n_suppressed;
+}
+
+static void event_sample_log(uint32_t lcore_id, const struct event_sample *s)
+{
+	const struct event_desc *desc = &event_descs[s->event];
+
+	switch (desc->n_addr) {
+	case 0:
+		plog_info("core %u task %u: %s\n", lcore_id, s->task_id, desc->name);
+		break;
+	case 1:
+		plog_info("core %u task %u: %s %d.%d.%d.%d:%u\n", lcore_id, s->task_id, desc->name,
+			  IP4(s->ip[0]), rte_bswap16(s->port[0]));
+		break;
+	default:
+		plog_info("core %u task %u: %s %d.%d.%d.%d:%u => %d.%d.%d.%d:%u\n", lcore_id, s->task_id, desc->name,
+			  IP4(s->ip[0]), rte_bswap16(s->port[0]), IP4(s->ip[1]), rte_bswap16(s->port[1]));
+		break;
+	}
+}
+
+void events_drain(void)
+{
+	for (uint32_t lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		struct event_lcore *ev = event_lcores[lcore_id];
+
+		if (ev == NULL)
+			continue;
+
+		uint32_t head = ev->head;
+		uint32_t tail = ev->tail;
+
+		if (head == tail)
+			continue;
+		rte_smp_rmb();
+		while (tail != head) {
+			event_sample_log(lcore_id, &ev->ring[tail & (EVENT_RING_SIZE - 1)]);
+			tail++;
+		}
+		rte_smp_mb();
+		ev->tail = tail;
+	}
+}
@@ -0,0 +1,153 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _PROX_EVENTS_H_
+#define _PROX_EVENTS_H_
+
+#include <inttypes.h>
+
+#include <rte_memory.h>
+#include <rte_branch_prediction.h>
+#include <rte_atomic.h>
+#include <rte_cycles.h>
+
+/* Datapath events. Handlers count events in a per-core block instead
+   of formatting log messages for each of them. Events can also be
+   sampled: up to EVENT_SAMPLES_PER_SEC samples per core and per second
+   are pushed into a single producer/single consumer ring which is
+   drained and logged by the master core. All tasks of a core share
+   the block, as they run from the same thread. */
+
+enum prox_event {
+	EVENT_CGNAT_SESSION_ADD,
+	EVENT_CGNAT_SESSION_DEL,
+	EVENT_CGNAT_NO_PUBLIC_IP,
+	EVENT_CGNAT_NO_PORT,
+	EVENT_CGNAT_PORT_QUOTA,
+	EVENT_CGNAT_TABLE_FULL,
+	EVENT_CGNAT_RACE,
+	EVENT_CGNAT_DEL_FAILED,
+	EVENT_CGNAT_RELEASE_FAILED,
+	EVENT_CGNAT_LOOKUP_FAILED,
+	EVENT_CGNAT_NOT_IPV4,
+	EVENT_CGNAT_NO_ROUTE,
+	EVENT_CGNAT_NO_MAPPING,
+	EVENT_ROUTING_NOT_IPV4,
+	EVENT_ROUTING_BAD_QINQ,
+	EVENT_ROUTING_UNKNOWN_ETYPE,
+	EVENT_QINQ_DECAP4_NO_ROUTE,
+	EVENT_FM_UNKNOWN_PKT,
+	N_PROX_EVENTS
+};
+
+#define EVENT_RING_SIZE		256
+#define EVENT_SAMPLES_PER_SEC	64
+
+/* Addresses and ports are in network byte order */
+struct event_sample {
+	uint64_t tsc;
+	uint16_t event;
+	uint8_t  task_id;
+	uint32_t ip[2];
+	uint16_t port[2];
+};
+
+struct event_lcore {
+	/* Written by the core only */
+	uint64_t count[N_PROX_EVENTS];
+	uint64_t n_suppressed;
+	uint64_t window_end;
+	uint32_t window_budget;
+	uint32_t tail_cache;
+	volatile uint32_t head;
+	/* Written by the master only */
+	volatile uint32_t tail __rte_cache_aligned;
+	struct event_sample ring[EVENT_RING_SIZE] __rte_cache_aligned;
+};
+
+/* Returns the event block of the core, allocating it the first time.
+   Called from task init on the master core. */
+struct event_lcore *event_lcore_get(uint32_t lcore_id, int socket_id);
+
+/* Log the samples recorded by the cores since the previous call */
+void events_drain(void);
+
+const char *event_name(enum prox_event event);
+/* Event count summed over the cores in lcores, or over all cores if
+   lcores is NULL */
+uint64_t event_count_get(enum prox_event event, const uint32_t *lcores, int n_lcores);
+uint64_t event_suppressed_get(uint32_t lcore_id);
+
+static inline void event_count(struct event_lcore *ev, enum prox_event event)
+{
+	ev->count[event]++;
+}
+
+void event_sample_slow(struct event_lcore *ev, uint64_t tsc);
+
+/* Count the event and, rate permitting, record a sample of it */
+static inline void event_sample(struct event_lcore *ev, enum prox_event event, uint8_t task_id,
+				uint32_t ip0, uint16_t port0, uint32_t ip1, uint16_t port1)
+{
+	uint64_t tsc = rte_rdtsc();
+
+	ev->count[event]++;
+	if (unlikely(tsc > ev->window_end))
+		event_sample_slow(ev, tsc);
+	if (ev->window_budget == 0)
+		goto suppressed;
+	/* Only read tail, written by the master, when the ring
+	   looks full */
+	if (ev->head - ev->tail_cache == EVENT_RING_SIZE) {
+		ev->tail_cache = ev->tail;
+		if (ev->head - ev->tail_cache == EVENT_RING_SIZE)
+			goto suppressed;
+	}
+	ev->window_budget--;
+
+	struct event_sample *s = &ev->ring[ev->head & (EVENT_RING_SIZE - 1)];
+
+	s->tsc = tsc;
+	s->event = event;
+	s->task_id = task_id;
+	s->ip[0] = ip0;
+	s->ip[1] = ip1;
+	s->port[0] = port0;
+	s->port[1] = port1;
+	rte_smp_wmb();
+	ev->head++;
+	return;
+suppressed:
+	ev->n_suppressed++;
+}
+
+#endif /* _PROX_EVENTS_H_ */
@@ -32,6 +32,7 @@
 
 #define PROX_MAX_PORTS          16
 #define MAX_TASKS_PER_CORE      8
+#define MAX_TSC_TASKS_PER_CORE  32
 #define MAX_SOCKETS             64
 #define MAX_NAME_SIZE           64
 #define MAX_PROTOCOLS           3
@@ -526,6 +526,9 @@ int lua_to_routes4(struct lua_State *L, enum lua_place from, const char *name, u
 	uint32_t n_loaded_rules;
 	uint32_t n_tot_rules;
 	struct rte_lpm *new_lpm;
+	/* Tables can be loaded again at runtime while the previous
+	   one is still in use, so each needs a unique name. */
+	static uint32_t n_lpm;
 	char lpm_name[64];
 	int ret;
 	int pop;
@@ -533,7 +536,7 @@ int lua_to_routes4(struct lua_State *L, enum lua_place from, const char *name, u
 	if ((pop = lua_getfrom(L, from, name)) < 0)
 		return -1;
 
-	snprintf(lpm_name, sizeof(lpm_name), "IPv4_lpm_s%u", socket);
+	snprintf(lpm_name, sizeof(lpm_name), "IPv4_lpm_s%u_%u", socket, n_lpm++);
 
 	if (!lua_istable(L, -1)) {
 		set_err("Data is not a table\n");
@@ -610,6 +613,34 @@ int lua_to_lpm4(struct lua_State *L, enum lua_place from, const char *name, uint
 	return 0;
 }
 
+void lpm4_free(struct lpm4 *lpm)
+{
+	rte_lpm_free(lpm->rte_lpm);
+	prox_free(lpm->next_hops);
+	prox_free(lpm);
+}
+
+int lua_file_to_global(struct lua_State *L, const char *file, const char *name)
+{
+	if (luaL_loadfile(L, file)) {
+		set_err("Lua error: '%s'\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return -1;
+	}
+	if (lua_pcall(L, 0, 1, 0)) {
+		set_err("Lua error: '%s'\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+		return -1;
+	}
+	if (!lua_istable(L, -1)) {
+		set_err("%s did not return a table\n", file);
+		lua_pop(L, 1);
+		return -1;
+	}
+	lua_setglobal(L, name);
+	return 0;
+}
+
 int lua_to_lpm6(struct lua_State *L, enum lua_place from, const char *name, uint8_t socket, struct lpm6 **lpm)
 {
 	struct lpm6 *ret;
@@ -988,7 +1019,7 @@ struct acl4_rule {
 	struct rte_acl_field fields[9];
 };
 
-int lua_to_rules(struct lua_State *L, enum lua_place from, const char *name, struct rte_acl_ctx *ctx, uint32_t* n_max_rules, int use_qinq, uint16_t qinq_tag)
+int lua_to_rules(struct lua_State *L, enum lua_place from, const char *name, struct rte_acl_ctx *ctx, uint32_t* n_max_rules, int use_qinq, uint16_t qinq_tag, uint8_t *actions)
 {
 	int pop;
 
@@ -1027,9 +1058,11 @@ int lua_to_rules(struct lua_State *L, enum lua_place from, const char *name, str
 
 		struct acl4_rule rule;
 
-		rule.data.userdata = action; /* allow, drop or rate_limit */
 		rule.data.category_mask = 1;
 		rule.data.priority = n_rules++;
+		/* Rules are numbered from 1, 0 is returned if no rule matches */
+		rule.data.userdata = n_rules;
+		actions[n_rules] = action; /* allow, drop or rate_limit */
 
 		/* Configuration for rules is done in little-endian so no bswap is needed here.. */
 
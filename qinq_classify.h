@@ -0,0 +1,160 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _QINQ_CLASSIFY_H_
+#define _QINQ_CLASSIFY_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <rte_mbuf.h>
+#include <rte_sched.h>
+#include <rte_version.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "defaults.h"
+#include "defines.h"
+#include "etypes.h"
+#include "prefetch.h"
+#include "qinq.h"
+
+/* Fields used for classification, as found in a QinQ packet starting
+   at the svlan tci. The key is filled with a single 16 byte load. */
+struct qinq_key {
+	uint16_t svlan_tci;
+	uint16_t cvlan_eth_proto;
+	uint16_t cvlan_tci;
+	uint16_t ether_type;
+	uint8_t  version_ihl;
+	uint8_t  tos;
+	uint8_t  pad[6];
+} __attribute__((aligned(16)));
+
+#define QINQ_KEY_OFFSET offsetof(struct qinq_hdr, svlan.vlan_tci)
+
+/* Gather the classification keys of a burst of at most MAX_PKT_BURST
+   packets and compute the index into the user table of each packet
+   (see PKT_TO_LUTQINQ). The load is done for all packets, whatever
+   their type, as it stays within the mbuf data room. */
+static inline void qinq_keys_gather(struct rte_mbuf **mbufs, uint16_t n_pkts, struct qinq_key *keys, uint32_t *lut)
+{
+	uint16_t j;
+
+	for (j = 0; j < n_pkts; ++j)
+		prefetch_nta(mbufs[j]);
+	for (j = 0; j < n_pkts; ++j)
+		prefetch_nta(rte_pktmbuf_mtod(mbufs[j], void *));
+
+	j = 0;
+#ifdef __SSE2__
+	const __m128i mask_tci = _mm_set1_epi32(0x0000FFFF);
+	const __m128i mask_sv_lo = _mm_set1_epi32(0x0000000F);
+	const __m128i mask_sv_hi = _mm_set1_epi32(0x0000FF00);
+	const __m128i mask_cv = _mm_set1_epi32(0x0000FF0F);
+
+	for (; j + 4 <= n_pkts; j += 4) {
+		__m128i k0 = _mm_loadu_si128((const __m128i *)(rte_pktmbuf_mtod(mbufs[j], uint8_t *) + QINQ_KEY_OFFSET));
+		__m128i k1 = _mm_loadu_si128((const __m128i *)(rte_pktmbuf_mtod(mbufs[j + 1], uint8_t *) + QINQ_KEY_OFFSET));
+		__m128i k2 = _mm_loadu_si128((const __m128i *)(rte_pktmbuf_mtod(mbufs[j + 2], uint8_t *) + QINQ_KEY_OFFSET));
+		__m128i k3 = _mm_loadu_si128((const __m128i *)(rte_pktmbuf_mtod(mbufs[j + 3], uint8_t *) + QINQ_KEY_OFFSET));
+
+		_mm_store_si128((__m128i *)&keys[j], k0);
+		_mm_store_si128((__m128i *)&keys[j + 1], k1);
+		_mm_store_si128((__m128i *)&keys[j + 2], k2);
+		_mm_store_si128((__m128i *)&keys[j + 3], k3);
+
+		/* Transpose so that one register holds the svlan tci
+		   of the 4 packets and another one the cvlan tci */
+		__m128i k01 = _mm_unpacklo_epi32(k0, k1);
+		__m128i k23 = _mm_unpacklo_epi32(k2, k3);
+		__m128i sv = _mm_and_si128(_mm_unpacklo_epi64(k01, k23), mask_tci);
+		__m128i cv = _mm_and_si128(_mm_unpackhi_epi64(k01, k23), mask_tci);
+
+		__m128i idx = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(sv, mask_sv_lo), 4),
+					   _mm_slli_epi32(_mm_and_si128(sv, mask_sv_hi), 8));
+		idx = _mm_or_si128(idx, _mm_and_si128(cv, mask_cv));
+		_mm_storeu_si128((__m128i *)&lut[j], idx);
+	}
+#endif
+	for (; j < n_pkts; ++j) {
+		memcpy(&keys[j], rte_pktmbuf_mtod(mbufs[j], uint8_t *) + QINQ_KEY_OFFSET, sizeof(keys[j]));
+		lut[j] = PKT_TO_LUTQINQ(keys[j].svlan_tci, keys[j].cvlan_tci);
+	}
+}
+
+/* Write the sched metadata (pipe from the user table, traffic class
+   and queue from the dscp table) of a burst of QinQ packets. Packets
+   other than IPv4 go to traffic class 0, queue 0. If keep_tc is set,
+   a traffic class already set by a previous task (i.e. ACL) is
+   kept. */
+static inline void qinq_classify_bulk(struct rte_mbuf **mbufs, uint16_t n_pkts, const uint16_t *user_table, const uint8_t *dscp, int keep_tc)
+{
+	struct qinq_key keys[MAX_PKT_BURST];
+	uint32_t lut[MAX_PKT_BURST];
+	uint16_t j;
+
+	qinq_keys_gather(mbufs, n_pkts, keys, lut);
+
+	/* The user table is too large to stay in cache, issue all
+	   lookups of the burst before using any of them. */
+	for (j = 0; j < n_pkts; ++j)
+		PREFETCH0(&user_table[lut[j]]);
+
+	for (j = 0; j < n_pkts; ++j) {
+		uint8_t queue = 0;
+		uint32_t tc = 0;
+
+		if (keys[j].ether_type == ETYPE_IPv4) {
+			uint8_t d = dscp[keys[j].tos >> 2];
+
+			queue = d & 0x3;
+			tc = d >> 2;
+		}
+		if (keep_tc) {
+			uint32_t prev_tc;
+#if RTE_VERSION >= RTE_VERSION_NUM(1,8,0,0)
+			uint32_t dummy;
+			rte_sched_port_pkt_read_tree_path(mbufs[j], &dummy, &dummy, &prev_tc, &dummy);
+#else
+			struct rte_sched_port_hierarchy *sched = (struct rte_sched_port_hierarchy *) &mbufs[j]->pkt.hash.sched;
+			prev_tc = sched->traffic_class;
+#endif
+			if (prev_tc)
+				tc = prev_tc;
+		}
+
+		rte_sched_port_pkt_write(mbufs[j], 0, user_table[lut[j]], tc, queue, 0);
+	}
+}
+
+#endif /* _QINQ_CLASSIFY_H_ */
@@ -48,6 +48,7 @@
 #define PROX_PANIC(cond, ...) do {					\
 		if (cond) {						\
 			plog_info(__VA_ARGS__);				\
+			plog_drain();					\
 			display_end();					\
  			if (prox_cfg.flags & DSF_DAEMON) {		\
                 		pid_t ppid = getppid();			\
@@ -0,0 +1,97 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include <rte_lpm.h>
+#include <rte_atomic.h>
+
+#include "prox_lua.h"
+#include "prox_lua_types.h"
+#include "prox_malloc.h"
+#include "prox_shared.h"
+#include "task_init.h"
+#include "lconf.h"
+#include "quit.h"
+#include "log.h"
+#include "route_table.h"
+
+struct route_table *route_table_init(struct task_args *targ, int socket_id)
+{
+	const int local = targ->flags & TASK_ARG_LOCAL_LPM;
+	struct route_table *rt = NULL;
+	struct lpm4 *lpm;
+
+	PROX_PANIC(!strcmp(targ->route_table, ""), "route table not specified\n");
+	if (!local)
+		rt = prox_sh_find_socket(socket_id, targ->route_table);
+	if (!rt) {
+		int ret = lua_to_lpm4(prox_lua(), GLOBAL, targ->route_table, socket_id, &lpm);
+		PROX_PANIC(ret, "Failed to load IPv4 LPM:\n%s\n", get_lua_to_errors());
+
+		rt = prox_zmalloc(sizeof(*rt), socket_id);
+		PROX_PANIC(rt == NULL, "Failed to allocate route table %s\n", targ->route_table);
+		rt->lpm = lpm;
+		rt->socket_id = socket_id;
+		if (!local)
+			prox_sh_add_socket(socket_id, targ->route_table, rt);
+	}
+	PROX_PANIC(route_table_check_tx_ports(rt->lpm, targ),
+		   "Routing Table contains port not reachable from core %u task %u (%d tx port/ %d ring)\n",
+		   targ->lconf->id, targ->task, targ->nb_txports, targ->nb_txrings);
+
+	targ->route_table_ref = rt;
+	return rt;
+}
+
+int route_table_check_tx_ports(const struct lpm4 *lpm, const struct task_args *targ)
+{
+	for (uint32_t i = 0; i < MAX_HOP_INDEX; i++) {
+		int tx_port = lpm->next_hops[i].mac_port.out_idx;
+
+		if ((tx_port > targ->nb_txports - 1) && (tx_port > targ->nb_txrings - 1)) {
+			plog_err("Routing Table contains port %d but only %d tx port/ %d ring\n", tx_port, targ->nb_txports, targ->nb_txrings);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+struct lpm4 *route_table_publish(struct route_table *rt, struct lpm4 *lpm)
+{
+	struct lpm4 *old = rt->lpm;
+
+	/* The new table has to be complete before it becomes visible */
+	rte_wmb();
+	*(struct lpm4 * volatile *)&rt->lpm = lpm;
+	rt->generation++;
+	return old;
+}
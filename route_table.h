@@ -0,0 +1,76 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _ROUTE_TABLE_H_
+#define _ROUTE_TABLE_H_
+
+#include <inttypes.h>
+
+struct lpm4;
+struct task_args;
+
+/* IPv4 route table shared between the routing, qinq_decap4 and cgnat
+   tasks referring to it by name. The table itself can be replaced at
+   runtime: a new lpm4 is built on the master core and published with
+   a single pointer store, after which the old one is freed as soon
+   as every core using it has gone through its main loop once. */
+struct route_table {
+	struct lpm4     *lpm;
+	/* Incremented each time a new table is published */
+	uint32_t        generation;
+	int             socket_id;
+};
+
+/* Returns the current table. Tasks call this once per bulk of
+   packets and do not use the result after returning from
+   handle_bulk: this is what allows the previous table to be freed
+   once the core has handled a command. */
+static inline struct lpm4 *route_table_get(const struct route_table *rt)
+{
+	return *(struct lpm4 * const volatile *)&rt->lpm;
+}
+
+/* Returns the table targ->route_table on the socket, loading it from
+   the Lua global of the same name on first use. Tasks with the "local
+   lpm" flag each get their own copy. The table is stored in
+   targ->route_table_ref. */
+struct route_table *route_table_init(struct task_args *targ, int socket_id);
+
+/* Check that all next hops of lpm can be used by the task */
+int route_table_check_tx_ports(const struct lpm4 *lpm, const struct task_args *targ);
+
+/* Make lpm the current table and return the previous one. The caller
+   has to wait until no core uses the previous table anymore before
+   freeing it. */
+struct lpm4 *route_table_publish(struct route_table *rt, struct lpm4 *lpm);
+
+#endif /* _ROUTE_TABLE_H_ */
@@ -49,6 +49,9 @@
 #include "stats_cons.h"
 #include "stats_cons_log.h"
 #include "stats_cons_cli.h"
+#include "prox_events.h"
+#include "pcap_stream.h"
+#include "lat_stream.h"
 
 #include "input.h"
 #include "input_curses.h"
@@ -211,6 +214,8 @@ void __attribute__((noreturn)) run(uint32_t flags)
 		break;
 	}
 
+	plog_async_init();
+
 	if (flags & DSF_AUTOSTART)
 		start_core_all(-1);
 	else
@@ -246,6 +251,10 @@ void __attribute__((noreturn)) run(uint32_t flags)
 			next_update += update_interval;
 			stats_update(stats_cons_flags);
 			stats_cons_notify();
+			events_drain();
+			pcap_stream_report();
+			lat_stream_report();
+			plog_drain();
 
 			if (stop_tsc && rte_rdtsc() >= stop_tsc) {
 				stop_prox = 1;
@@ -263,6 +272,10 @@ void __attribute__((noreturn)) run(uint32_t flags)
 
 			stats_update(stats_cons_flags);
 			stats_cons_notify();
+			events_drain();
+			pcap_stream_report();
+			lat_stream_report();
+			plog_drain();
 
 			if (stop_tsc && rte_rdtsc() >= stop_tsc) {
 				stop_prox = 1;
@@ -275,6 +288,9 @@ void __attribute__((noreturn)) run(uint32_t flags)
 	if (prox_cfg.flags & DSF_WAIT_ON_QUIT) {
 		stop_core_all(-1);
 	}
+	pcap_stream_exit();
+	lat_stream_exit();
+	plog_drain();
 
 	if (prox_cfg.logbuf) {
 		file_print(prox_cfg.logbuf);
@@ -31,9 +31,11 @@
 */
 
 #include <rte_lcore.h>
+#include <rte_cycles.h>
 
 #include "prox_malloc.h"
 #include "stats_core.h"
+#include "stats_seq.h"
 #include "cqm.h"
 #include "log.h"
 #include "msr.h"
@@ -45,6 +47,7 @@ struct stats_core_manager {
 	struct rdt_features rdt_features;
 	int                msr_support;
 	int                max_core_id;
+	int                idle_enabled;
 	uint16_t           n_lcore_stats;
 	int cache_size[RTE_MAX_LCORE];
 	struct lcore_stats lcore_stats_set[0];
@@ -104,6 +107,11 @@ int stats_mbm_enabled(void)
 	return mbm_is_supported();
 }
 
+int stats_idle_enabled(void)
+{
+	return scm->idle_enabled;
+}
+
 uint32_t stats_lcore_find_stat_id(uint32_t lcore_id)
 {
 	for (int i = 0; i < scm->n_lcore_stats; ++i)
@@ -156,6 +164,8 @@ void stats_lcore_init(void)
 	get_L3_size();
 	while (prox_core_next(&lcore_id, 0) == 0) {
 		scm->lcore_stats_set[scm->n_lcore_stats++].lcore_id = lcore_id;
+		if (lcore_cfg[lcore_id].idle_mode != IDLE_MODE_NONE)
+			scm->idle_enabled = 1;
 	}
 	if (!rdt_is_supported())
 		return;
@@ -291,8 +301,25 @@ void stats_lcore_post_proc(void)
 	}
 }
 
+static void stats_lcore_update_idle(void)
+{
+	for (uint8_t i = 0; i < scm->n_lcore_stats; ++i) {
+		struct lcore_stats *ls = &scm->lcore_stats_set[i];
+		struct lcore_stats_sample *lss = &ls->sample[last_stat];
+		struct lcore_rt_stats *rt = &lcore_cfg[ls->lcore_id].rt_stats;
+		struct lcore_rt_stats snapshot;
+
+		stats_seq_read(&snapshot, rt, sizeof(snapshot), &rt->seq);
+		lss->idle_cycles = snapshot.idle_cycles;
+		lss->sleep_cycles = snapshot.sleep_cycles;
+		lss->tsc = rte_rdtsc();
+	}
+}
+
 void stats_lcore_update(void)
 {
+	if (scm->idle_enabled)
+		stats_lcore_update_idle();
 	if (scm->msr_support)
 		stats_lcore_update_freq();
 	if (rdt_is_supported())
@@ -35,7 +35,18 @@
 
 #include <inttypes.h>
 
+/* Updated by the worker core when it runs its idle strategy and
+   read by the stats core. */
+struct lcore_rt_stats {
+	uint32_t seq;          /* See stats_seq.h */
+	uint64_t idle_cycles;  /* Cycles spent pausing or sleeping */
+	uint64_t sleep_cycles; /* Part of idle_cycles spent sleeping */
+};
+
 struct lcore_stats_sample {
+	uint64_t tsc;
+	uint64_t idle_cycles;
+	uint64_t sleep_cycles;
 	uint64_t afreq;
 	uint64_t mfreq;
 	uint64_t mbm_tot_bytes;
@@ -66,6 +77,7 @@ int stats_cpu_freq_enabled(void);
 int stats_cmt_enabled(void);
 int stats_cat_enabled(void);
 int stats_mbm_enabled(void);
+int stats_idle_enabled(void);
 void stats_lcore_update(void);
 void stats_lcore_init(void);
 void stats_lcore_post_proc(void);
@@ -53,6 +53,22 @@ struct stats_latency_manager {
 
 static struct stats_latency_manager *slm;
 
+static const struct {
+	const char *name;
+	uint32_t   ppm;
+} lat_percentiles[LAT_N_PERCENTILES] = {
+	[LAT_P50]    = {"p50", 500000},
+	[LAT_P90]    = {"p90", 900000},
+	[LAT_P99]    = {"p99", 990000},
+	[LAT_P99_9]  = {"p99.9", 999000},
+	[LAT_P99_99] = {"p99.99", 999900},
+};
+
+const char *stats_latency_percentile_name(enum lat_percentile p)
+{
+	return lat_percentiles[p].name;
+}
+
 void stats_latency_reset(void)
 {
 	for (uint16_t i = 0; i < slm->n_latency; ++i)
@@ -216,6 +232,8 @@ static void stats_latency_from_lat_test(struct stats_latency *dst, struct lat_te
 		dst->min = lat_test_get_min(src);
 		dst->avg = lat_test_get_avg(src);
 		dst->stddev = lat_test_get_stddev(src);
+		for (int i = 0; i < LAT_N_PERCENTILES; ++i)
+			dst->percentile[i] = lat_test_get_percentile(src, lat_percentiles[i].ppm);
 	}
 	dst->accuracy_limit = lat_test_get_accuracy_limit(src);
 	dst->tot_packets = src->tot_pkts;
@@ -37,11 +37,21 @@
 
 #include "handle_lat.h"
 
+enum lat_percentile {
+	LAT_P50,
+	LAT_P90,
+	LAT_P99,
+	LAT_P99_9,
+	LAT_P99_99,
+	LAT_N_PERCENTILES
+};
+
 struct stats_latency {
 	struct time_unit_err avg;
 	struct time_unit_err min;
 	struct time_unit_err max;
 	struct time_unit_err stddev;
+	struct time_unit     percentile[LAT_N_PERCENTILES];
 
 	struct time_unit accuracy_limit;
 	uint64_t         lost_packets;
@@ -62,6 +72,7 @@ void stats_latency_update(void);
 void stats_latency_reset(void);
 
 int stats_get_n_latency(void);
+const char *stats_latency_percentile_name(enum lat_percentile p);
 
 #ifdef LATENCY_HISTOGRAM
 void stats_core_lat_histogram(uint8_t lcore_id, uint8_t task_id, uint64_t **buckets);
@@ -46,6 +46,14 @@
 #include "stats_latency.h"
 #include "stats_global.h"
 #include "stats_prio_task.h"
+#include "stats_core.h"
+#include "prox_cfg.h"
+#include "lconf.h"
+#include "cmd_parser.h"
+#include "handle_routing.h"
+#include "handle_acl.h"
+#include "handle_qos.h"
+#include "handle_cgnat.h"
 
 struct stats_path_str {
 	const char *str;
@@ -164,6 +172,205 @@ static uint64_t sp_task_tsc(int argc, const char *argv[])
 	return stats_get_task_stats_sample(c, t, 1)->tsc;
 }
 
+static uint64_t sp_task_handle_pkts(int argc, const char *argv[])
+{
+	uint32_t c, t;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return -1;
+	return stats_get_task_stats_sample(c, t, 1)->handle_pkts;
+}
+
+static uint64_t sp_task_handle_cycles(int argc, const char *argv[])
+{
+	uint32_t c, t;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return -1;
+	return stats_get_task_stats_sample(c, t, 1)->handle_cycles;
+}
+
+static const struct task_rt_cycles *sp_task_rt_cycles(const char *argv[], uint32_t *burst)
+{
+	uint32_t c, t;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return NULL;
+	*burst = atoi(argv[2]);
+	if (*burst > MAX_RING_BURST)
+		return NULL;
+	return stats_get_task_rt_cycles(c, t);
+}
+
+static uint64_t sp_task_handle_burst_calls(int argc, const char *argv[])
+{
+	const struct task_rt_cycles *rt_cycles;
+	uint32_t burst;
+
+	rt_cycles = sp_task_rt_cycles(argv, &burst);
+	if (!rt_cycles)
+		return -1;
+	return rt_cycles->calls[burst];
+}
+
+static uint64_t sp_task_handle_burst_cycles(int argc, const char *argv[])
+{
+	const struct task_rt_cycles *rt_cycles;
+	uint32_t burst;
+
+	rt_cycles = sp_task_rt_cycles(argv, &burst);
+	if (!rt_cycles)
+		return -1;
+	return rt_cycles->cycles[burst];
+}
+
+static uint64_t sp_task_route_lpm_miss(int argc, const char *argv[])
+{
+	uint32_t c, t;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return -1;
+	if (!prox_core_active(c, 0) || t >= lcore_cfg[c].n_tasks_all || !task_is_mode(c, t, "routing", ""))
+		return -1;
+	return task_routing_get_n_lpm_miss(lcore_cfg[c].tasks_all[t]);
+}
+
+static const struct acl_rule_stats *sp_task_acl_rule_stats(const char *argv[], uint32_t *rule)
+{
+	const struct acl_rule_stats *rule_stats;
+	uint32_t c, t, n_rules;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return NULL;
+	if (!prox_core_active(c, 0) || t >= lcore_cfg[c].n_tasks_all || !task_is_mode(c, t, "acl", ""))
+		return NULL;
+	rule_stats = task_acl_get_rule_stats(lcore_cfg[c].tasks_all[t], &n_rules);
+	*rule = atoi(argv[2]);
+	if (*rule > n_rules)
+		return NULL;
+	return rule_stats;
+}
+
+static uint64_t sp_task_acl_rule_packets(int argc, const char *argv[])
+{
+	const struct acl_rule_stats *rule_stats;
+	uint32_t rule;
+
+	rule_stats = sp_task_acl_rule_stats(argv, &rule);
+	if (!rule_stats)
+		return -1;
+	return rule_stats[rule].packets;
+}
+
+static uint64_t sp_task_acl_rule_bytes(int argc, const char *argv[])
+{
+	const struct acl_rule_stats *rule_stats;
+	uint32_t rule;
+
+	rule_stats = sp_task_acl_rule_stats(argv, &rule);
+	if (!rule_stats)
+		return -1;
+	return rule_stats[rule].bytes;
+}
+
+static uint64_t sp_task_acl_classify_cycles(int argc, const char *argv[])
+{
+	const uint64_t *hist;
+	uint32_t c, t, b;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return -1;
+	if (!prox_core_active(c, 0) || t >= lcore_cfg[c].n_tasks_all || !task_is_mode(c, t, "acl", ""))
+		return -1;
+	hist = task_acl_get_classify_hist(lcore_cfg[c].tasks_all[t]);
+	b = atoi(argv[2]);
+	if (!hist || b >= ACL_CLASSIFY_HIST_SIZE)
+		return -1;
+	return hist[b];
+}
+
+static const struct qos_tc_stats *sp_task_qos_tc_stats(const char *argv[])
+{
+	const struct qos_tc_stats *tc_stats;
+	uint32_t c, t, tc;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return NULL;
+	if (!prox_core_active(c, 0) || t >= lcore_cfg[c].n_tasks_all || !task_is_mode(c, t, "qos", ""))
+		return NULL;
+	tc_stats = task_qos_get_tc_stats(lcore_cfg[c].tasks_all[t]);
+	tc = atoi(argv[2]);
+	if (!tc_stats || tc >= RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE)
+		return NULL;
+	return &tc_stats[tc];
+}
+
+static uint64_t sp_task_qos_tc_enqueued(int argc, const char *argv[])
+{
+	const struct qos_tc_stats *tc_stats = sp_task_qos_tc_stats(argv);
+
+	return tc_stats? tc_stats->enqueued : (uint64_t)-1;
+}
+
+static uint64_t sp_task_qos_tc_dequeued(int argc, const char *argv[])
+{
+	const struct qos_tc_stats *tc_stats = sp_task_qos_tc_stats(argv);
+
+	return tc_stats? tc_stats->dequeued : (uint64_t)-1;
+}
+
+static uint64_t sp_task_qos_tc_dropped(int argc, const char *argv[])
+{
+	const struct qos_tc_stats *tc_stats = sp_task_qos_tc_stats(argv);
+
+	return tc_stats? tc_stats->dropped : (uint64_t)-1;
+}
+
+static uint64_t sp_task_qos_tc_occupancy(int argc, const char *argv[])
+{
+	const struct qos_tc_stats *tc_stats = sp_task_qos_tc_stats(argv);
+
+	if (!tc_stats)
+		return -1;
+	/* Counters are updated by the worker without synchronization */
+	uint64_t out = tc_stats->dequeued + tc_stats->dropped;
+	uint64_t in = tc_stats->enqueued;
+
+	return in > out? in - out : 0;
+}
+
+static const struct cgnat_session_stats *sp_task_cgnat_sessions(const char *argv[])
+{
+	uint32_t c, t;
+
+	if (args_to_core_task(argv[0], argv[1], &c, &t))
+		return NULL;
+	if (!prox_core_active(c, 0) || t >= lcore_cfg[c].n_tasks_all || !task_is_mode(c, t, "cgnat", ""))
+		return NULL;
+	return task_cgnat_get_session_stats(lcore_cfg[c].tasks_all[t]);
+}
+
+static uint64_t sp_task_cgnat_sessions_created(int argc, const char *argv[])
+{
+	const struct cgnat_session_stats *sessions = sp_task_cgnat_sessions(argv);
+
+	return sessions? sessions->created : (uint64_t)-1;
+}
+
+static uint64_t sp_task_cgnat_sessions_expired(int argc, const char *argv[])
+{
+	const struct cgnat_session_stats *sessions = sp_task_cgnat_sessions(argv);
+
+	return sessions? sessions->expired : (uint64_t)-1;
+}
+
+static uint64_t sp_task_cgnat_sessions_active(int argc, const char *argv[])
+{
+	const struct cgnat_session_stats *sessions = sp_task_cgnat_sessions(argv);
+
+	return sessions? sessions->active : (uint64_t)-1;
+}
+
 static uint64_t sp_l4gen_created(int argc, const char *argv[])
 {
 	struct l4_stats_sample *clast = NULL;
@@ -691,6 +898,73 @@ static uint64_t sp_latency_stddev(int argc, const char *argv[])
 	return time_unit_to_usec(&tu);
 }
 
+static uint64_t sp_latency_percentile(const char *lat_id, int tot, enum lat_percentile p)
+{
+	struct stats_latency *lat_test = NULL;
+
+	if (atoi(lat_id) >= stats_get_n_latency())
+		return -1;
+	if (tot)
+		lat_test = stats_latency_tot_get(atoi(lat_id));
+	else
+		lat_test = stats_latency_get(atoi(lat_id));
+
+	if (!lat_test->tot_packets)
+		return -1;
+
+	return time_unit_to_usec(&lat_test->percentile[p]);
+}
+
+static uint64_t sp_latency_p50(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 0, LAT_P50);
+}
+
+static uint64_t sp_latency_tot_p50(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 1, LAT_P50);
+}
+
+static uint64_t sp_latency_p90(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 0, LAT_P90);
+}
+
+static uint64_t sp_latency_tot_p90(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 1, LAT_P90);
+}
+
+static uint64_t sp_latency_p99(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 0, LAT_P99);
+}
+
+static uint64_t sp_latency_tot_p99(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 1, LAT_P99);
+}
+
+static uint64_t sp_latency_p99_9(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 0, LAT_P99_9);
+}
+
+static uint64_t sp_latency_tot_p99_9(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 1, LAT_P99_9);
+}
+
+static uint64_t sp_latency_p99_99(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 0, LAT_P99_99);
+}
+
+static uint64_t sp_latency_tot_p99_99(int argc, const char *argv[])
+{
+	return sp_latency_percentile(argv[0], 1, LAT_P99_99);
+}
+
 static uint64_t sp_ring_used(int argc, const char *argv[])
 {
 	struct ring_stats *rs = NULL;
@@ -756,6 +1030,38 @@ static uint64_t sp_global_tsc(int argc, const char *argv[])
 	return stats_get_global_stats(1)->tsc;
 }
 
+static struct lcore_stats_sample *sp_lcore_stats_sample(const char *core_str)
+{
+	uint32_t lcore_id;
+
+	if (parse_list_set(&lcore_id, core_str, 1) != 1)
+		return NULL;
+	if (!prox_core_active(lcore_id, 0))
+		return NULL;
+	return stats_get_lcore_stats_sample(stats_lcore_find_stat_id(lcore_id), 1);
+}
+
+static uint64_t sp_core_idle_cycles(int argc, const char *argv[])
+{
+	struct lcore_stats_sample *lss = sp_lcore_stats_sample(argv[0]);
+
+	return lss? lss->idle_cycles : (uint64_t)-1;
+}
+
+static uint64_t sp_core_sleep_cycles(int argc, const char *argv[])
+{
+	struct lcore_stats_sample *lss = sp_lcore_stats_sample(argv[0]);
+
+	return lss? lss->sleep_cycles : (uint64_t)-1;
+}
+
+static uint64_t sp_core_tsc(int argc, const char *argv[])
+{
+	struct lcore_stats_sample *lss = sp_lcore_stats_sample(argv[0]);
+
+	return lss? lss->tsc : (uint64_t)-1;
+}
+
 static uint64_t sp_hz(int argc, const char *argv[])
 {
 	return rte_get_tsc_hz();
@@ -783,6 +1089,25 @@ struct stats_path_str stats_paths[] = {
 	{"task.core(#).task(#).tsc", sp_task_tsc},
 	{"task.core(#).task(#).drop.tx_fail_prio(#)", sp_task_drop_tx_fail_prio},
 	{"task.core(#).task(#).rx_prio(#)", sp_task_rx_prio},
+	{"task.core(#).task(#).handle.packets", sp_task_handle_pkts},
+	{"task.core(#).task(#).handle.cycles", sp_task_handle_cycles},
+	{"task.core(#).task(#).handle.burst(#).calls", sp_task_handle_burst_calls},
+	{"task.core(#).task(#).handle.burst(#).cycles", sp_task_handle_burst_cycles},
+	{"task.core(#).task(#).route.lpm_miss", sp_task_route_lpm_miss},
+	{"task.core(#).task(#).acl.rule(#).packets", sp_task_acl_rule_packets},
+	{"task.core(#).task(#).acl.rule(#).bytes", sp_task_acl_rule_bytes},
+	{"task.core(#).task(#).acl.classify_cycles(#)", sp_task_acl_classify_cycles},
+	{"task.core(#).task(#).qos.tc(#).enqueued", sp_task_qos_tc_enqueued},
+	{"task.core(#).task(#).qos.tc(#).dequeued", sp_task_qos_tc_dequeued},
+	{"task.core(#).task(#).qos.tc(#).dropped", sp_task_qos_tc_dropped},
+	{"task.core(#).task(#).qos.tc(#).occupancy", sp_task_qos_tc_occupancy},
+	{"task.core(#).task(#).cgnat.sessions.created", sp_task_cgnat_sessions_created},
+	{"task.core(#).task(#).cgnat.sessions.expired", sp_task_cgnat_sessions_expired},
+	{"task.core(#).task(#).cgnat.sessions.active", sp_task_cgnat_sessions_active},
+
+	{"core(#).idle_cycles", sp_core_idle_cycles},
+	{"core(#).sleep_cycles", sp_core_sleep_cycles},
+	{"core(#).tsc", sp_core_tsc},
 
 	{"port(#).no_mbufs", sp_port_no_mbufs},
 	{"port(#).ierrors", sp_port_ierrors},
@@ -818,6 +1143,16 @@ struct stats_path_str stats_paths[] = {
 	{"latency(#).tot.used", sp_latency_tot_used},
 	{"latency(#).tot.total", sp_latency_tot_total},
 	{"latency(#).stddev", sp_latency_stddev},
+	{"latency(#).p50", sp_latency_p50},
+	{"latency(#).p90", sp_latency_p90},
+	{"latency(#).p99", sp_latency_p99},
+	{"latency(#).p99.9", sp_latency_p99_9},
+	{"latency(#).p99.99", sp_latency_p99_99},
+	{"latency(#).tot.p50", sp_latency_tot_p50},
+	{"latency(#).tot.p90", sp_latency_tot_p90},
+	{"latency(#).tot.p99", sp_latency_tot_p99},
+	{"latency(#).tot.p99.9", sp_latency_tot_p99_9},
+	{"latency(#).tot.p99.99", sp_latency_tot_p99_99},
 
 	{"ring(#).used", sp_ring_used},
 	{"ring(#).free", sp_ring_free},
@@ -0,0 +1,81 @@
+/*
+  Copyright(c) 2010-2017 Intel Corporation.
+  Copyright(c) 2016-2018 Viosoft Corporation.
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in
+      the documentation and/or other materials provided with the
+      distribution.
+    * Neither the name of Intel Corporation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef _STATS_SEQ_H_
+#define _STATS_SEQ_H_
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <rte_atomic.h>
+
+/* Sequence counter protecting a group of statistics that is written
+   by a single core and read by the stats core. The writer makes the
+   counter odd while it updates the group and even again when done,
+   which only costs two plain stores to a cache line that the writer
+   owns anyway. A reader retries its copy until it sees the same even
+   value before and after, which gives it a coherent snapshot of all
+   the counters in the group. If the writer keeps the group busy, the
+   reader gives up after STATS_SEQ_MAX_RETRIES and keeps the last
+   copy, where each counter is still individually valid. */
+
+#define STATS_SEQ_MAX_RETRIES 64
+
+static inline void stats_seq_write_begin(uint32_t *seq)
+{
+	*(volatile uint32_t *)seq = *seq + 1;
+	rte_smp_wmb();
+}
+
+static inline void stats_seq_write_end(uint32_t *seq)
+{
+	rte_smp_wmb();
+	*(volatile uint32_t *)seq = *seq + 1;
+}
+
+/* Copy size bytes from src (which contains seq) to dst. Returns 0 if
+   the copy is a coherent snapshot. */
+static inline int stats_seq_read(void *dst, const void *src, size_t size, const uint32_t *seq)
+{
+	for (int i = 0; i < STATS_SEQ_MAX_RETRIES; ++i) {
+		uint32_t start = *(const volatile uint32_t *)seq;
+
+		rte_smp_rmb();
+		memcpy(dst, src, size);
+		rte_smp_rmb();
+		if (!(start & 1) && start == *(const volatile uint32_t *)seq)
+			return 0;
+	}
+	return -1;
+}
+
+#endif /* _STATS_SEQ_H_ */
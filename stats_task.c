@@ -99,12 +99,24 @@ uint64_t stats_core_task_last_tsc(uint8_t lcore_id, uint8_t task_id)
 	return lcore_task_stats_all[lcore_id].task_stats[task_id].sample[last_stat].tsc;
 }
 
-static void init_core_port(struct task_stats *ts, struct task_rt_stats *stats, uint8_t flags)
+const struct task_rt_cycles *stats_get_task_rt_cycles(uint32_t lcore_id, uint32_t task_id)
 {
-	ts->stats = stats;
+	return lcore_task_stats_all[lcore_id].task_stats[task_id].rt_cycles;
+}
+
+static void init_core_port(struct task_stats *ts, struct task_base_aux *aux, uint8_t flags)
+{
+	ts->stats = &aux->stats_pub;
+	ts->rt_cycles = &aux->rt_cycles;
 	ts->flags |= flags;
 }
 
+static void stats_task_update_cycles(struct task_stats_sample *last, const struct task_rt_cycles *rt_cycles)
+{
+	last->handle_pkts = rt_cycles->tot_pkts;
+	last->handle_cycles = rt_cycles->tot_cycles;
+}
+
 void stats_task_post_proc(void)
 {
 	for (uint8_t task_id = 0; task_id < nb_tasks_tot; ++task_id) {
@@ -128,12 +140,16 @@ void stats_task_update(void)
 	for (uint8_t task_id = 0; task_id < nb_tasks_tot; ++task_id) {
 		struct task_stats *cur_task_stats = task_stats_set[task_id];
 		struct task_rt_stats *stats = cur_task_stats->stats;
+		struct task_rt_stats snapshot;
 		struct task_stats_sample *last = &cur_task_stats->sample[last_stat];
 
-		/* Read TX first and RX second, in order to prevent displaying
-		   a negative packet loss. Depending on the configuration
-		   (when forwarding, for example), TX might be bigger than RX. */
 		before = rte_rdtsc();
+		if (stats_seq_read(&snapshot, stats, sizeof(snapshot), &stats->seq) == 0)
+			stats = &snapshot;
+		/* Without a coherent snapshot, read TX first and RX
+		   second, in order to prevent displaying a negative
+		   packet loss. Depending on the configuration (when
+		   forwarding, for example), TX might be bigger than RX. */
 		last->tx_pkt_count = stats->tx_pkt_count;
 		last->drop_tx_fail = stats->drop_tx_fail;
 		last->drop_discard = stats->drop_discard;
@@ -145,6 +161,7 @@ void stats_task_update(void)
 		last->drop_bytes   = stats->drop_bytes;
 		after = rte_rdtsc();
 		last->tsc = (before >> 1) + (after >> 1);
+		stats_task_update_cycles(last, cur_task_stats->rt_cycles);
 	}
 }
 
@@ -183,11 +200,11 @@ void stats_task_init(void)
 		lconf = &lcore_cfg[lcore_id];
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
 			struct task_args *targ = &lconf->targs[task_id];
-			struct task_rt_stats *stats = &lconf->tasks_all[task_id]->aux->stats;
+			struct task_base_aux *aux = lconf->tasks_all[task_id]->aux;
 			if (targ->nb_rxrings == 0 && targ->nb_txrings == 0) {
 				struct task_stats *ts = &lcore_task_stats_all[lcore_id].task_stats[task_id];
 
-				init_core_port(ts, stats, TASK_STATS_RX | TASK_STATS_TX);
+				init_core_port(ts, aux, TASK_STATS_RX | TASK_STATS_TX);
 				task_stats_set[nb_tasks_tot++] = ts;
 			}
 		}
@@ -199,11 +216,11 @@ void stats_task_init(void)
 		lconf = &lcore_cfg[lcore_id];
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
 			struct task_args *targ = &lconf->targs[task_id];
-			struct task_rt_stats *stats = &lconf->tasks_all[task_id]->aux->stats;
+			struct task_base_aux *aux = lconf->tasks_all[task_id]->aux;
 			if (targ->nb_rxrings != 0 && targ->nb_txrings == 0) {
 				struct task_stats *ts = &lcore_task_stats_all[lcore_id].task_stats[task_id];
 
-				init_core_port(ts, stats, TASK_STATS_TX);
+				init_core_port(ts, aux, TASK_STATS_TX);
 				task_stats_set[nb_tasks_tot++] = ts;
 			}
 		}
@@ -215,11 +232,11 @@ void stats_task_init(void)
 		lconf = &lcore_cfg[lcore_id];
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
 			struct task_args *targ = &lconf->targs[task_id];
-			struct task_rt_stats *stats = &lconf->tasks_all[task_id]->aux->stats;
+			struct task_base_aux *aux = lconf->tasks_all[task_id]->aux;
 			if (targ->nb_rxrings == 0 && targ->nb_txrings != 0) {
 				struct task_stats *ts = &lcore_task_stats_all[lcore_id].task_stats[task_id];
 
-				init_core_port(ts, stats, TASK_STATS_RX);
+				init_core_port(ts, aux, TASK_STATS_RX);
 				task_stats_set[nb_tasks_tot++] = ts;
 			}
 		}
@@ -231,11 +248,11 @@ void stats_task_init(void)
 		lconf = &lcore_cfg[lcore_id];
 		for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
 			struct task_args *targ = &lconf->targs[task_id];
-			struct task_rt_stats *stats = &lconf->tasks_all[task_id]->aux->stats;
+			struct task_base_aux *aux = lconf->tasks_all[task_id]->aux;
 			if (targ->nb_rxrings != 0 && targ->nb_txrings != 0) {
 				struct task_stats *ts = &lcore_task_stats_all[lcore_id].task_stats[task_id];
 
-				init_core_port(ts, stats, 0);
+				init_core_port(ts, aux, 0);
 				task_stats_set[nb_tasks_tot++] = ts;
 			}
 		}
@@ -36,6 +36,8 @@
 #include <inttypes.h>
 
 #include "clock.h"
+#include "defaults.h"
+#include "stats_seq.h"
 
 /* The struct task_stats is read/write from the task itself and
    read-only from the core that collects the stats. Since only the
@@ -49,9 +51,18 @@
    the statistics core through atomic primitives, for example through
    rte_atomic32_set(). The accuracy would be determined by the
    frequency at which the statistics are transferred to the statistics
-   core. */
+   core.
+
+   To allow the stats core to take a coherent snapshot of all the
+   counters (for example RX and TX of the same bulk), the task does
+   not update the copy read by the stats core. It accumulates into
+   its own copy and the thread publishes it after each bulk that was
+   handled, and after running tsc_tasks (which also covers updates
+   done on empty polls), through task_stats_publish(). Only the short
+   publish is bracketed by the seq counter (see stats_seq.h). */
 
 struct task_rt_stats {
+	uint32_t	seq;
 	uint32_t	rx_pkt_count;
 	uint32_t	tx_pkt_count;
 	uint32_t	drop_tx_fail;
@@ -63,6 +74,17 @@ struct task_rt_stats {
 	uint64_t        drop_bytes;
 } __attribute__((packed)) __rte_cache_aligned;
 
+/* Cycles spent in handle_bulk, indexed by the number of packets
+   passed to handle_bulk. Only updated while cycle accounting is
+   active on the core ("cycles distr start"). The totals over all
+   buckets are kept as well for the periodic stats. */
+struct task_rt_cycles {
+	uint64_t calls[MAX_RING_BURST + 1];
+	uint64_t cycles[MAX_RING_BURST + 1];
+	uint64_t tot_pkts;
+	uint64_t tot_cycles;
+};
+
 #ifdef PROX_STATS
 #define TASK_STATS_ADD_IDLE(stats, cycles) do {				\
 		(stats)->idle_cycles += (cycles) + rdtsc_overhead_stats; \
@@ -100,8 +122,24 @@ struct task_rt_stats {
 		(stats)->drop_bytes += bytes;		\
 	} while (0)					\
 
+static inline void task_stats_publish(struct task_rt_stats *pub, const struct task_rt_stats *stats)
+{
+	stats_seq_write_begin(&pub->seq);
+	pub->rx_pkt_count = stats->rx_pkt_count;
+	pub->tx_pkt_count = stats->tx_pkt_count;
+	pub->drop_tx_fail = stats->drop_tx_fail;
+	pub->drop_discard = stats->drop_discard;
+	pub->drop_handled = stats->drop_handled;
+	pub->idle_cycles = stats->idle_cycles;
+	pub->rx_bytes = stats->rx_bytes;
+	pub->tx_bytes = stats->tx_bytes;
+	pub->drop_bytes = stats->drop_bytes;
+	stats_seq_write_end(&pub->seq);
+}
+
 #define START_EMPTY_MEASSURE() uint64_t cur_tsc = rte_rdtsc();
 #else
+static inline void task_stats_publish(__attribute__((unused)) struct task_rt_stats *pub, __attribute__((unused)) const struct task_rt_stats *stats) {}
 #define TASK_STATS_ADD_IDLE(stats, cycles) do {} while(0)
 #define TASK_STATS_ADD_TX(stats, ntx)  do {} while(0)
 #define TASK_STATS_ADD_DROP_TX_FAIL(stats, ntx)  do {} while(0)
@@ -125,6 +163,8 @@ struct task_stats_sample {
 	uint64_t rx_bytes;
 	uint64_t tx_bytes;
 	uint64_t drop_bytes;
+	uint64_t handle_pkts;   /* packets passed to handle_bulk while cycle accounting is active */
+	uint64_t handle_cycles; /* cycles spent in handle_bulk for these packets */
 };
 
 struct task_stats {
@@ -137,6 +177,7 @@ struct task_stats {
 	struct task_stats_sample sample[2];
 
 	struct task_rt_stats *stats;
+	struct task_rt_cycles *rt_cycles;
 	/* flags set if total RX/TX values need to be reported set at
 	   initialization time, only need to access stats values in port */
 	uint8_t flags;
@@ -157,5 +198,6 @@ uint64_t stats_core_task_tot_rx(uint8_t lcore_id, uint8_t task_id);
 uint64_t stats_core_task_tot_tx(uint8_t lcore_id, uint8_t task_id);
 uint64_t stats_core_task_tot_drop(uint8_t lcore_id, uint8_t task_id);
 uint64_t stats_core_task_last_tsc(uint8_t lcore_id, uint8_t task_id);
+const struct task_rt_cycles *stats_get_task_rt_cycles(uint32_t lcore_id, uint32_t task_id);
 
 #endif /* _STATS_TASK_H_ */
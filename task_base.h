@@ -165,8 +165,10 @@ struct task_base;
 typedef uint16_t (*rx_pkt_func) (struct task_base *tbase, struct rte_mbuf ***mbufs);
 
 struct task_base_aux {
-	/* Not used when PROX_STATS is not defined */
+	/* Not used when PROX_STATS is not defined. stats is only
+	   accessed by the task, stats_pub by the stats core. */
 	struct task_rt_stats stats;
+	struct task_rt_stats stats_pub;
 	struct task_rt_dump task_rt_dump;
 
 	/* Used if TASK_TSC_RX is enabled*/
@@ -183,6 +185,8 @@ struct task_base_aux {
 
 	uint32_t rx_bucket[MAX_RING_BURST + 1];
 	uint32_t tx_bucket[MAX_RING_BURST + 1];
+	struct task_rt_cycles rt_cycles;
+	int (*handle_bulk_orig)(struct task_base *tbase, struct rte_mbuf **mbufs, const uint16_t n_pkts);
 	int (*tx_pkt_l2)(struct task_base *tbase, struct rte_mbuf **mbufs, const uint16_t n_pkts, uint8_t *out);
 	int (*tx_pkt_orig)(struct task_base *tbase, struct rte_mbuf **mbufs, const uint16_t n_pkts, uint8_t *out);
 	int (*tx_pkt_hw)(struct task_base *tbase, struct rte_mbuf **mbufs, const uint16_t n_pkts, uint8_t *out);
@@ -46,6 +46,7 @@
 
 struct rte_mbuf;
 struct lcore_cfg;
+struct route_table;
 
 #if MAX_RINGS_PER_TASK < PROX_MAX_PORTS
 #error MAX_RINGS_PER_TASK < PROX_MAX_PORTS
@@ -62,6 +63,11 @@ struct lcore_cfg;
 #define	TASK_ARG_DO_NOT_SET_SRC_MAC 0x200
 #define	TASK_ARG_DO_NOT_SET_DST_MAC 0x400
 #define	TASK_ARG_HW_SRC_MAC 	0x800
+#define	TASK_ARG_PREBUILT_MBUFS	0x1000
+#define	TASK_ARG_ACL_SHADOW	0x2000
+#define	TASK_ARG_ACL_STATS	0x4000
+#define	TASK_ARG_POLICE_GROUP	0x8000
+#define	TASK_ARG_QOS_TC_STATS	0x10000
 
 enum protocols {IPV4, ARP, IPV6};
 
@@ -69,6 +75,8 @@ struct qos_cfg {
 	struct rte_sched_port_params port_params;
 	struct rte_sched_subport_params subport_params[1];
 	struct rte_sched_pipe_params pipe_params[1];
+	uint32_t dequeue_ns;     /* 0: dequeue from the enqueue path */
+	uint32_t dequeue_budget; /* packets per dequeue interval */
 };
 
 enum task_mode {NOT_SET, MASTER, QINQ_DECAP4, QINQ_DECAP6,
@@ -110,6 +118,14 @@ enum police_action {
 	ACT_INVALID = 4
 };
 
+/* Distribution of the delays added by the impair task */
+enum delay_distr {
+	DELAY_DISTR_UNIFORM,	/* delay us + [0, random delay us[ */
+	DELAY_DISTR_NORMAL,	/* mean delay us, standard deviation random delay us */
+	DELAY_DISTR_PARETO,	/* mean delay us, standard deviation random delay us */
+	DELAY_DISTR_CDF,	/* delay us + delay taken from delay cdf file */
+};
+
 /* Configuration for task that is only used during startup. */
 struct task_args {
 	struct task_base       *tbase;
@@ -180,6 +196,8 @@ struct task_args {
 	uint32_t               n_max_rules;
 	uint32_t               random_delay_us;
 	uint32_t               delay_us;
+	enum delay_distr       delay_distr;
+	char                   delay_cdf_file[256];
 	uint32_t               cpe_table_timeout_ms;
 	uint32_t               etype;
 #ifdef GRE_TP
@@ -197,21 +215,29 @@ struct task_args {
 	char                   rand_str[64][64];
 	uint32_t               rand_offset[64];
 	char                   pcap_file[256];
+	uint32_t               pcap_stream_size; /* bytes, 0: dump on stop */
+	uint32_t               pcap_rotate_size; /* bytes, 0: no rotation */
+	uint32_t               snaplen;
+	char                   pcap_filter[256];
 	uint32_t               accur_pos;
 	uint32_t               sig_pos;
 	uint32_t               sig;
 	uint32_t               lat_pos;
 	uint32_t               packet_id_pos;
 	uint32_t               latency_buffer_size;
+	uint32_t               latency_stream_size;
 	uint32_t               bucket_size;
 	uint32_t               lat_enabled;
 	uint32_t               pkt_size;
 	uint8_t                pkt_inline[ETHER_MAX_LEN];
+	char                   template_copy[16];
 	uint32_t               probability;
 	char                   nat_table[256];
 	uint32_t               use_src;
 	char                   route_table[256];
+	struct route_table     *route_table_ref;
 	char                   rules[256];
+	char                   acl_alg[16];
 	char                   dscp[256];
 	char                   tun_bindings[256];
 	char                   cpe_table_name[256];
@@ -238,6 +264,10 @@ struct task_args {
 	struct rte_hash              *private_ip_port_hash;
 	struct rte_hash              *private_ip_hash;
 	struct private_ip_info       *private_ip_info;
+	uint32_t                     n_private_flow_entries;
+	uint32_t                     session_timeout_ms; /* 0: sessions never expire */
+	uint32_t                     port_block_size; /* 0: no port block allocation */
+	uint32_t                     port_quota; /* max ports per subscriber, 0: no limit */
 	struct rte_ring			**ctrl_rx_rings;
 	struct rte_ring			**ctrl_tx_rings;
 	int				n_ctrl_rings;
@@ -30,7 +30,13 @@
   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <time.h>
 #include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_version.h>
+#if RTE_VERSION >= RTE_VERSION_NUM(17,5,0,0)
+#include <rte_pause.h>
+#endif
 #include <rte_table_hash.h>
 
 #include "log.h"
@@ -41,34 +47,40 @@
 #include "hash_entry_types.h"
 #include "defines.h"
 #include "hash_utils.h"
+#include "heap.h"
+#include "prox_malloc.h"
+#include "quit.h"
+
+/* term, drain and ctrl */
+#define N_BUILTIN_TSC_TASKS 3
 
-struct tsc_task {
-	uint64_t tsc;
-	uint64_t (* tsc_task)(struct lcore_cfg *lconf);
-};
+/* Initial time spent idle after the first empty loop iteration */
+#define IDLE_MIN_TSC 256
+/* nanosleep() returns up to the timer slack (50 usec by default)
+   after the requested time. Only that much less is slept, and waits
+   shorter than the slack are spent spinning. */
+#define IDLE_TIMER_SLACK_NSEC 50000
 
-static uint64_t tsc_drain(struct lcore_cfg *lconf)
+static uint64_t tsc_drain(struct lcore_cfg *lconf, void *data)
 {
 	lconf_flush_all_queues(lconf);
 	return DRAIN_TIMEOUT;
 }
 
-static uint64_t tsc_term(struct lcore_cfg *lconf)
+/* data points to a flag that is set when the set of running tasks
+   has changed. The term tsc_task is then executed again as soon as
+   possible so that pending requests are handled without delay. */
+static uint64_t tsc_term(struct lcore_cfg *lconf, void *data)
 {
 	if (lconf_is_req(lconf) && lconf_do_flags(lconf)) {
 		lconf_flush_all_queues(lconf);
-		return -2;
+		*(int *)data = 1;
+		return 0;
 	}
 	return TERM_TIMEOUT;
 }
 
-static uint64_t tsc_period(struct lcore_cfg *lconf)
-{
-	lconf->period_func(lconf->period_data);
-	return lconf->period_timeout;
-}
-
-static uint64_t tsc_ctrl(struct lcore_cfg *lconf)
+static uint64_t tsc_ctrl(struct lcore_cfg *lconf, void *data)
 {
 	const uint8_t n_tasks_all = lconf->n_tasks_all;
 	void *msgs[MAX_RING_BURST];
@@ -99,6 +111,93 @@ static uint64_t tsc_ctrl(struct lcore_cfg *lconf)
 	return lconf->ctrl_timeout;
 }
 
+/* Run all tsc_tasks for which the deadline has passed and
+   reschedule them. Expired tsc_tasks are first removed from the heap
+   so that a tsc_task asking to be rescheduled immediately is only run
+   once per call. Returns the tsc at which the next tsc_task expires. */
+static uint64_t tsc_tasks_run(struct lcore_cfg *lconf, struct heap *tsc_heap, uint64_t cur_tsc)
+{
+	struct tsc_task *expired[MAX_TSC_TASKS_PER_CORE + N_BUILTIN_TSC_TASKS];
+	uint32_t n_expired = 0;
+	uint64_t resched_diff;
+
+	while (heap_top_is_lower(tsc_heap, cur_tsc + 1))
+		expired[n_expired++] = TSC_TASK_UPCAST(heap_pop(tsc_heap));
+
+	for (uint32_t i = 0; i < n_expired; ++i) {
+		struct tsc_task *t = expired[i];
+
+		resched_diff = t->tsc_task(lconf, t->data);
+		if (resched_diff == TSC_TASK_STOP)
+			continue;
+		t->tsc += resched_diff;
+		heap_add(tsc_heap, &t->heap_ref, t->tsc);
+	}
+
+	return heap_top_priority(tsc_heap);
+}
+
+/* Called after a loop iteration in which no task received
+   packets. The time spent idle doubles with each consecutive empty
+   iteration, up to max_idle_tsc, and never extends beyond the next
+   tsc_task deadline. In IDLE_MODE_SLEEP, once the maximum has been
+   reached, the CPU is yielded to the kernel instead of spinning on
+   pause. Returns the new backoff. */
+static uint64_t thread_idle(struct lcore_cfg *lconf, uint64_t backoff, uint64_t max_idle_tsc, uint64_t next_tsc)
+{
+	uint64_t start = rte_rdtsc();
+	uint64_t end;
+
+	backoff = backoff ? backoff * 2 : IDLE_MIN_TSC;
+	if (backoff > max_idle_tsc)
+		backoff = max_idle_tsc;
+
+	if (start >= next_tsc)
+		return backoff;
+	end = next_tsc - start < backoff ? next_tsc : start + backoff;
+
+	if (lconf->idle_mode == IDLE_MODE_SLEEP && backoff == max_idle_tsc) {
+		/* Only sleep for what is left of the budget, minus the
+		   timer slack */
+		uint64_t now = rte_rdtsc();
+		uint64_t nsec = now < end ? tsc_to_nsec(end - now) : 0;
+		uint64_t woken = start;
+
+		if (nsec > IDLE_TIMER_SLACK_NSEC) {
+			nsec -= IDLE_TIMER_SLACK_NSEC;
+			struct timespec req = {
+				.tv_sec = nsec / 1000000000,
+				.tv_nsec = nsec % 1000000000,
+			};
+			nanosleep(&req, NULL);
+			woken = rte_rdtsc();
+		}
+		/* Spin for the rest of the budget, also when a signal
+		   ended the sleep early */
+		while (rte_rdtsc() < end)
+			rte_pause();
+		end = rte_rdtsc();
+		stats_seq_write_begin(&lconf->rt_stats.seq);
+		lconf->rt_stats.sleep_cycles += woken - start;
+	} else {
+		while (rte_rdtsc() < end)
+			rte_pause();
+		end = rte_rdtsc();
+		stats_seq_write_begin(&lconf->rt_stats.seq);
+	}
+	lconf->rt_stats.idle_cycles += end - start;
+	stats_seq_write_end(&lconf->rt_stats.seq);
+
+	return backoff;
+}
+
+static void tsc_task_schedule(struct heap *tsc_heap, struct tsc_task *t, uint64_t tsc)
+{
+	t->tsc = tsc;
+	t->heap_ref.elem = NULL;
+	heap_add(tsc_heap, &t->heap_ref, tsc);
+}
+
 int thread_generic(struct lcore_cfg *lconf)
 {
 	struct task_base *tasks[MAX_TASKS_PER_CORE];
@@ -106,90 +205,91 @@ int thread_generic(struct lcore_cfg *lconf)
 	struct rte_mbuf **mbufs;
 	uint64_t cur_tsc = rte_rdtsc();
 	uint8_t zero_rx[MAX_TASKS_PER_CORE] = {0};
-	struct tsc_task tsc_tasks[] = {
-		{.tsc = cur_tsc, .tsc_task = tsc_term},
-		{.tsc = cur_tsc + DRAIN_TIMEOUT, .tsc_task = tsc_drain},
-		{.tsc = -1},
-		{.tsc = -1},
-		{.tsc = -1},
+	/* Adaptive polling: a task for which rx_pkt returned no packets
+	   is skipped for poll_backoff iterations. The backoff doubles on
+	   each empty poll up to max_poll_skip and is reset as soon as
+	   packets are received, so busy tasks are polled every loop. */
+	uint8_t adaptive[MAX_TASKS_PER_CORE] = {0};
+	uint32_t poll_skip[MAX_TASKS_PER_CORE] = {0};
+	uint32_t poll_backoff[MAX_TASKS_PER_CORE] = {0};
+	const uint32_t max_poll_skip = lconf->max_poll_skip;
+	/* Idle strategy, only used if no task needs to run on every
+	   iteration. */
+	int idle_enabled = 0;
+	uint64_t idle_backoff = 0;
+	const uint64_t max_idle_tsc = usec_to_tsc(lconf->max_idle_us);
+	uint16_t rx_loop;
+	struct tsc_task builtin[N_BUILTIN_TSC_TASKS] = {
+		{.tsc_task = tsc_term},
+		{.tsc_task = tsc_drain},
+		{.tsc_task = tsc_ctrl},
 	};
+	int tasks_changed = 0;
 	uint8_t n_tasks_run = lconf->n_tasks_run;
+	struct heap *tsc_heap;
+	uint64_t next_tsc;
 
-	if (lconf->period_func) {
-		tsc_tasks[2].tsc = cur_tsc + lconf->period_timeout;
-		tsc_tasks[2].tsc_task = tsc_period;
-	}
+	tsc_heap = heap_create(N_BUILTIN_TSC_TASKS + lconf->n_tsc_tasks, rte_lcore_to_socket_id(lconf->id));
+	PROX_PANIC(tsc_heap == NULL, "Failed to allocate tsc_task heap on core %u\n", lconf->id);
+
+	builtin[0].data = &tasks_changed;
+	tsc_task_schedule(tsc_heap, &builtin[0], cur_tsc);
+	tsc_task_schedule(tsc_heap, &builtin[1], cur_tsc + DRAIN_TIMEOUT);
 
 	for (uint8_t task_id = 0; task_id < lconf->n_tasks_all; ++task_id) {
-		if (lconf->ctrl_func_m[task_id]) {
-			tsc_tasks[3].tsc = cur_tsc + lconf->ctrl_timeout;
-			tsc_tasks[3].tsc_task = tsc_ctrl;
-			break;
-		}
-		if (lconf->ctrl_func_p[task_id]) {
-			tsc_tasks[3].tsc = cur_tsc + lconf->ctrl_timeout;
-			tsc_tasks[3].tsc_task = tsc_ctrl;
+		if (lconf->ctrl_func_m[task_id] || lconf->ctrl_func_p[task_id]) {
+			tsc_task_schedule(tsc_heap, &builtin[2], cur_tsc + lconf->ctrl_timeout);
 			break;
 		}
 	}
 
-	/* sort tsc tasks */
-	for (size_t i = 0; i < sizeof(tsc_tasks)/sizeof(tsc_tasks[0]); ++i) {
-		for (size_t j = i + 1; j < sizeof(tsc_tasks)/sizeof(tsc_tasks[0]); ++j) {
-			if (tsc_tasks[i].tsc > tsc_tasks[j].tsc) {
-				struct tsc_task tmp = tsc_tasks[i];
-				tsc_tasks[i] = tsc_tasks[j];
-				tsc_tasks[j] = tmp;
-			}
-		}
+	for (uint8_t i = 0; i < lconf->n_tsc_tasks; ++i) {
+		struct tsc_task *t = &lconf->tsc_tasks[i];
+
+		tsc_task_schedule(tsc_heap, t, cur_tsc + t->start_timeout);
 	}
-	struct tsc_task next_tsc = tsc_tasks[0];
+
+	next_tsc = heap_top_priority(tsc_heap);
 
 	for (;;) {
 		cur_tsc = rte_rdtsc();
-		/* Sort scheduled tsc_tasks starting from earliest
-		   first. A linear search is performed moving
-		   tsc_tasks that are scheduled earlier to the front
-		   of the list. There is a high frequency tsc_task in
-		   most cases. As a consequence, the currently
-		   scheduled tsc_task will be rescheduled to be
-		   executed as the first again. If many tsc_tasks are
-		   to be used, the algorithm should be replaced with a
-		   priority-queue (heap). */
-		if (unlikely(cur_tsc >= next_tsc.tsc)) {
-			uint64_t resched_diff = tsc_tasks[0].tsc_task(lconf);
-
-			if (resched_diff == (uint64_t)-2) {
+		/* The tsc_tasks are kept in a heap ordered by deadline.
+		   Only the earliest deadline is checked in the main
+		   loop, independently of the number of tsc_tasks. */
+		if (unlikely(cur_tsc >= next_tsc)) {
+			next_tsc = tsc_tasks_run(lconf, tsc_heap, cur_tsc);
+			lconf_publish_stats(lconf);
+
+			if (tasks_changed) {
+				tasks_changed = 0;
 				n_tasks_run = lconf->n_tasks_run;
-				if (!n_tasks_run)
+				if (!n_tasks_run) {
+					prox_free(tsc_heap);
 					return 0;
+				}
+				idle_enabled = lconf->idle_mode != IDLE_MODE_NONE;
+				idle_backoff = 0;
 				for (int i = 0; i < lconf->n_tasks_run; ++i) {
 					tasks[i] = lconf->tasks_run[i];
 
 					uint8_t task_id = lconf_get_task_id(lconf, tasks[i]);
 					if (lconf->targs[task_id].task_init->flag_features & TASK_FEATURE_ZERO_RX)
 						zero_rx[i] = 1;
+					/* Tasks that need to run on every
+					   iteration are never skipped. */
+					if (zero_rx[i])
+						idle_enabled = 0;
+					adaptive[i] = (lconf->flags & LCONF_FLAG_ADAPTIVE_POLL) &&
+						!zero_rx[i] &&
+						lconf->targs[task_id].tx_opt_ring_task == NULL;
+					poll_skip[i] = 0;
+					poll_backoff[i] = 0;
 				}
 			}
-
-			uint64_t new_tsc = tsc_tasks[0].tsc + resched_diff;
-			tsc_tasks[0].tsc = new_tsc;
-			next_tsc.tsc = new_tsc;
-
-			for (size_t i = 1; i < sizeof(tsc_tasks)/sizeof(tsc_tasks[0]); ++i) {
-				if (new_tsc < tsc_tasks[i].tsc) {
-					if (i > 1) {
-						tsc_tasks[i - 1] = next_tsc;
-						next_tsc = tsc_tasks[0];
-					}
-					break;
-				}
-				else
-					tsc_tasks[i - 1] = tsc_tasks[i];
-			}
 		}
 
 		uint16_t nb_rx;
+		rx_loop = 0;
 		for (uint8_t task_id = 0; task_id < n_tasks_run; ++task_id) {
 			struct task_base *t = tasks[task_id];
 			struct task_args *targ = &lconf->targs[task_id];
@@ -199,14 +299,34 @@ int thread_generic(struct lcore_cfg *lconf)
 			if (unlikely(next[task_id] && (targ->tx_opt_ring_task == NULL))) {
 				// plogx_info("task %d is too busy\n", task_id);
 				next[task_id] = 0;
+				rx_loop = 1;
+			} else if (unlikely(poll_skip[task_id])) {
+				/* Not polled, so not known to be idle */
+				poll_skip[task_id]--;
+				rx_loop = 1;
 			} else {
 				nb_rx = t->rx_pkt(t, &mbufs);
+				rx_loop |= nb_rx;
 				if (likely(nb_rx || zero_rx[task_id])) {
 					next[task_id] = t->handle_bulk(t, mbufs, nb_rx);
+					poll_backoff[task_id] = 0;
+					task_stats_publish(&t->aux->stats_pub, &t->aux->stats);
+				} else if (adaptive[task_id]) {
+					poll_backoff[task_id] = poll_backoff[task_id] ? poll_backoff[task_id] * 2 : 1;
+					if (poll_backoff[task_id] > max_poll_skip)
+						poll_backoff[task_id] = max_poll_skip;
+					poll_skip[task_id] = poll_backoff[task_id];
 				}
 			}
 
 		}
+
+		if (unlikely(idle_enabled)) {
+			if (rx_loop)
+				idle_backoff = 0;
+			else
+				idle_backoff = thread_idle(lconf, idle_backoff, max_idle_tsc, next_tsc);
+		}
 	}
 	return 0;
 }
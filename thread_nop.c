@@ -66,6 +66,7 @@ int thread_nop(struct lcore_cfg *lconf)
 		if (cur_tsc > drain_tsc) {
 			drain_tsc = cur_tsc + DRAIN_TIMEOUT;
 			lconf_flush_all_queues(lconf);
+			lconf_publish_stats(lconf);
 		}
 
 		for (uint8_t task_id = 0; task_id < n_tasks_run; ++task_id) {
@@ -74,6 +75,7 @@ int thread_nop(struct lcore_cfg *lconf)
 
 			if (likely(nb_rx)) {
 				handle_nop_bulk(t, mbufs, nb_rx);
+				task_stats_publish(&t->aux->stats_pub, &t->aux->stats);
 			}
 		}
 	}
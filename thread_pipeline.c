@@ -288,12 +288,15 @@ int thread_pipeline(struct lcore_cfg *lconf)
 
 			if (cur_tsc > term_tsc) {
 				term_tsc = cur_tsc + TERM_TIMEOUT;
-				if (lconf->msg.req && lconf->msg.type == LCONF_MSG_STOP) {
+				struct lconf_msg *msg = lconf_peek_msg(lconf);
+
+				if (msg && msg->type == LCONF_MSG_STOP) {
+					lconf_msg_done(lconf);
 					lconf->flags &= ~LCONF_FLAG_RUNNING;
 					break;
 				}
-				if (!lconf_is_req(lconf)) {
-					lconf_unset_req(lconf);
+				if (msg) {
+					lconf_msg_done(lconf);
 					plog_warn("Command ignored (lconf functions not supported in Packet Framework pipelines)\n");
 				}
 			}